@@ -140,6 +140,7 @@ if(NOT DEFINED ${proj}_DIR)
       -DGLEW_INCLUDE_DIR:PATH=${GLEW_INCLUDE_DIR}
       -DGLEW_LIBRARY:FILEPATH=${GLEW_LIBRARY}
       -DUSE_LDI_DETECTION:BOOL=${USE_LDI_DETECTION}
+      -DUSE_HEADLESS_SIMULATION:BOOL=${USE_HEADLESS_SIMULATION}
     DEPENDS
       ${${proj}_DEPENDENCIES}
     )
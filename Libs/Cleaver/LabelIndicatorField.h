@@ -0,0 +1,104 @@
+/*=========================================================================
+
+  Program: Bender
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+#ifndef LABELINDICATORFIELD_H
+#define LABELINDICATORFIELD_H
+
+// Cleaver includes
+#include <Cleaver/ScalarField.h>
+#include <Cleaver/BoundingBox.h>
+
+// ITK includes
+#include <itkImage.h>
+
+// STD includes
+#include <vector>
+
+namespace Cleaver {
+
+// .NAME LabelIndicatorField - Indicator of a label range of a label map
+// .SECTION General Description
+// Equivalent to a LabelMapField of the output of a BinaryThresholdImageFilter
+// except that the thresholded image is never created: the indicator value of
+// the voxels is computed on the fly from the shared label map when sampled.
+// Many fields can share the same label map for the cost of a single image.
+// The region of the label map that contains the label range can be given to
+// skip the interpolation outside of it.
+template<class TPixel>
+class LabelIndicatorField : public ScalarField
+{
+public:
+  typedef TPixel PixelType;
+  typedef itk::Image<PixelType,3> ImageType;
+  typedef typename ImageType::RegionType RegionType;
+
+public:
+  // The field is InsideValue where the label map is in
+  // [LowerLabel, UpperLabel], OutsideValue elsewhere.
+  LabelIndicatorField(typename ImageType::Pointer labelImage,
+                      PixelType lowerLabel, PixelType upperLabel,
+                      float insideValue, float outsideValue);
+  // Same as above with the region containing all the labels in
+  // [LowerLabel, UpperLabel].
+  LabelIndicatorField(typename ImageType::Pointer labelImage,
+                      PixelType lowerLabel, PixelType upperLabel,
+                      float insideValue, float outsideValue,
+                      const RegionType& labelRegion);
+  virtual ~LabelIndicatorField();
+
+  virtual float valueAt(float x, float y, float z) const;
+
+  virtual BoundingBox bounds() const;
+
+  // Compute in one pass the region of each label in [0, numberOfLabels[.
+  // The region of a label not present in the image is empty.
+  static std::vector<RegionType> ComputeLabelRegions(
+    const ImageType* labelImage, size_t numberOfLabels);
+
+  // Union of the regions, ignoring the empty ones.
+  static RegionType MergeRegions(const RegionType& region1,
+                                 const RegionType& region2);
+
+private:
+  void Initialize(typename ImageType::Pointer labelImage,
+                  PixelType lowerLabel, PixelType upperLabel,
+                  float insideValue, float outsideValue);
+
+  inline float IndicatorAt(long i, long j, long k) const;
+
+  typename ImageType::Pointer LabelMap;
+  const PixelType*            Buffer;
+  long                        Size[3];
+  long                        Strides[3];
+  // Voxel range (inclusive) where the indicator can be inside.
+  long                        LabelStart[3];
+  long                        LabelEnd[3];
+  PixelType                   LowerLabel;
+  PixelType                   UpperLabel;
+  float                       InsideValue;
+  float                       OutsideValue;
+  BoundingBox                 Bounds;
+};
+
+} // namespace
+
+#include "LabelIndicatorField.txx"
+
+#endif // LABELINDICATORFIELD_H
@@ -0,0 +1,247 @@
+/*=========================================================================
+
+  Program: Bender
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+#include "LabelIndicatorField.h"
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+
+namespace Cleaver {
+
+//----------------------------------------------------------------------------
+template< class TPixel>
+LabelIndicatorField<TPixel>::LabelIndicatorField(
+  typename ImageType::Pointer labelImage,
+  PixelType lowerLabel, PixelType upperLabel,
+  float insideValue, float outsideValue)
+{
+  this->Initialize(labelImage, lowerLabel, upperLabel,
+                   insideValue, outsideValue);
+  for (int i = 0; i < 3; ++i)
+    {
+    this->LabelStart[i] = 0;
+    this->LabelEnd[i] = this->Size[i] - 1;
+    }
+}
+
+//----------------------------------------------------------------------------
+template< class TPixel>
+LabelIndicatorField<TPixel>::LabelIndicatorField(
+  typename ImageType::Pointer labelImage,
+  PixelType lowerLabel, PixelType upperLabel,
+  float insideValue, float outsideValue,
+  const RegionType& labelRegion)
+{
+  this->Initialize(labelImage, lowerLabel, upperLabel,
+                   insideValue, outsideValue);
+  const RegionType& largestRegion =
+    this->LabelMap->GetLargestPossibleRegion();
+  for (int i = 0; i < 3; ++i)
+    {
+    this->LabelStart[i] = labelRegion.GetIndex(i) - largestRegion.GetIndex(i);
+    this->LabelEnd[i] =
+      this->LabelStart[i] + static_cast<long>(labelRegion.GetSize(i)) - 1;
+    }
+}
+
+//----------------------------------------------------------------------------
+template< class TPixel>
+void LabelIndicatorField<TPixel>::Initialize(
+  typename ImageType::Pointer labelImage,
+  PixelType lowerLabel, PixelType upperLabel,
+  float insideValue, float outsideValue)
+{
+  this->LabelMap = labelImage;
+  this->Buffer = this->LabelMap->GetBufferPointer();
+  this->LowerLabel = lowerLabel;
+  this->UpperLabel = upperLabel;
+  this->InsideValue = insideValue;
+  this->OutsideValue = outsideValue;
+
+  typename ImageType::SizeType size =
+    this->LabelMap->GetBufferedRegion().GetSize();
+  long stride = 1;
+  for (int i = 0; i < 3; ++i)
+    {
+    this->Size[i] = static_cast<long>(size[i]);
+    this->Strides[i] = stride;
+    stride *= this->Size[i];
+    }
+
+  // Same bounds as LabelMapField
+  vec3 o(0,0,0);
+  vec3 s(size[0], size[1], size[2]);
+  this->Bounds = BoundingBox(o,s);
+}
+
+//----------------------------------------------------------------------------
+template< class TPixel>
+LabelIndicatorField<TPixel>::~LabelIndicatorField()
+{
+}
+
+//----------------------------------------------------------------------------
+template< class TPixel>
+float LabelIndicatorField<TPixel>::IndicatorAt(long i, long j, long k) const
+{
+  const PixelType label = this->Buffer[
+    i * this->Strides[0] + j * this->Strides[1] + k * this->Strides[2]];
+  return (label >= this->LowerLabel && label <= this->UpperLabel) ?
+    this->InsideValue : this->OutsideValue;
+}
+
+//----------------------------------------------------------------------------
+template< class TPixel>
+float LabelIndicatorField<TPixel>::valueAt(float x, float y, float z) const
+{
+  // Same sampling as itk::LinearInterpolateImageFunction on the thresholded
+  // image: voxel centers are at +0.5 and the neighbors are clamped to the
+  // image boundaries.
+  const double p[3] = {x - 0.5, y - 0.5, z - 0.5};
+  long lo[3];
+  long hi[3];
+  double t[3];
+  for (int i = 0; i < 3; ++i)
+    {
+    const double base = std::floor(p[i]);
+    t[i] = p[i] - base;
+    const long b = static_cast<long>(base);
+    lo[i] = std::min(std::max(b, 0L), this->Size[i] - 1);
+    hi[i] = std::min(std::max(b + 1, 0L), this->Size[i] - 1);
+    // None of the neighbors can be in the label range.
+    if (hi[i] < this->LabelStart[i] || lo[i] > this->LabelEnd[i])
+      {
+      return this->OutsideValue;
+      }
+    }
+
+  const double v00 = this->IndicatorAt(lo[0], lo[1], lo[2]) * (1. - t[0])
+    + this->IndicatorAt(hi[0], lo[1], lo[2]) * t[0];
+  const double v10 = this->IndicatorAt(lo[0], hi[1], lo[2]) * (1. - t[0])
+    + this->IndicatorAt(hi[0], hi[1], lo[2]) * t[0];
+  const double v01 = this->IndicatorAt(lo[0], lo[1], hi[2]) * (1. - t[0])
+    + this->IndicatorAt(hi[0], lo[1], hi[2]) * t[0];
+  const double v11 = this->IndicatorAt(lo[0], hi[1], hi[2]) * (1. - t[0])
+    + this->IndicatorAt(hi[0], hi[1], hi[2]) * t[0];
+  const double v0 = v00 * (1. - t[1]) + v10 * t[1];
+  const double v1 = v01 * (1. - t[1]) + v11 * t[1];
+  return static_cast<float>(v0 * (1. - t[2]) + v1 * t[2]);
+}
+
+//----------------------------------------------------------------------------
+template< class TPixel>
+BoundingBox LabelIndicatorField<TPixel>::bounds() const
+{
+  return this->Bounds;
+}
+
+//----------------------------------------------------------------------------
+template< class TPixel>
+std::vector<typename LabelIndicatorField<TPixel>::RegionType>
+LabelIndicatorField<TPixel>::ComputeLabelRegions(
+  const ImageType* labelImage, size_t numberOfLabels)
+{
+  const RegionType& region = labelImage->GetBufferedRegion();
+  const PixelType* buffer = labelImage->GetBufferPointer();
+  const long size[3] = {static_cast<long>(region.GetSize(0)),
+                        static_cast<long>(region.GetSize(1)),
+                        static_cast<long>(region.GetSize(2))};
+
+  std::vector<long> start(3 * numberOfLabels);
+  std::vector<long> end(3 * numberOfLabels, -1);
+  for (size_t l = 0; l < numberOfLabels; ++l)
+    {
+    start[3*l] = size[0];
+    start[3*l + 1] = size[1];
+    start[3*l + 2] = size[2];
+    }
+
+  for (long k = 0; k < size[2]; ++k)
+    {
+    for (long j = 0; j < size[1]; ++j)
+      {
+      for (long i = 0; i < size[0]; ++i, ++buffer)
+        {
+        const double label = static_cast<double>(*buffer);
+        if (label < 0. || label >= static_cast<double>(numberOfLabels))
+          {
+          continue;
+          }
+        const size_t l = 3 * static_cast<size_t>(label);
+        start[l] = std::min(start[l], i);
+        end[l] = std::max(end[l], i);
+        start[l + 1] = std::min(start[l + 1], j);
+        end[l + 1] = std::max(end[l + 1], j);
+        start[l + 2] = std::min(start[l + 2], k);
+        end[l + 2] = std::max(end[l + 2], k);
+        }
+      }
+    }
+
+  std::vector<RegionType> regions(numberOfLabels);
+  for (size_t l = 0; l < numberOfLabels; ++l)
+    {
+    if (end[3*l] < 0)
+      {
+      continue; // empty region
+      }
+    typename RegionType::IndexType index;
+    typename RegionType::SizeType regionSize;
+    for (int i = 0; i < 3; ++i)
+      {
+      index[i] = region.GetIndex(i) + start[3*l + i];
+      regionSize[i] = end[3*l + i] - start[3*l + i] + 1;
+      }
+    regions[l].SetIndex(index);
+    regions[l].SetSize(regionSize);
+    }
+  return regions;
+}
+
+//----------------------------------------------------------------------------
+template< class TPixel>
+typename LabelIndicatorField<TPixel>::RegionType
+LabelIndicatorField<TPixel>::MergeRegions(const RegionType& region1,
+                                          const RegionType& region2)
+{
+  if (region1.GetNumberOfPixels() == 0)
+    {
+    return region2;
+    }
+  if (region2.GetNumberOfPixels() == 0)
+    {
+    return region1;
+    }
+  typename RegionType::IndexType index;
+  typename RegionType::SizeType size;
+  for (int i = 0; i < 3; ++i)
+    {
+    const long start = std::min(region1.GetIndex(i), region2.GetIndex(i));
+    const long end = std::max(
+      region1.GetIndex(i) + static_cast<long>(region1.GetSize(i)),
+      region2.GetIndex(i) + static_cast<long>(region2.GetSize(i)));
+    index[i] = start;
+    size[i] = end - start;
+    }
+  return RegionType(index, size);
+}
+
+} // namespace
@@ -27,17 +27,20 @@
 
 // ITK includes
 #include <itkImage.h>
-#include <itkLinearInterpolateImageFunction.h>
 
 namespace Cleaver {
 
+// .NAME LabelMapField - Trilinear interpolation of a label map
+// .SECTION General Description
+// The values are sampled directly in the image buffer and match the
+// itk::LinearInterpolateImageFunction of the image at the voxel centers
+// (x - 0.5, y - 0.5, z - 0.5).
 template<class TPixel>
 class LabelMapField : public ScalarField
 {
 public:
   typedef TPixel PixelType;
   typedef itk::Image<PixelType,3> ImageType;
-  typedef itk::LinearInterpolateImageFunction<ImageType> InterpolationType;
 
 public:
   LabelMapField(typename ImageType::Pointer LabelImage);
@@ -49,8 +52,13 @@ public:
   BoundingBox dataBounds() const;
 
 private:
-  typename ImageType::Pointer         LabelMap;
-  typename InterpolationType::Pointer Interpolant;
+  // Trilinear interpolation at the continuous index (i, j, k).
+  inline float Interpolate(double i, double j, double k) const;
+
+  typename ImageType::Pointer LabelMap;
+  const PixelType*           Buffer;
+  long                       Size[3];
+  long                       Strides[3];
   BoundingBox                Bounds;
 };
 
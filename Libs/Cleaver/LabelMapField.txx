@@ -20,6 +20,9 @@
 
 #include "LabelMapField.h"
 
+// STD includes
+#include <algorithm>
+#include <cmath>
 
 namespace Cleaver {
 
@@ -28,12 +31,17 @@ template< class TPixel>
 LabelMapField<TPixel>::LabelMapField(typename ImageType::Pointer labelImage)
 {
   this->LabelMap = labelImage;
-
-  this->Interpolant = InterpolationType::New();
-  this->Interpolant->SetInputImage(this->LabelMap);
+  this->Buffer = this->LabelMap->GetBufferPointer();
 
   typename ImageType::SizeType size =
     this->LabelMap->GetLargestPossibleRegion().GetSize();
+  long stride = 1;
+  for (int i = 0; i < 3; ++i)
+    {
+    this->Size[i] = static_cast<long>(size[i]);
+    this->Strides[i] = stride;
+    stride *= this->Size[i];
+    }
   //ImageType::PointType origin = this->LabelMap->GetOrigin();
 
   // TODO: Investigate the setup of these parameters in Cleaver default to origin (0,0,0)
@@ -50,23 +58,59 @@ LabelMapField<TPixel>::~LabelMapField()
 {
 }
 
+//----------------------------------------------------------------------------
+template< class TPixel>
+float LabelMapField<TPixel>::Interpolate(double i, double j, double k) const
+{
+  // Same as itk::LinearInterpolateImageFunction: the neighbors are clamped
+  // to the image boundaries.
+  const double p[3] = {i, j, k};
+  long offsets[3][2];
+  double t[3];
+  for (int d = 0; d < 3; ++d)
+    {
+    const double base = std::floor(p[d]);
+    t[d] = p[d] - base;
+    const long b = static_cast<long>(base);
+    offsets[d][0] =
+      std::min(std::max(b, 0L), this->Size[d] - 1) * this->Strides[d];
+    offsets[d][1] =
+      std::min(std::max(b + 1, 0L), this->Size[d] - 1) * this->Strides[d];
+    }
+
+  const PixelType* buffer = this->Buffer;
+  double v[2][2];
+  for (int z = 0; z < 2; ++z)
+    {
+    for (int y = 0; y < 2; ++y)
+      {
+      const long offset = offsets[1][y] + offsets[2][z];
+      v[z][y] = static_cast<double>(buffer[offset + offsets[0][0]]) * (1. - t[0])
+        + static_cast<double>(buffer[offset + offsets[0][1]]) * t[0];
+      }
+    }
+  const double v0 = v[0][0] * (1. - t[1]) + v[0][1] * t[1];
+  const double v1 = v[1][0] * (1. - t[1]) + v[1][1] * t[1];
+  return static_cast<float>(v0 * (1. - t[2]) + v1 * t[2]);
+}
+
 //----------------------------------------------------------------------------
 template< class TPixel>
 float LabelMapField<TPixel>::valueAt(float x, float y, float z) const
 {
-  double p[3] = {x - 0.5,y - 0.5,z - 0.5};
-  typename InterpolationType::ContinuousIndexType index(p);
 #ifndef NDEBUG
-  if (! this->LabelMap->GetLargestPossibleRegion().IsInside(index))
+  const float p[3] = {x, y, z};
+  for (int i = 0; i < 3; ++i)
     {
-    std::cerr << "Value at (" << x << ", " << y << ", " << z << ") is outside volume boundaries."
-              << index << " -> " << this->Interpolant->EvaluateAtContinuousIndex(index) << std::endl;
-    return -1.;
+    if (p[i] < 0. || p[i] >= this->Size[i])
+      {
+      std::cerr << "Value at (" << x << ", " << y << ", " << z
+                << ") is outside volume boundaries." << std::endl;
+      return -1.;
+      }
     }
 #endif
-  float res = this->Interpolant->EvaluateAtContinuousIndex(index);
-  //std::cout << this << "(" << x << ", " << y << ", " << z << "): " << res << std::endl;
-  return res;
+  return this->Interpolate(x - 0.5, y - 0.5, z - 0.5);
 }
 
 //----------------------------------------------------------------------------
@@ -77,4 +121,3 @@ BoundingBox LabelMapField<TPixel>::bounds() const
 }
 
 } // namespace
-
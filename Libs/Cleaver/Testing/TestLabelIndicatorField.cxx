@@ -0,0 +1,153 @@
+/*=========================================================================
+
+  Program: Bender
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+#include "LabelIndicatorField.h"
+#include "LabelMapField.h"
+#include <itkBinaryThresholdImageFilter.h>
+#include <itkImageRegionIterator.h>
+
+#include <cmath>
+
+int TestLabelIndicatorField(int argc, char * argv[]);
+bool TestLabelIndicatorField();
+
+typedef Cleaver::LabelIndicatorField<unsigned char>::ImageType LabelImageType;
+typedef Cleaver::LabelMapField<float>::ImageType FloatImageType;
+
+int TestLabelIndicatorField(int argc, char * argv[])
+{
+  bool res = TestLabelIndicatorField();
+  return res ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+LabelImageType::Pointer CreateLabelImage()
+{
+  LabelImageType::Pointer image = LabelImageType::New();
+  LabelImageType::SizeType size;
+  size[0] = 4;
+  size[1] = 3;
+  size[2] = 3;
+  LabelImageType::IndexType start;
+  start.Fill(0);
+  LabelImageType::RegionType region;
+  region.SetSize( size );
+  region.SetIndex( start );
+  image->SetRegions( region );
+  image->Allocate();
+
+  unsigned char data[36] = {0, 0, 0, 0,
+                            0, 1, 1, 0,
+                            0, 0, 0, 0,
+                            0, 1, 1, 0,
+                            0, 1, 2, 2,
+                            0, 1, 1, 0,
+                            0, 0, 0, 0,
+                            0, 1, 1, 0,
+                            0, 0, 0, 0};
+  size_t i = 0;
+  typedef itk::ImageRegionIterator<LabelImageType> ItType;
+  ItType it( image, region );
+  for(it.GoToBegin(); !it.IsAtEnd();++it)
+    {
+    it.Set(data[i++]);
+    }
+  return image;
+}
+
+bool CompareFields(const Cleaver::ScalarField& field,
+                   const Cleaver::ScalarField& expectedField)
+{
+  // LabelMapField is only defined inside the volume boundaries.
+  Cleaver::BoundingBox bounds = expectedField.bounds();
+  for (float z = 0.; z < bounds.maxCorner().z; z+=0.25)
+    {
+    for (float y = 0.; y < bounds.maxCorner().y; y+=0.25)
+      {
+      for (float x = 0.; x < bounds.maxCorner().x; x+=0.25)
+        {
+        float value = field.valueAt(x,y,z);
+        float expected = expectedField.valueAt(x,y,z);
+        if (std::abs(value - expected) > 1e-5)
+          {
+          std::cerr << "Value at (" << x << ", " << y << ", " << z << "): "
+                    << value << " instead of " << expected << std::endl;
+          return false;
+          }
+        }
+      }
+    }
+  return true;
+}
+
+bool TestLabel(LabelImageType::Pointer image,
+               const LabelImageType::RegionType& region,
+               unsigned char lower, unsigned char upper,
+               float insideValue, float outsideValue)
+{
+  typedef itk::BinaryThresholdImageFilter<LabelImageType, FloatImageType>
+    ThresholdFilterType;
+  ThresholdFilterType::Pointer thresholdFilter = ThresholdFilterType::New();
+  thresholdFilter->SetInput(image);
+  thresholdFilter->SetLowerThreshold(lower);
+  thresholdFilter->SetUpperThreshold(upper);
+  thresholdFilter->SetInsideValue(insideValue);
+  thresholdFilter->SetOutsideValue(outsideValue);
+  thresholdFilter->Update();
+  Cleaver::LabelMapField<float> expectedField(thresholdFilter->GetOutput());
+
+  Cleaver::LabelIndicatorField<unsigned char> field(
+    image, lower, upper, insideValue, outsideValue);
+  Cleaver::LabelIndicatorField<unsigned char> regionField(
+    image, lower, upper, insideValue, outsideValue, region);
+  return CompareFields(field, expectedField)
+    && CompareFields(regionField, expectedField);
+}
+
+bool TestLabelIndicatorField()
+{
+  typedef Cleaver::LabelIndicatorField<unsigned char> FieldType;
+  LabelImageType::Pointer image = CreateLabelImage();
+
+  std::vector<FieldType::RegionType> regions =
+    FieldType::ComputeLabelRegions(image, 4);
+  if (regions.size() != 4
+      || regions[1].GetIndex(0) != 1 || regions[1].GetSize(0) != 2
+      || regions[1].GetSize(1) != 3 || regions[1].GetSize(2) != 3
+      || regions[2].GetIndex(0) != 2 || regions[2].GetSize(0) != 2
+      || regions[2].GetIndex(1) != 1 || regions[2].GetSize(1) != 1
+      || regions[3].GetNumberOfPixels() != 0)
+    {
+    std::cerr << "Wrong label regions" << std::endl;
+    return false;
+    }
+  FieldType::RegionType skinRegion =
+    FieldType::MergeRegions(regions[1], regions[2]);
+  skinRegion = FieldType::MergeRegions(skinRegion, regions[3]);
+  if (skinRegion.GetIndex(0) != 1 || skinRegion.GetSize(0) != 3)
+    {
+    std::cerr << "Wrong merged region" << std::endl;
+    return false;
+    }
+
+  return TestLabel(image, skinRegion, 1, 3, -1., 0.)
+    && TestLabel(image, regions[1], 1, 1, 1., -1.)
+    && TestLabel(image, regions[2], 2, 2, 2., -1.)
+    && TestLabel(image, regions[3], 3, 3, 3., -1.);
+}
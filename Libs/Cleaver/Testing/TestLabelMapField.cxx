@@ -20,6 +20,9 @@
 
 #include "LabelMapField.h"
 #include <itkImageRegionIterator.h>
+#include <itkLinearInterpolateImageFunction.h>
+
+#include <cmath>
 
 int TestLabelMapField(int argc, char * argv[]);
 bool TestLabelMapField();
@@ -84,15 +87,30 @@ bool TestLabelMapField()
 {
   LabelImageType::Pointer image = CreateImage();
   Cleaver::LabelMapField<float> labelMapField(image);
+
+  typedef itk::LinearInterpolateImageFunction<LabelImageType> InterpolationType;
+  InterpolationType::Pointer interpolant = InterpolationType::New();
+  interpolant->SetInputImage(image);
+
   //labelMapField.SetGenerateDataFromLabels(true);
-  for (float z = 0.; z <= 0.; z+=0.5)
+  for (float z = 0.; z < 3.; z+=0.5)
     {
-    for (float y = -1.; y < 10.; y+=0.5)
+    for (float y = 0.; y < 3.; y+=0.25)
       {
-      for (float x = -1.; x < 10.; x+=0.5)
+      for (float x = 0.; x < 3.; x+=0.25)
         {
+        double p[3] = {x - 0.5, y - 0.5, z - 0.5};
+        InterpolationType::ContinuousIndexType index(p);
+        float expected = interpolant->EvaluateAtContinuousIndex(index);
+        float value = labelMapField.valueAt(x,y,z);
         std::cout << "("<< x<< "," << y << "," << z << "):"
-                  << labelMapField.valueAt(x,y,z) << std::endl;
+                  << value << std::endl;
+        if (std::abs(value - expected) > 1e-4)
+          {
+          std::cerr << "Value at (" << x << ", " << y << ", " << z << "): "
+                    << value << " instead of " << expected << std::endl;
+          return false;
+          }
         }
       }
     }
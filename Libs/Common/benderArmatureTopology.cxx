@@ -0,0 +1,189 @@
+/*=========================================================================
+
+  Program: Bender
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Bender includes
+#include "benderArmatureTopology.h"
+
+// VTK includes
+#include <vtkCellData.h>
+#include <vtkIdTypeArray.h>
+#include <vtkPolyData.h>
+
+// STD includes
+#include <iostream>
+
+namespace bender
+{
+const ArmatureTopology::DistanceType ArmatureTopology::InfiniteDistance;
+
+//-------------------------------------------------------------------------------
+ArmatureTopology::ArmatureTopology()
+{
+}
+
+//-------------------------------------------------------------------------------
+bool ArmatureTopology::SetParenthood(vtkIdTypeArray* parenthood)
+{
+  this->Parents.clear();
+  this->Children.clear();
+  this->Roots.clear();
+  this->Distances.clear();
+  if (!parenthood)
+    {
+    return false;
+    }
+
+  const vtkIdType numberOfBones = parenthood->GetNumberOfTuples();
+  this->Parents.resize(numberOfBones, -1);
+  this->Children.resize(numberOfBones);
+  for (vtkIdType bone = 0; bone < numberOfBones; ++bone)
+    {
+    vtkIdType parent = parenthood->GetValue(bone);
+    if (parent < -1 || parent >= numberOfBones || parent == bone)
+      {
+      std::cerr << "Invalid parent " << parent << " for bone " << bone
+                << std::endl;
+      this->Parents.clear();
+      this->Children.clear();
+      this->Roots.clear();
+      return false;
+      }
+    this->Parents[bone] = parent;
+    if (parent == -1)
+      {
+      this->Roots.push_back(bone);
+      }
+    else
+      {
+      this->Children[parent].push_back(bone);
+      }
+    }
+
+  this->ComputeDistances();
+  return true;
+}
+
+//-------------------------------------------------------------------------------
+bool ArmatureTopology::SetArmature(vtkPolyData* armature)
+{
+  vtkIdTypeArray* parenthood = armature ? vtkIdTypeArray::SafeDownCast(
+    armature->GetCellData()->GetArray("Parenthood")) : 0;
+  return this->SetParenthood(parenthood);
+}
+
+//-------------------------------------------------------------------------------
+void ArmatureTopology::ComputeDistances()
+{
+  const size_t numberOfBones = this->Parents.size();
+  this->Distances.assign(numberOfBones * numberOfBones, InfiniteDistance);
+
+  // Breadth-first traversal of the tree from each bone. Each bone is
+  // visited at most once, the parents and children lists give the
+  // neighbors directly.
+  std::vector<vtkIdType> queue(numberOfBones);
+  for (size_t source = 0; source < numberOfBones; ++source)
+    {
+    DistanceType* distances = &this->Distances[source * numberOfBones];
+    // Distances are stored saturated, keep the exact depth aside to not
+    // revisit bones farther than InfiniteDistance.
+    std::vector<unsigned int> depths(numberOfBones, 0);
+    std::vector<bool> visited(numberOfBones, false);
+    size_t begin = 0;
+    size_t end = 0;
+    queue[end++] = source;
+    visited[source] = true;
+    distances[source] = 0;
+    while (begin < end)
+      {
+      vtkIdType bone = queue[begin++];
+      unsigned int depth = depths[bone] + 1;
+      DistanceType distance = depth < InfiniteDistance ?
+        static_cast<DistanceType>(depth) : InfiniteDistance;
+
+      vtkIdType parent = this->Parents[bone];
+      if (parent >= 0 && !visited[parent])
+        {
+        visited[parent] = true;
+        depths[parent] = depth;
+        distances[parent] = distance;
+        queue[end++] = parent;
+        }
+      const BoneList& children = this->Children[bone];
+      for (BoneList::const_iterator it = children.begin();
+           it != children.end(); ++it)
+        {
+        if (!visited[*it])
+          {
+          visited[*it] = true;
+          depths[*it] = depth;
+          distances[*it] = distance;
+          queue[end++] = *it;
+          }
+        }
+      }
+    }
+}
+
+//-------------------------------------------------------------------------------
+bool ArmatureTopology::IsEmpty() const
+{
+  return this->Parents.empty();
+}
+
+//-------------------------------------------------------------------------------
+vtkIdType ArmatureTopology::GetNumberOfBones() const
+{
+  return static_cast<vtkIdType>(this->Parents.size());
+}
+
+//-------------------------------------------------------------------------------
+vtkIdType ArmatureTopology::GetParent(vtkIdType bone) const
+{
+  return this->Parents[bone];
+}
+
+//-------------------------------------------------------------------------------
+const ArmatureTopology::BoneList& ArmatureTopology
+::GetChildren(vtkIdType bone) const
+{
+  return this->Children[bone];
+}
+
+//-------------------------------------------------------------------------------
+const ArmatureTopology::BoneList& ArmatureTopology::GetRoots() const
+{
+  return this->Roots;
+}
+
+//-------------------------------------------------------------------------------
+ArmatureTopology::DistanceType ArmatureTopology
+::GetDistance(vtkIdType bone, vtkIdType otherBone) const
+{
+  return this->Distances[bone * this->Parents.size() + otherBone];
+}
+
+//-------------------------------------------------------------------------------
+const ArmatureTopology::DistanceType* ArmatureTopology
+::GetDistances(vtkIdType bone) const
+{
+  return &this->Distances[bone * this->Parents.size()];
+}
+
+};
@@ -0,0 +1,93 @@
+/*=========================================================================
+
+  Program: Bender
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+#ifndef __benderArmatureTopology_h
+#define __benderArmatureTopology_h
+
+// .NAME ArmatureTopology - bone hierarchy of an armature
+// .SECTION General Description
+// ArmatureTopology parses the "Parenthood" cell array of an armature once
+// and gives access to the parent and children of each bone, and to the
+// distance in the tree between any two bones (1 between a bone and its
+// parent or its children).
+// All the distances are computed with one breadth-first traversal per bone,
+// O(n^2) for n bones, and stored in a compact n x n table of bytes.
+// Distances are saturated: a distance that does not fit in a byte, or a bone
+// that can't be reached (forest of bones), is InfiniteDistance.
+
+// Bender includes
+#include "BenderCommonExport.h"
+
+// VTK includes
+#include <vtkType.h>
+class vtkIdTypeArray;
+class vtkPolyData;
+
+// STD includes
+#include <vector>
+
+namespace bender
+{
+class BENDER_COMMON_EXPORT ArmatureTopology
+{
+public:
+  typedef unsigned char DistanceType;
+  typedef std::vector<vtkIdType> BoneList;
+
+  static const DistanceType InfiniteDistance = 255;
+
+  ArmatureTopology();
+
+  /// Set the parent of each bone, -1 for the roots.
+  /// Return false if the parenthood is invalid (i.e. out of range parent),
+  /// the topology is then empty.
+  bool SetParenthood(vtkIdTypeArray* parenthood);
+  /// Convenience method that uses the "Parenthood" cell array of the
+  /// armature. If the array is missing, the topology is empty.
+  bool SetArmature(vtkPolyData* armature);
+
+  /// Return true if no parenthood is set.
+  bool IsEmpty() const;
+  vtkIdType GetNumberOfBones() const;
+
+  /// Return the parent of the bone, -1 for a root.
+  vtkIdType GetParent(vtkIdType bone) const;
+  const BoneList& GetChildren(vtkIdType bone) const;
+  const BoneList& GetRoots() const;
+
+  /// Distance in the tree between 2 bones.
+  DistanceType GetDistance(vtkIdType bone, vtkIdType otherBone) const;
+  /// Distances between the bone and all the other bones.
+  /// The row contains GetNumberOfBones() values.
+  const DistanceType* GetDistances(vtkIdType bone) const;
+
+private:
+  void ComputeDistances();
+
+  std::vector<vtkIdType> Parents;
+  std::vector<BoneList> Children;
+  BoneList Roots;
+  /// Row major, Distances[bone * n + otherBone]
+  std::vector<DistanceType> Distances;
+};
+
+};
+
+#endif
@@ -0,0 +1,76 @@
+/*=========================================================================
+
+  Program: Bender
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Bender includes
+#include "benderBinaryIO.h"
+
+namespace bender
+{
+//-------------------------------------------------------------------------------
+void BinaryIO::WriteHeader(std::ostream& stream, const std::string& type,
+                           vtkTypeUInt32 version)
+{
+  WriteString(stream, type);
+  WriteValue(stream, version);
+}
+
+//-------------------------------------------------------------------------------
+bool BinaryIO::ReadHeader(std::istream& stream, const std::string& type,
+                          vtkTypeUInt32 version)
+{
+  std::string streamType;
+  vtkTypeUInt32 streamVersion = 0;
+  return ReadString(stream, streamType) && streamType == type
+    && ReadValue(stream, streamVersion) && streamVersion == version;
+}
+
+//-------------------------------------------------------------------------------
+void BinaryIO::WriteString(std::ostream& stream, const std::string& value)
+{
+  WriteVector(stream, std::vector<char>(value.begin(), value.end()));
+}
+
+//-------------------------------------------------------------------------------
+bool BinaryIO::ReadString(std::istream& stream, std::string& value)
+{
+  std::vector<char> characters;
+  if (!ReadVector(stream, characters))
+    {
+    return false;
+    }
+  value.assign(characters.begin(), characters.end());
+  return true;
+}
+
+//-------------------------------------------------------------------------------
+vtkTypeUInt64 BinaryIO::GetRemainingBytes(std::istream& stream)
+{
+  const std::streampos position = stream.tellg();
+  if (position < 0)
+    {
+    return 0;
+    }
+  stream.seekg(0, std::ios::end);
+  const std::streampos end = stream.tellg();
+  stream.seekg(position);
+  return end > position ? static_cast<vtkTypeUInt64>(end - position) : 0;
+}
+
+};
@@ -0,0 +1,73 @@
+/*=========================================================================
+
+  Program: Bender
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+#ifndef __benderBinaryIO_h
+#define __benderBinaryIO_h
+
+// .NAME BinaryIO - helpers to read and write compact binary files
+// .SECTION General Description
+// Values are written in the native byte order. Vectors and strings are
+// prefixed with their number of elements. A header is a type tag followed by
+// a version number.
+
+// Bender includes
+#include "BenderCommonExport.h"
+
+// VTK includes
+#include <vtkType.h>
+
+// STD includes
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace bender
+{
+class BENDER_COMMON_EXPORT BinaryIO
+{
+public:
+  static void WriteHeader(std::ostream& stream, const std::string& type,
+                          vtkTypeUInt32 version);
+  static bool ReadHeader(std::istream& stream, const std::string& type,
+                         vtkTypeUInt32 version);
+
+  template <class T>
+  static void WriteValue(std::ostream& stream, const T& value);
+  template <class T>
+  static bool ReadValue(std::istream& stream, T& value);
+
+  template <class T>
+  static void WriteVector(std::ostream& stream, const std::vector<T>& values);
+  /// Fail if the size of the vector is larger than the rest of the stream,
+  /// a truncated or corrupted file must not allocate an arbitrary size.
+  template <class T>
+  static bool ReadVector(std::istream& stream, std::vector<T>& values);
+
+  static void WriteString(std::ostream& stream, const std::string& value);
+  static bool ReadString(std::istream& stream, std::string& value);
+
+  /// Number of bytes left to read in a seekable stream, 0 if unknown.
+  static vtkTypeUInt64 GetRemainingBytes(std::istream& stream);
+};
+
+};
+#include "benderBinaryIO.txx"
+
+#endif
@@ -0,0 +1,67 @@
+/*=========================================================================
+
+  Program: Bender
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+namespace bender
+{
+//-------------------------------------------------------------------------------
+template <class T>
+void BinaryIO::WriteValue(std::ostream& stream, const T& value)
+{
+  stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+//-------------------------------------------------------------------------------
+template <class T>
+bool BinaryIO::ReadValue(std::istream& stream, T& value)
+{
+  stream.read(reinterpret_cast<char*>(&value), sizeof(T));
+  return !stream.fail();
+}
+
+//-------------------------------------------------------------------------------
+template <class T>
+void BinaryIO::WriteVector(std::ostream& stream, const std::vector<T>& values)
+{
+  const vtkTypeUInt64 size = values.size();
+  WriteValue(stream, size);
+  if (size)
+    {
+    stream.write(reinterpret_cast<const char*>(&values[0]), size * sizeof(T));
+    }
+}
+
+//-------------------------------------------------------------------------------
+template <class T>
+bool BinaryIO::ReadVector(std::istream& stream, std::vector<T>& values)
+{
+  vtkTypeUInt64 size = 0;
+  if (!ReadValue(stream, size) || size > GetRemainingBytes(stream) / sizeof(T))
+    {
+    return false;
+    }
+  values.resize(size);
+  if (size)
+    {
+    stream.read(reinterpret_cast<char*>(&values[0]), size * sizeof(T));
+    }
+  return !stream.fail();
+}
+
+};
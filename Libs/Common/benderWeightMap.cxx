@@ -194,59 +194,15 @@ bool WeightMap::IsMasked(const WeightMap::Voxel& voxel)const
 void WeightMap::SetWeightsFiliation(vtkIdTypeArray* weightsFiliation,
                                     int maxDegree)
 {
-  this->WeightsDegrees.resize(weightsFiliation->GetNumberOfTuples());
-  for (SiteIndex index = 0; index < weightsFiliation->GetNumberOfTuples(); ++index)
-    {
-    //
-    // Use Djikstras to compute distance map
-    //
-
-    // Init edges and distance map
-    RowSizes& degrees = this->WeightsDegrees[index];
-    degrees.resize(weightsFiliation->GetNumberOfTuples(),
-                   std::numeric_limits<SiteIndex>::max());
-    degrees[index] = 0; // 0th degree for itself
-    std::vector<bool> edges (weightsFiliation->GetNumberOfTuples(), false);
-
-    // for each weight
-    for (vtkIdType count = 0; count < weightsFiliation->GetNumberOfTuples(); ++count)
-      {
-      // search the next closest weight (in degree).
-      SiteIndex degree = std::numeric_limits<SiteIndex>::max();
-      vtkIdType currentID = -1;
-      for (size_t i = 0; i < degrees.size(); ++i)
-        {
-        if (degrees[i] < degree && edges[i] == false)
-          {
-          degree = degrees[i];
-          currentID = i;
-          }
-        }
-      if (degree == std::numeric_limits<SiteIndex>::max())
-        {
-        std::cerr << "ERROR:" << std::endl
-                  << "While computing edge distance map, "
-                  << "every edge should be accessible !"<<std::endl;
-        break;
-        }
-      edges[currentID] = true; // visited
+  this->WeightsTopology.SetParenthood(weightsFiliation);
+  this->MaxWeightDegree = maxDegree;
+}
 
-      for (vtkIdType id = 0; id < weightsFiliation->GetNumberOfTuples(); ++id)
-        {
-        SiteIndex newDegree = std::numeric_limits<SiteIndex>::max();
-        if (weightsFiliation->GetValue(currentID) == id // ID is currentID parent
-            || weightsFiliation->GetValue(id) == currentID) // ID is currentID child
-          {
-          newDegree = degree + 1;
-          }
-
-        if (newDegree < degrees[id])
-          {
-          degrees[id] = newDegree;
-          }
-        }
-      }
-    }
+//-------------------------------------------------------------------------------
+void WeightMap::SetWeightsFiliation(const ArmatureTopology& topology,
+                                    int maxDegree)
+{
+  this->WeightsTopology = topology;
   this->MaxWeightDegree = maxDegree;
 }
 
@@ -262,7 +218,12 @@ bool WeightMap::IsUnfiliated(SiteIndex index, SiteIndex cornerIndex)const
     {
     return true;
     }
-  return this->WeightsDegrees[index][cornerIndex] > this->MaxWeightDegree;
+  if (this->WeightsTopology.IsEmpty())
+    {
+    return false;
+    }
+  return this->WeightsTopology.GetDistance(index, cornerIndex)
+    > this->MaxWeightDegree;
 }
 
 //-------------------------------------------------------------------------------
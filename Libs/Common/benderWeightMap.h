@@ -32,6 +32,7 @@
 
 // Bender includes
 #include "BenderCommonExport.h"
+#include "benderArmatureTopology.h"
 
 // ITK includes
 #include <itkImage.h>
@@ -49,7 +50,9 @@ namespace bender
 class BENDER_COMMON_EXPORT WeightMap
 {
 public:
-  typedef unsigned char SiteIndex;
+  // Index of the weight (i.e. armature edge). 16 bits to support large
+  // armatures, the max value is reserved for invalid entries.
+  typedef unsigned short SiteIndex;
   struct WeightEntry
   {
     float Value;
@@ -63,7 +66,6 @@ public:
   typedef std::vector<WeightEntry> WeightEntries;
   typedef itk::ImageRegion<3> Region;
   typedef itk::VariableLengthVector<float> WeightVector;
-  typedef std::vector<RowSizes> WeightsDegreesType;
 
   // For any j, WeightTable[...][j] correspond to the weights at a voxel.
   typedef std::vector<WeightEntries> WeightLUT;
@@ -105,6 +107,9 @@ public:
   /// \sa SetMaskImage(), IsUnfiliated(), Lerp()
   void SetWeightsFiliation(vtkIdTypeArray* weightsFiliation,
                            int maxDegree = 4);
+  /// Same as above with an already computed topology.
+  void SetWeightsFiliation(const ArmatureTopology& topology,
+                           int maxDegree = 4);
 
   /// Interpolate the weights at a given point.
   /// \a coord: the point to evaluate at.
@@ -144,7 +149,7 @@ private:
   itk::ImageRegion<3> MaskRegion;
 
   /// Contains the degrees between each weight indexes.
-  WeightsDegreesType WeightsDegrees;
+  ArmatureTopology WeightsTopology;
   /// -1 means all degrees are accepted. -1 by default.
   int MaxWeightDegree;
   /// Minimum weight value accepted in Insert()
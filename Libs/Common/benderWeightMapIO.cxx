@@ -19,18 +19,51 @@
 =========================================================================*/
 
 // Bender includes
+#include "benderBinaryIO.h"
 #include "benderWeightMapIO.h"
 
 // ITK includes
 #include <itkImageRegion.h>
 #include <itkImageFileReader.h>
+#include <itkImageFileWriter.h>
 #include <itkDirectory.h>
+#include <itksys/SystemTools.hxx>
+
+// VTK includes
+#include <vtkType.h>
+
+// STD includes
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
 
 using namespace bender;
 
 typedef itk::ImageRegion<3> Region;
 typedef itk::Image<float, 3>  WeightImage;
 
+namespace
+{
+// Type tag and version at the beginning of the packed weight files
+const char* PackedWeightsTag = "BenderPackedWeights";
+const vtkTypeUInt32 PackedWeightsVersion = 1;
+
+//----------------------------------------------------------------------------
+// Offset of a voxel in a region, in the order of the image buffer
+itk::OffsetValueType ComputeOffset(const Region& region,
+                                   const itk::Index<3>& index)
+{
+  const itk::OffsetValueType sizeX = region.GetSize(0);
+  const itk::OffsetValueType sizeY = region.GetSize(1);
+  return (index[0] - region.GetIndex(0))
+    + sizeX * ((index[1] - region.GetIndex(1))
+    + sizeY * (index[2] - region.GetIndex(2)));
+}
+
+}
+
 namespace bender
 {
 //----------------------------------------------------------------------------
@@ -106,6 +139,366 @@ int ReadWeights(const std::vector<std::string>& fnames,
   return numSites;
 }
 
-};
+//----------------------------------------------------------------------------
+std::string GetPackedWeightFileName(const std::string& dirName)
+{
+  return dirName + "/weights_packed.dat";
+}
 
+//-------------------------------------------------------------------------------
+PackedWeights::PackedWeights()
+ : MaxInfluences(0)
+{
+}
+
+//-------------------------------------------------------------------------------
+size_t PackedWeights::GetNumberOfBodyVoxels() const
+{
+  return this->MaxInfluences ? this->Indices.size() / this->MaxInfluences : 0;
+}
+
+//-------------------------------------------------------------------------------
+bool PackWeights(const std::vector<std::string>& fnames,
+                 unsigned int maxInfluences,
+                 PackedWeights& packedWeights,
+                 const unsigned char* abort)
+{
+  packedWeights = PackedWeights();
+  if (fnames.empty() || maxInfluences == 0)
+    {
+    return false;
+    }
+  packedWeights.MaxInfluences = maxInfluences;
+
+  size_t numBodyVoxels = 0;
+  for (size_t i = 0; i < fnames.size(); ++i)
+    {
+    if (abort && *abort)
+      {
+      return false;
+      }
+    std::cout << "Pack " << fnames[i] << std::endl;
+
+    typedef itk::ImageFileReader<WeightImage>  ReaderType;
+    ReaderType::Pointer reader = ReaderType::New();
+    reader->SetFileName(fnames[i].c_str());
+    reader->Update();
+    WeightImage::Pointer weight_i = reader->GetOutput();
+    const float* weights = weight_i->GetBufferPointer();
+
+    if (i == 0)
+      {
+      packedWeights.Region = weight_i->GetLargestPossibleRegion();
+      packedWeights.Origin = weight_i->GetOrigin();
+      packedWeights.Spacing = weight_i->GetSpacing();
+      packedWeights.Direction = weight_i->GetDirection();
+
+      // The body voxels are the domain of the first weight.
+      const PackedWeights::Offset numVoxels =
+        packedWeights.Region.GetNumberOfPixels();
+      for (PackedWeights::Offset v = 0; v < numVoxels; ++v)
+        {
+        if (weights[v] < 0.f)
+          {
+          continue;
+          }
+        if (packedWeights.Runs.empty() || packedWeights.Runs.back() != v)
+          {
+          packedWeights.Runs.push_back(v);
+          packedWeights.Runs.push_back(v + 1);
+          }
+        else
+          {
+          ++packedWeights.Runs.back();
+          }
+        ++numBodyVoxels;
+        }
+      packedWeights.Indices.resize(maxInfluences * numBodyVoxels,
+                                   WeightMap::WeightEntry().Index);
+      packedWeights.Values.resize(maxInfluences * numBodyVoxels, -1.f);
+      }
+
+    if (weight_i->GetLargestPossibleRegion() != packedWeights.Region)
+      {
+      std::cerr << "Weight maps with different regions can't be packed: "
+                << fnames[i] << std::endl;
+      return false;
+      }
+
+    packedWeights.WeightNames.push_back(
+      itksys::SystemTools::GetFilenameName(fnames[i]));
+    packedWeights.TimeStamps.push_back(
+      itksys::SystemTools::ModifiedTime(fnames[i].c_str()));
+    packedWeights.FileSizes.push_back(
+      itksys::SystemTools::FileLength(fnames[i].c_str()));
+
+    // Keep the entries of a body voxel sorted by decreasing weights to only
+    // have to compare against the smallest one.
+    const WeightMap::SiteIndex site = static_cast<WeightMap::SiteIndex>(i);
+    size_t column = 0;
+    for (size_t r = 0; r < packedWeights.Runs.size(); r += 2)
+      {
+      for (PackedWeights::Offset v = packedWeights.Runs[r];
+           v < packedWeights.Runs[r + 1]; ++v, ++column)
+        {
+        const float value = weights[v];
+        float* values = &packedWeights.Values[column];
+        WeightMap::SiteIndex* indices = &packedWeights.Indices[column];
+        if (value <= values[(maxInfluences - 1) * numBodyVoxels])
+          {
+          continue;
+          }
+        unsigned int row = maxInfluences - 1;
+        for (; row > 0 && value > values[(row - 1) * numBodyVoxels]; --row)
+          {
+          values[row * numBodyVoxels] = values[(row - 1) * numBodyVoxels];
+          indices[row * numBodyVoxels] = indices[(row - 1) * numBodyVoxels];
+          }
+        values[row * numBodyVoxels] = value;
+        indices[row * numBodyVoxels] = site;
+        }
+      }
+    }
+  std::cout << numBodyVoxels << " body voxels in "
+            << packedWeights.Runs.size() / 2 << " runs packed" << std::endl;
+  return true;
+}
+
+//-------------------------------------------------------------------------------
+bool WritePackedWeights(const PackedWeights& packedWeights,
+                        const std::string& fname)
+{
+  std::cout << "Write packed weights to " << fname << std::endl;
+  const std::string partialFileName = fname + ".part";
+  {
+  std::ofstream file(partialFileName.c_str(), std::ios::out | std::ios::binary);
+  if (!file)
+    {
+    std::cerr << "Could not write " << partialFileName << std::endl;
+    return false;
+    }
+  file.write(PackedWeightsTag, strlen(PackedWeightsTag));
+  BinaryIO::WriteValue(file, PackedWeightsVersion);
+
+  // Header
+  for (unsigned int i = 0; i < 3; ++i)
+    {
+    BinaryIO::WriteValue(file, packedWeights.Region.GetIndex(i));
+    BinaryIO::WriteValue(file, packedWeights.Region.GetSize(i));
+    BinaryIO::WriteValue(file, packedWeights.Origin[i]);
+    BinaryIO::WriteValue(file, packedWeights.Spacing[i]);
+    for (unsigned int j = 0; j < 3; ++j)
+      {
+      BinaryIO::WriteValue(file, packedWeights.Direction[i][j]);
+      }
+    }
+  const vtkTypeUInt64 numWeights = packedWeights.WeightNames.size();
+  BinaryIO::WriteValue(file, numWeights);
+  for (size_t i = 0; i < packedWeights.WeightNames.size(); ++i)
+    {
+    BinaryIO::WriteString(file, packedWeights.WeightNames[i]);
+    BinaryIO::WriteValue(
+      file, static_cast<vtkTypeInt64>(packedWeights.TimeStamps[i]));
+    BinaryIO::WriteValue(
+      file, static_cast<vtkTypeUInt64>(packedWeights.FileSizes[i]));
+    }
+  BinaryIO::WriteValue(
+    file, static_cast<vtkTypeUInt32>(packedWeights.MaxInfluences));
 
+  // Weights
+  BinaryIO::WriteVector(file, packedWeights.Runs);
+  BinaryIO::WriteVector(file, packedWeights.Indices);
+  BinaryIO::WriteVector(file, packedWeights.Values);
+  if (!file)
+    {
+    std::cerr << "Could not write " << partialFileName << std::endl;
+    return false;
+    }
+  }
+  itksys::SystemTools::RemoveFile(fname.c_str());
+  if (std::rename(partialFileName.c_str(), fname.c_str()) != 0)
+    {
+    std::cerr << "Could not move " << partialFileName << " to "
+              << fname << std::endl;
+    return false;
+    }
+  return true;
+}
+
+//-------------------------------------------------------------------------------
+bool ReadPackedWeights(const std::string& fname,
+                       const std::vector<std::string>& fnames,
+                       PackedWeights& packedWeights,
+                       bool headerOnly)
+{
+  packedWeights = PackedWeights();
+  if (!itksys::SystemTools::FileExists(fname.c_str(), true))
+    {
+    return false;
+    }
+  std::cout << "Read " << fname << std::endl;
+  std::ifstream file(fname.c_str(), std::ios::in | std::ios::binary);
+  std::string tag(strlen(PackedWeightsTag), '\0');
+  vtkTypeUInt32 version = 0;
+  if (!file.read(&tag[0], tag.size()) || tag != PackedWeightsTag
+      || !BinaryIO::ReadValue(file, version)
+      || version != PackedWeightsVersion)
+    {
+    std::cerr << fname << " is not a packed weight file." << std::endl;
+    return false;
+    }
+
+  // Header
+  bool res = true;
+  Region::IndexType regionIndex;
+  Region::SizeType regionSize;
+  for (unsigned int i = 0; i < 3; ++i)
+    {
+    res = res && BinaryIO::ReadValue(file, regionIndex[i])
+      && BinaryIO::ReadValue(file, regionSize[i])
+      && BinaryIO::ReadValue(file, packedWeights.Origin[i])
+      && BinaryIO::ReadValue(file, packedWeights.Spacing[i]);
+    for (unsigned int j = 0; j < 3; ++j)
+      {
+      res = res && BinaryIO::ReadValue(file, packedWeights.Direction[i][j]);
+      }
+    }
+  packedWeights.Region.SetIndex(regionIndex);
+  packedWeights.Region.SetSize(regionSize);
+  vtkTypeUInt64 numWeights = 0;
+  res = res && BinaryIO::ReadValue(file, numWeights);
+  for (vtkTypeUInt64 i = 0; res && i < numWeights && i < fnames.size(); ++i)
+    {
+    std::string name;
+    vtkTypeInt64 timeStamp = 0;
+    vtkTypeUInt64 fileSize = 0;
+    res = BinaryIO::ReadString(file, name)
+      && BinaryIO::ReadValue(file, timeStamp)
+      && BinaryIO::ReadValue(file, fileSize);
+    packedWeights.WeightNames.push_back(name);
+    packedWeights.TimeStamps.push_back(static_cast<long>(timeStamp));
+    packedWeights.FileSizes.push_back(static_cast<unsigned long>(fileSize));
+    }
+  if (!res)
+    {
+    std::cerr << "Could not read the header of " << fname << std::endl;
+    return false;
+    }
+
+  // The packed weights are out of date as soon as a weight file changes.
+  bool upToDate = (numWeights == fnames.size());
+  for (size_t i = 0; upToDate && i < fnames.size(); ++i)
+    {
+    upToDate =
+      packedWeights.WeightNames[i] == itksys::SystemTools::GetFilenameName(fnames[i])
+      && packedWeights.TimeStamps[i] == itksys::SystemTools::ModifiedTime(fnames[i].c_str())
+      && packedWeights.FileSizes[i] == itksys::SystemTools::FileLength(fnames[i].c_str());
+    }
+  if (!upToDate)
+    {
+    std::cout << fname << " is out of date, read the weight files instead."
+              << std::endl;
+    return false;
+    }
+  if (headerOnly)
+    {
+    return true;
+    }
+
+  vtkTypeUInt32 maxInfluences = 0;
+  res = BinaryIO::ReadValue(file, maxInfluences)
+    && BinaryIO::ReadVector(file, packedWeights.Runs)
+    && BinaryIO::ReadVector(file, packedWeights.Indices)
+    && BinaryIO::ReadVector(file, packedWeights.Values);
+  packedWeights.MaxInfluences = maxInfluences;
+  if (!res || maxInfluences == 0
+      || packedWeights.Runs.size() % 2 != 0
+      || packedWeights.Indices.size() != packedWeights.Values.size()
+      || packedWeights.Indices.size() % maxInfluences != 0)
+    {
+    std::cerr << "Could not read the weights of " << fname << std::endl;
+    return false;
+    }
+  return true;
+}
+
+//-------------------------------------------------------------------------------
+WeightImage::Pointer GetPackedWeightMask(const PackedWeights& packedWeights)
+{
+  WeightImage::Pointer mask = WeightImage::New();
+  mask->SetRegions(packedWeights.Region);
+  mask->SetOrigin(packedWeights.Origin);
+  mask->SetSpacing(packedWeights.Spacing);
+  mask->SetDirection(packedWeights.Direction);
+  mask->Allocate();
+  mask->FillBuffer(-1.f);
+
+  // The first row has the largest weight of each body voxel.
+  float* buffer = mask->GetBufferPointer();
+  size_t column = 0;
+  for (size_t r = 0; r < packedWeights.Runs.size(); r += 2)
+    {
+    for (PackedWeights::Offset v = packedWeights.Runs[r];
+         v < packedWeights.Runs[r + 1]; ++v, ++column)
+      {
+      buffer[v] = packedWeights.Values[column];
+      }
+    }
+  return mask;
+}
+
+//-------------------------------------------------------------------------------
+int ReadPackedWeights(const PackedWeights& packedWeights,
+                      const std::vector<WeightMap::Voxel>& bodyVoxels,
+                      WeightMap& weightMap)
+{
+  typedef std::vector<WeightMap::Voxel> Voxels;
+  const Region& region = packedWeights.Region;
+  weightMap.Init(bodyVoxels, region);
+
+  // First column of each run, to find the column of a voxel
+  std::vector<size_t> runColumns(packedWeights.Runs.size() / 2);
+  size_t numColumns = 0;
+  for (size_t r = 0; r < runColumns.size(); ++r)
+    {
+    runColumns[r] = numColumns;
+    numColumns += packedWeights.Runs[2 * r + 1] - packedWeights.Runs[2 * r];
+    }
+
+  const int numSites = static_cast<int>(packedWeights.WeightNames.size());
+  int numInserted(0);
+  for(Voxels::const_iterator v_iter = bodyVoxels.begin(); v_iter!=bodyVoxels.end(); ++v_iter)
+    {
+    const WeightMap::Voxel& v(*v_iter);
+    if (!region.IsInside(v))
+      {
+      continue;
+      }
+    const PackedWeights::Offset offset = ComputeOffset(region, v);
+    // Find the last run that begins at or before the voxel.
+    std::vector<PackedWeights::Offset>::const_iterator run = std::upper_bound(
+      packedWeights.Runs.begin(), packedWeights.Runs.end(), offset);
+    const size_t bound = run - packedWeights.Runs.begin();
+    if (bound % 2 == 0)
+      {
+      // Outside of any run: background voxel
+      continue;
+      }
+    const size_t column =
+      runColumns[bound / 2] + (offset - packedWeights.Runs[bound - 1]);
+    for (size_t c = column; c < packedWeights.Indices.size(); c += numColumns)
+      {
+      const WeightMap::SiteIndex index = packedWeights.Indices[c];
+      if (index >= numSites)
+        {
+        break;
+        }
+      numInserted += weightMap.Insert(v, index, packedWeights.Values[c]);
+      }
+    }
+  std::cout << numInserted << " inserted to weight map" << std::endl;
+  weightMap.Print();
+  return numSites;
+}
+
+};
@@ -24,15 +24,101 @@
 // Bender includes
 #include "benderWeightMap.h"
 
+// ITK includes
+#include <itkImage.h>
+
 // STD includes
 #include <string>
 #include <vector>
 
 namespace bender
 {
+// Packed weights: the K largest weights of each body voxel, in a single file.
+// Body voxels are the voxels with a weight >= 0 in the first weight image,
+// they are listed as runs of consecutive voxels of the weight image region.
+// The weights are laid out in K rows like the rows of WeightMap: row r holds
+// the r-th largest (site index, weight) entry of each body voxel. Unused
+// entries have an invalid site index.
+// The file takes 6*K bytes per body voxel and 16 bytes per run, nothing is
+// stored for the background voxels. Its header holds the name, modification
+// time and size of the weight files it was packed from: the packed weights
+// are only used while these files are unchanged.
+struct BENDER_COMMON_EXPORT PackedWeights
+{
+  typedef itk::Image<float, 3> WeightImage;
+  typedef itk::OffsetValueType Offset;
+
+  PackedWeights();
+
+  // Number of body voxels, i.e. the number of columns of the rows.
+  size_t GetNumberOfBodyVoxels() const;
+
+  // Geometry of the weight images
+  WeightImage::RegionType Region;
+  WeightImage::PointType Origin;
+  WeightImage::SpacingType Spacing;
+  WeightImage::DirectionType Direction;
+
+  // Weight file names (without directory), modification times and sizes.
+  std::vector<std::string> WeightNames;
+  std::vector<long> TimeStamps;
+  std::vector<unsigned long> FileSizes;
+
+  // Maximum number of weights per body voxel (K)
+  unsigned int MaxInfluences;
+  // [begin, end) offsets of the runs of body voxels in Region
+  std::vector<Offset> Runs;
+  // K rows of site indices and weights, one column per body voxel
+  std::vector<WeightMap::SiteIndex> Indices;
+  std::vector<float> Values;
+};
+
 // Get the weight files from a directory
 void BENDER_COMMON_EXPORT GetWeightFileNames(const std::string& dirName, std::vector<std::string>& fnames);
 
+// Return the name of the packed weight file of a weight directory.
+// The file may not exist.
+std::string BENDER_COMMON_EXPORT GetPackedWeightFileName(const std::string& dirName);
+
+// Pack the weight files, keeping the maxInfluences largest weights of each
+// body voxel. Return false if the files can't be read or don't share the
+// same region.
+bool BENDER_COMMON_EXPORT PackWeights(const std::vector<std::string>& fnames,
+                                      unsigned int maxInfluences,
+                                      PackedWeights& packedWeights,
+                                      const unsigned char* abort = 0);
+
+// Write the packed weights. The file is written aside and renamed when
+// complete, a reader never sees a partial file.
+bool BENDER_COMMON_EXPORT WritePackedWeights(const PackedWeights& packedWeights,
+                                             const std::string& fname);
+
+// Read the packed weights if they were packed from the current weight files
+// fnames. Return false if the file doesn't exist, can't be read, or is out of
+// date: the weight files must then be read instead.
+// If headerOnly is true, the weights are not read.
+bool BENDER_COMMON_EXPORT ReadPackedWeights(const std::string& fname,
+                                            const std::vector<std::string>& fnames,
+                                            PackedWeights& packedWeights,
+                                            bool headerOnly = false);
+
+// Create an image with the largest weight at each voxel: -1 outside of the
+// weight domain, >= 0 inside. It can be used as a mask for WeightMap.
+// \sa WeightMap::SetMaskImage()
+itk::Image<float, 3>::Pointer BENDER_COMMON_EXPORT GetPackedWeightMask(
+  const PackedWeights& packedWeights);
+
+// Create a weight map from a list of voxels and packed weights.
+int BENDER_COMMON_EXPORT ReadPackedWeights(const PackedWeights& packedWeights,
+                                           const std::vector<WeightMap::Voxel>& bodyVoxels,
+                                           WeightMap& weightMap);
+
+// Create a weight map from an image (labelmap) and packed weights.
+template <class T>
+int BENDER_COMMON_EXPORT ReadPackedWeightsFromImage(const PackedWeights& packedWeights,
+                                                    const typename itk::Image<T, 3>::Pointer image,
+                                                    bender::WeightMap& weightMap);
+
 // Create a weight map from a list of voxels
 int BENDER_COMMON_EXPORT ReadWeights(const std::vector<std::string>& fnames,
                                      const std::vector<WeightMap::Voxel>& bodyVoxels,
@@ -83,7 +83,50 @@ int ReadWeightsFromImage(const std::vector<std::string>& fnames,
   return numSites;
 }
 
+//-------------------------------------------------------------------------------
+//create a weight map from packed weights
+template <class T>
+int ReadPackedWeightsFromImage(const PackedWeights& packedWeights,
+                               const typename itk::Image<T, 3>::Pointer image,
+                               bender::WeightMap& weightMap)
+{
+  typedef itk::ImageRegion<3> Region;
+  Region region = image->GetLargestPossibleRegion();
+  if (packedWeights.Region != region)
+    {
+    std::cerr << "Weight maps regions different from image are not supported:"
+              << "Image: " << region
+              << " Weight: " << packedWeights.Region
+              << std::endl;
+    return 0;
+    }
+  weightMap.Init<T>(image, region);
 
-};
-
+  const int numSites = static_cast<int>(packedWeights.WeightNames.size());
+  const size_t numColumns = packedWeights.GetNumberOfBodyVoxels();
+  size_t numInserted(0);
+  size_t column = 0;
+  for (size_t r = 0; r < packedWeights.Runs.size(); r += 2)
+    {
+    for (PackedWeights::Offset v = packedWeights.Runs[r];
+         v < packedWeights.Runs[r + 1]; ++v, ++column)
+      {
+      const typename itk::Image<T, 3>::IndexType index =
+        image->ComputeIndex(v);
+      for (size_t c = column; c < packedWeights.Indices.size(); c += numColumns)
+        {
+        if (packedWeights.Indices[c] >= numSites)
+          {
+          break;
+          }
+        bool inserted = weightMap.Insert(
+          index, packedWeights.Indices[c], packedWeights.Values[c]);
+        numInserted += (inserted ? 1 : 0);
+        }
+      }
+    }
+  std::cout << " " << numInserted << " voxels inserted to weight map" << std::endl;
+  return numSites;
+}
 
+};
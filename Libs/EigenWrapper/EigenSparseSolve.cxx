@@ -26,3 +26,13 @@ Eigen::VectorXf Solve(SpMat& A,  Eigen::VectorXf& b)
   Eigen::SimplicialCholesky<SpMat> solver(A);  // performs a Cholesky factorization of A
   return solver.solve(b);
 }
+
+SparseSolver::SparseSolver(SpMat& A)
+  : Solver(A) // performs a Cholesky factorization of A
+{
+}
+
+Eigen::VectorXf SparseSolver::Solve(const Eigen::VectorXf& b) const
+{
+  return this->Solver.solve(b);
+}
@@ -33,4 +33,16 @@ typedef Eigen::SparseMatrix<float> SpMat;
 //Solve a sparse linear system.  Just wrap around Eignen
 Eigen::VectorXf BENDER_EIGENWRAPPER_EXPORT Solve(SpMat& A,  Eigen::VectorXf& b);
 
+//Factorize a sparse linear system once to solve it for several right hand
+//sides, one at a time.
+class BENDER_EIGENWRAPPER_EXPORT SparseSolver
+{
+public:
+  SparseSolver(SpMat& A);
+  Eigen::VectorXf Solve(const Eigen::VectorXf& b) const;
+
+private:
+  Eigen::SimplicialCholesky<SpMat> Solver;
+};
+
 #endif
@@ -0,0 +1,256 @@
+/*=========================================================================
+
+  Program: Bender
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+#include "itkVotingResampleImageFilter.h"
+#include "itkVotingResampleImageFunction.h"
+
+#include <itkImageRegionConstIteratorWithIndex.h>
+#include <itkImageRegionIterator.h>
+#include <itkResampleImageFilter.h>
+
+#include <iostream>
+#include <vector>
+
+int itkVotingResampleImageFilterTest(int argc, char * argv[]);
+
+typedef itk::Image<unsigned short, 3> LabelImageType;
+
+namespace
+{
+
+//-----------------------------------------------------------------------------
+// Labelmap of odd size made of blocks of labels with some noise, so that the
+// boxes have ties and the boundary boxes are clamped.
+LabelImageType::Pointer CreateLabelmap()
+{
+  LabelImageType::Pointer image = LabelImageType::New();
+  LabelImageType::SizeType size;
+  size[0] = 23;
+  size[1] = 17;
+  size[2] = 13;
+  LabelImageType::IndexType start;
+  start.Fill(0);
+  LabelImageType::RegionType region(start, size);
+  image->SetRegions(region);
+  image->Allocate();
+
+  LabelImageType::SpacingType spacing;
+  spacing[0] = 1.;
+  spacing[1] = 0.5;
+  spacing[2] = 2.;
+  image->SetSpacing(spacing);
+  LabelImageType::PointType origin;
+  origin[0] = -10.;
+  origin[1] = 3.;
+  origin[2] = 7.5;
+  image->SetOrigin(origin);
+  LabelImageType::DirectionType direction;
+  direction.SetIdentity();
+  direction[1][1] = -1.;
+  image->SetDirection(direction);
+
+  unsigned int seed = 12345;
+  itk::ImageRegionConstIteratorWithIndex<LabelImageType> indexIt(image, region);
+  itk::ImageRegionIterator<LabelImageType> it(image, region);
+  for (; !it.IsAtEnd(); ++it, ++indexIt)
+    {
+    const LabelImageType::IndexType index = indexIt.GetIndex();
+    unsigned short label = static_cast<unsigned short>(
+      (index[0] / 5 + 2 * (index[1] / 4) + 3 * (index[2] / 3)) % 9);
+    seed = seed * 1103515245 + 12345;
+    if ((seed >> 16) % 4 == 0)
+      {
+      label = static_cast<unsigned short>((seed >> 20) % 9);
+      }
+    it.Set(label);
+    }
+  return image;
+}
+
+//-----------------------------------------------------------------------------
+// Output geometry of a voting resampling with the given spacing ratios.
+void ComputeGeometry(const LabelImageType* input, const double ratios[3],
+                     LabelImageType::SizeType& size,
+                     LabelImageType::SpacingType& spacing,
+                     LabelImageType::PointType& origin)
+{
+  size = input->GetLargestPossibleRegion().GetSize();
+  spacing = input->GetSpacing();
+  origin = input->GetOrigin();
+  for (unsigned int i = 0; i < 3; ++i)
+    {
+    size[i] = static_cast<LabelImageType::SizeValueType>(size[i] / ratios[i]);
+    spacing[i] = input->GetSpacing()[i] * ratios[i];
+    origin[i] += input->GetDirection()[i][i]
+      * (spacing[i] - input->GetSpacing()[i]) / 2.;
+    }
+}
+
+//-----------------------------------------------------------------------------
+LabelImageType::Pointer ResampleWithFunction(LabelImageType* input,
+                                             const double ratios[3],
+                                             int radius,
+                                             std::vector<int> highLabels,
+                                             std::vector<int> lowLabels)
+{
+  LabelImageType::SizeType size;
+  LabelImageType::SpacingType spacing;
+  LabelImageType::PointType origin;
+  ComputeGeometry(input, ratios, size, spacing, origin);
+
+  typedef itk::VotingResampleImageFunction<LabelImageType, double>
+    VotingFunctionType;
+  VotingFunctionType::Pointer interpolator = VotingFunctionType::New();
+  interpolator->SetInputImage(input);
+  interpolator->SetHighPrecedenceLabels(highLabels);
+  interpolator->SetLowPrecedenceLabels(lowLabels);
+  interpolator->SetOutputSpacing(spacing);
+  interpolator->SetRadius(radius);
+
+  typedef itk::ResampleImageFilter<LabelImageType, LabelImageType>
+    ResampleImageFilterType;
+  ResampleImageFilterType::Pointer resample = ResampleImageFilterType::New();
+  resample->SetInput(input);
+  resample->SetInterpolator(interpolator);
+  resample->SetSize(size);
+  resample->SetOutputSpacing(spacing);
+  resample->SetOutputOrigin(origin);
+  resample->SetOutputDirection(input->GetDirection());
+  resample->Update();
+  return resample->GetOutput();
+}
+
+//-----------------------------------------------------------------------------
+LabelImageType::Pointer ResampleWithFilter(LabelImageType* input,
+                                           const double ratios[3],
+                                           int radius,
+                                           const std::vector<int>& highLabels,
+                                           const std::vector<int>& lowLabels)
+{
+  LabelImageType::SizeType size;
+  LabelImageType::SpacingType spacing;
+  LabelImageType::PointType origin;
+  ComputeGeometry(input, ratios, size, spacing, origin);
+
+  typedef itk::VotingResampleImageFilter<LabelImageType> VotingFilterType;
+  VotingFilterType::Pointer resample = VotingFilterType::New();
+  resample->SetInput(input);
+  resample->SetHighPrecedenceLabels(highLabels);
+  resample->SetLowPrecedenceLabels(lowLabels);
+  resample->SetRadius(radius);
+  resample->SetSize(size);
+  resample->SetOutputSpacing(spacing);
+  resample->SetOutputOrigin(origin);
+  resample->Update();
+  return resample->GetOutput();
+}
+
+//-----------------------------------------------------------------------------
+bool CompareImages(LabelImageType* expected, LabelImageType* output)
+{
+  if (expected->GetLargestPossibleRegion() != output->GetLargestPossibleRegion()
+      || expected->GetSpacing() != output->GetSpacing()
+      || expected->GetOrigin() != output->GetOrigin()
+      || expected->GetDirection() != output->GetDirection())
+    {
+    std::cerr << "Different geometries: " << std::endl
+              << expected->GetLargestPossibleRegion() << expected->GetSpacing()
+              << " " << expected->GetOrigin() << std::endl
+              << output->GetLargestPossibleRegion() << output->GetSpacing()
+              << " " << output->GetOrigin() << std::endl;
+    return false;
+    }
+  size_t numberOfDifferences = 0;
+  itk::ImageRegionConstIteratorWithIndex<LabelImageType> expectedIt(
+    expected, expected->GetLargestPossibleRegion());
+  itk::ImageRegionConstIteratorWithIndex<LabelImageType> outputIt(
+    output, output->GetLargestPossibleRegion());
+  for (; !expectedIt.IsAtEnd(); ++expectedIt, ++outputIt)
+    {
+    if (expectedIt.Get() != outputIt.Get())
+      {
+      if (numberOfDifferences < 10)
+        {
+        std::cerr << "Voxel " << outputIt.GetIndex() << ": " << outputIt.Get()
+                  << " instead of " << expectedIt.Get() << std::endl;
+        }
+      ++numberOfDifferences;
+      }
+    }
+  if (numberOfDifferences)
+    {
+    std::cerr << numberOfDifferences << " different voxels" << std::endl;
+    }
+  return numberOfDifferences == 0;
+}
+
+} // end namespace
+
+//-----------------------------------------------------------------------------
+int itkVotingResampleImageFilterTest(int argc, char * argv[])
+{
+  LabelImageType::Pointer input = CreateLabelmap();
+
+  // Even, odd and non-integer spacing ratios, and upsampling.
+  const double ratios[][3] = {
+    {2., 2., 2.},
+    {3., 3., 3.},
+    {2.5, 1.5, 1.7},
+    {4., 3., 2.},
+    {0.5, 1., 1.3}
+    };
+  const int numberOfRatios = sizeof(ratios) / sizeof(ratios[0]);
+  const int radii[] = {-1, 1, 2};
+
+  std::vector<int> noLabels;
+  std::vector<int> highLabels;
+  highLabels.push_back(7);
+  highLabels.push_back(3);
+  std::vector<int> lowLabels;
+  lowLabels.push_back(0);
+  lowLabels.push_back(5);
+
+  bool res = true;
+  for (int precedence = 0; precedence < 2; ++precedence)
+    {
+    const std::vector<int>& high = precedence ? highLabels : noLabels;
+    const std::vector<int>& low = precedence ? lowLabels : noLabels;
+    for (int r = 0; r < numberOfRatios; ++r)
+      {
+      for (int radius = 0; radius < 3; ++radius)
+        {
+        LabelImageType::Pointer expected =
+          ResampleWithFunction(input, ratios[r], radii[radius], high, low);
+        LabelImageType::Pointer output =
+          ResampleWithFilter(input, ratios[r], radii[radius], high, low);
+        if (!CompareImages(expected, output))
+          {
+          std::cerr << "Failed with ratios (" << ratios[r][0] << ", "
+                    << ratios[r][1] << ", " << ratios[r][2] << "), radius "
+                    << radii[radius] << " and "
+                    << (precedence ? "" : "no ") << "precedence labels"
+                    << std::endl;
+          res = false;
+          }
+        }
+      }
+    }
+  return res ? EXIT_SUCCESS : EXIT_FAILURE;
+}
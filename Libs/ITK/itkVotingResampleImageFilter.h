@@ -0,0 +1,178 @@
+/*=========================================================================
+
+  Program: Bender
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+#ifndef __itkVotingResampleImageFilter_h
+#define __itkVotingResampleImageFilter_h
+
+#include "itkImageToImageFilter.h"
+#include "itkVotingResampleImageFunction.h"
+
+#include <vector>
+
+namespace itk
+{
+
+/** \class VotingResampleImageFilter
+ * \brief Resample a label map by voting in a box around each output voxel.
+ *
+ * The output has the same direction as the input, only its origin, spacing
+ * and size change. Each output voxel is the label elected in the box of
+ * input voxels centered on it, with the same rules as
+ * VotingResampleImageFunction (high and low precedence labels, radius, and
+ * replicated voxels outside the image). This gives the same output as a
+ * ResampleImageFilter with a VotingResampleImageFunction, much faster:
+ *  - the labels are tallied in a counting array indexed by label. Only the
+ *  labels touched by the box are reset and looked at for the election.
+ *  - the tally slides along the scanlines: only the columns of voxels that
+ *  enter and leave the box are added and removed.
+ *  - when the boxes of consecutive voxels don't overlap (e.g. integer
+ *  spacing ratio), each box is tallied directly, without removal.
+ *  - the output regions are processed by multiple threads.
+ * Pixel types that are not integers, or labels spanning more than
+ * MaximumLabelRange values, are voted with VotingResampleImageFunction.
+ *
+ * \sa VotingResampleImageFunction
+ *
+ * \ingroup ImageFilters
+ */
+template <class TImage>
+class VotingResampleImageFilter :
+  public ImageToImageFilter<TImage, TImage>
+{
+public:
+  /** Standard class typedefs. */
+  typedef VotingResampleImageFilter             Self;
+  typedef ImageToImageFilter<TImage, TImage>    Superclass;
+  typedef SmartPointer<Self>                    Pointer;
+  typedef SmartPointer<const Self>              ConstPointer;
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(VotingResampleImageFilter, ImageToImageFilter);
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  typedef TImage                                ImageType;
+  typedef typename ImageType::PixelType         PixelType;
+  typedef typename ImageType::RegionType        RegionType;
+  typedef typename ImageType::SizeType          SizeType;
+  typedef typename ImageType::IndexType         IndexType;
+  typedef typename ImageType::SpacingType       SpacingType;
+  typedef typename ImageType::PointType         PointType;
+  typedef typename ImageType::OffsetValueType   OffsetValueType;
+
+  itkStaticConstMacro(ImageDimension, unsigned int, ImageType::ImageDimension);
+
+  typedef VotingResampleImageFunction<ImageType, double> VotingFunctionType;
+
+  /** Output geometry. The direction is the input direction. */
+  itkSetMacro(OutputSpacing, SpacingType);
+  itkGetConstReferenceMacro(OutputSpacing, SpacingType);
+  itkSetMacro(OutputOrigin, PointType);
+  itkGetConstReferenceMacro(OutputOrigin, PointType);
+  itkSetMacro(Size, SizeType);
+  itkGetConstReferenceMacro(Size, SizeType);
+
+  /** Radius of the voting box, -1 (default) to compute it from the input
+   * and output spacings. */
+  itkSetMacro(Radius, int);
+  itkGetConstMacro(Radius, int);
+
+  /** Precedence labels, see VotingResampleImageFunction. */
+  void SetHighPrecedenceLabels(const std::vector<int>& labels);
+  std::vector<int> GetHighPrecedenceLabels() const;
+  void SetLowPrecedenceLabels(const std::vector<int>& labels);
+  std::vector<int> GetLowPrecedenceLabels() const;
+
+  /** Maximum difference between the largest and smallest labels for the
+   * counting array to be used. 65536 by default. */
+  itkSetMacro(MaximumLabelRange, unsigned long);
+  itkGetConstMacro(MaximumLabelRange, unsigned long);
+
+protected:
+  VotingResampleImageFilter();
+  ~VotingResampleImageFilter(){};
+  void PrintSelf(std::ostream& os, Indent indent) const;
+
+  virtual void GenerateOutputInformation();
+  virtual void GenerateInputRequestedRegion();
+  virtual void BeforeThreadedGenerateData();
+  virtual void ThreadedGenerateData(const RegionType& outputRegionForThread,
+                                    ThreadIdType threadId);
+
+  /** Tally of the labels of a box, indexed by label - minimum label. */
+  class LabelTally
+    {
+    public:
+      LabelTally(size_t numberOfBins);
+      inline void Add(size_t bin);
+      inline void Remove(size_t bin);
+      void Reset();
+      /** Remove the bins whose count went back to 0 from the touched bins. */
+      void Compact();
+
+      std::vector<unsigned long> Counts;
+      std::vector<unsigned char> IsTouched;
+      std::vector<size_t> TouchedBins;
+    };
+
+  /** Elect the label of the compacted tally. */
+  PixelType Vote(const LabelTally& tally) const;
+
+  /** Voting box along the axis, in input indices (not clamped), for each
+   * output index. */
+  struct AxisBoxes
+    {
+    std::vector<OffsetValueType> Start;
+    std::vector<OffsetValueType> End;
+    std::vector<bool> IsInside;
+    std::vector<double> ContinuousIndex;
+    };
+
+private:
+  VotingResampleImageFilter( const Self& ); //purposely not implemented
+  void operator=( const Self& ); //purposely not implemented
+
+  void ThreadedGenerateDataWithFunction(const RegionType& outputRegionForThread,
+                                        ThreadIdType threadId);
+
+  SpacingType m_OutputSpacing;
+  PointType m_OutputOrigin;
+  SizeType m_Size;
+  int m_Radius;
+  std::vector<int> m_HighPrecedenceLabels;
+  std::vector<int> m_LowPrecedenceLabels;
+  unsigned long m_MaximumLabelRange;
+
+  // Computed before the threads are started
+  AxisBoxes m_Boxes[ImageDimension];
+  bool m_UseTally;
+  PixelType m_MinimumLabel;
+  size_t m_NumberOfBins;
+  // Rank of each bin in the precedence labels, -1 if not a precedence label
+  std::vector<int> m_HighPrecedenceRanks;
+  std::vector<int> m_LowPrecedenceRanks;
+  typename VotingFunctionType::Pointer m_VotingFunction;
+};
+
+} // end namespace itk
+
+# include "itkVotingResampleImageFilter.txx"
+
+#endif
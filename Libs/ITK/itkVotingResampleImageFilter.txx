@@ -0,0 +1,533 @@
+/*=========================================================================
+
+  Program: Bender
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+#ifndef __itkVotingResampleImageFilter_txx
+#define __itkVotingResampleImageFilter_txx
+
+#include "itkVotingResampleImageFilter.h"
+
+#include "itkImageLinearIteratorWithIndex.h"
+#include "itkMinimumMaximumImageCalculator.h"
+#include "itkProgressReporter.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace itk
+{
+
+/**
+ * LabelTally
+ */
+template<class TImage>
+VotingResampleImageFilter<TImage>::LabelTally
+::LabelTally(size_t numberOfBins)
+  : Counts(numberOfBins, 0), IsTouched(numberOfBins, 0)
+{
+}
+
+template<class TImage>
+void VotingResampleImageFilter<TImage>::LabelTally::Add(size_t bin)
+{
+  if (!this->IsTouched[bin])
+    {
+    this->IsTouched[bin] = 1;
+    this->TouchedBins.push_back(bin);
+    }
+  ++this->Counts[bin];
+}
+
+template<class TImage>
+void VotingResampleImageFilter<TImage>::LabelTally::Remove(size_t bin)
+{
+  --this->Counts[bin];
+}
+
+template<class TImage>
+void VotingResampleImageFilter<TImage>::LabelTally::Reset()
+{
+  for (size_t i = 0; i < this->TouchedBins.size(); ++i)
+    {
+    this->Counts[this->TouchedBins[i]] = 0;
+    this->IsTouched[this->TouchedBins[i]] = 0;
+    }
+  this->TouchedBins.clear();
+}
+
+template<class TImage>
+void VotingResampleImageFilter<TImage>::LabelTally::Compact()
+{
+  size_t last = 0;
+  for (size_t i = 0; i < this->TouchedBins.size(); ++i)
+    {
+    const size_t bin = this->TouchedBins[i];
+    if (this->Counts[bin])
+      {
+      this->TouchedBins[last++] = bin;
+      }
+    else
+      {
+      this->IsTouched[bin] = 0;
+      }
+    }
+  this->TouchedBins.resize(last);
+}
+
+/**
+ * Constructor
+ */
+template<class TImage>
+VotingResampleImageFilter<TImage>
+::VotingResampleImageFilter()
+{
+  this->m_OutputSpacing.Fill(1.);
+  this->m_OutputOrigin.Fill(0.);
+  this->m_Size.Fill(0);
+  this->m_Radius = -1;
+  this->m_MaximumLabelRange = 65536;
+  this->m_UseTally = false;
+  this->m_MinimumLabel = 0;
+  this->m_NumberOfBins = 0;
+}
+
+/**
+ * Precedence labels
+ */
+template<class TImage>
+void VotingResampleImageFilter<TImage>
+::SetHighPrecedenceLabels(const std::vector<int>& labels)
+{
+  this->m_HighPrecedenceLabels = labels;
+  this->Modified();
+}
+
+template<class TImage>
+std::vector<int> VotingResampleImageFilter<TImage>
+::GetHighPrecedenceLabels() const
+{
+  return this->m_HighPrecedenceLabels;
+}
+
+template<class TImage>
+void VotingResampleImageFilter<TImage>
+::SetLowPrecedenceLabels(const std::vector<int>& labels)
+{
+  this->m_LowPrecedenceLabels = labels;
+  this->Modified();
+}
+
+template<class TImage>
+std::vector<int> VotingResampleImageFilter<TImage>
+::GetLowPrecedenceLabels() const
+{
+  return this->m_LowPrecedenceLabels;
+}
+
+/**
+ * GenerateOutputInformation
+ */
+template<class TImage>
+void VotingResampleImageFilter<TImage>
+::GenerateOutputInformation()
+{
+  this->Superclass::GenerateOutputInformation();
+  ImageType* output = this->GetOutput();
+  RegionType outputRegion;
+  outputRegion.SetSize(this->m_Size);
+  output->SetLargestPossibleRegion(outputRegion);
+  output->SetSpacing(this->m_OutputSpacing);
+  output->SetOrigin(this->m_OutputOrigin);
+  output->SetDirection(this->GetInput()->GetDirection());
+}
+
+/**
+ * GenerateInputRequestedRegion
+ */
+template<class TImage>
+void VotingResampleImageFilter<TImage>
+::GenerateInputRequestedRegion()
+{
+  this->Superclass::GenerateInputRequestedRegion();
+  ImageType* input = const_cast<ImageType*>(this->GetInput());
+  if (input)
+    {
+    input->SetRequestedRegionToLargestPossibleRegion();
+    }
+}
+
+/**
+ * BeforeThreadedGenerateData
+ */
+template<class TImage>
+void VotingResampleImageFilter<TImage>
+::BeforeThreadedGenerateData()
+{
+  const ImageType* input = this->GetInput();
+  const RegionType& inputRegion = input->GetBufferedRegion();
+  const SpacingType& inputSpacing = input->GetSpacing();
+
+  // Both images share the direction: the input continuous index of an
+  // output index is an affine function of it along each axis.
+  typename ImageType::DirectionType inverseDirection =
+    input->GetInverseDirection();
+  Vector<double, ImageDimension> originOffset =
+    inverseDirection * (this->m_OutputOrigin - input->GetOrigin());
+  for (unsigned int i = 0; i < ImageDimension; ++i)
+    {
+    OffsetValueType radius = this->m_Radius;
+    if (this->m_Radius == -1)
+      {
+      // Same radius as VotingResampleImageFunction
+      double numberOfInputVoxelsCoveredByOutputVoxel =
+        this->m_OutputSpacing[i] / inputSpacing[i];
+      double inputRadius = (numberOfInputVoxelsCoveredByOutputVoxel - 1) / 2.;
+      radius = static_cast<OffsetValueType>(
+        inputRadius >= 1.0 ? inputRadius + 0.5 : 1.0);
+      }
+
+    const double start = inputRegion.GetIndex()[i];
+    const double end = start + inputRegion.GetSize()[i];
+    AxisBoxes& boxes = this->m_Boxes[i];
+    const size_t size = this->m_Size[i];
+    boxes.Start.resize(size);
+    boxes.End.resize(size);
+    boxes.IsInside.resize(size);
+    boxes.ContinuousIndex.resize(size);
+    for (size_t o = 0; o < size; ++o)
+      {
+      const double index = (originOffset[i] + o * this->m_OutputSpacing[i])
+        / inputSpacing[i];
+      const OffsetValueType center = static_cast<OffsetValueType>(index + 0.5);
+      boxes.ContinuousIndex[o] = index;
+      boxes.Start[o] = center - radius;
+      boxes.End[o] = center + radius;
+      boxes.IsInside[o] = index >= start - 0.5 && index < end - 0.5;
+      }
+    }
+
+  // The counting array is used for integer labels of a reasonable range.
+  this->m_UseTally = std::numeric_limits<PixelType>::is_integer;
+  if (this->m_UseTally)
+    {
+    typedef MinimumMaximumImageCalculator<ImageType> CalculatorType;
+    typename CalculatorType::Pointer calculator = CalculatorType::New();
+    calculator->SetImage(input);
+    calculator->Compute();
+    const double range = static_cast<double>(calculator->GetMaximum())
+      - static_cast<double>(calculator->GetMinimum()) + 1.;
+    this->m_UseTally = range <= this->m_MaximumLabelRange;
+    this->m_MinimumLabel = calculator->GetMinimum();
+    this->m_NumberOfBins = static_cast<size_t>(range);
+    }
+  if (this->m_UseTally)
+    {
+    this->m_HighPrecedenceRanks.assign(this->m_NumberOfBins, -1);
+    this->m_LowPrecedenceRanks.assign(this->m_NumberOfBins, -1);
+    for (size_t i = 0; i < this->m_HighPrecedenceLabels.size(); ++i)
+      {
+      const long bin = this->m_HighPrecedenceLabels[i]
+        - static_cast<long>(this->m_MinimumLabel);
+      // The first occurrence has the highest precedence
+      if (bin >= 0 && bin < static_cast<long>(this->m_NumberOfBins)
+          && this->m_HighPrecedenceRanks[bin] == -1)
+        {
+        this->m_HighPrecedenceRanks[bin] = static_cast<int>(i);
+        }
+      }
+    for (size_t i = 0; i < this->m_LowPrecedenceLabels.size(); ++i)
+      {
+      const long bin = this->m_LowPrecedenceLabels[i]
+        - static_cast<long>(this->m_MinimumLabel);
+      if (bin >= 0 && bin < static_cast<long>(this->m_NumberOfBins))
+        {
+        this->m_LowPrecedenceRanks[bin] = static_cast<int>(i);
+        }
+      }
+    this->m_VotingFunction = 0;
+    }
+  else
+    {
+    std::vector<int> highPrecedenceLabels = this->m_HighPrecedenceLabels;
+    std::vector<int> lowPrecedenceLabels = this->m_LowPrecedenceLabels;
+    this->m_VotingFunction = VotingFunctionType::New();
+    this->m_VotingFunction->SetInputImage(input);
+    this->m_VotingFunction->SetHighPrecedenceLabels(highPrecedenceLabels);
+    this->m_VotingFunction->SetLowPrecedenceLabels(lowPrecedenceLabels);
+    this->m_VotingFunction->SetOutputSpacing(this->m_OutputSpacing);
+    this->m_VotingFunction->SetRadius(this->m_Radius);
+    }
+}
+
+/**
+ * Vote
+ */
+template<class TImage>
+typename VotingResampleImageFilter<TImage>::PixelType
+VotingResampleImageFilter<TImage>
+::Vote(const LabelTally& tally) const
+{
+  const std::vector<size_t>& bins = tally.TouchedBins;
+  // The high precedence label with the highest precedence wins.
+  int highestRank = -1;
+  size_t winner = 0;
+  for (size_t i = 0; i < bins.size(); ++i)
+    {
+    const int rank = this->m_HighPrecedenceRanks[bins[i]];
+    if (rank >= 0 && (highestRank < 0 || rank < highestRank))
+      {
+      highestRank = rank;
+      winner = bins[i];
+      }
+    }
+  if (highestRank >= 0)
+    {
+    return static_cast<PixelType>(this->m_MinimumLabel + winner);
+    }
+
+  // Otherwise, the most represented label that is not a low precedence
+  // label wins. Ties are won by the smallest label.
+  unsigned long maximumCount = 0;
+  for (size_t i = 0; i < bins.size(); ++i)
+    {
+    const size_t bin = bins[i];
+    if (this->m_LowPrecedenceRanks[bin] >= 0)
+      {
+      continue;
+      }
+    const unsigned long count = tally.Counts[bin];
+    if (count > maximumCount || (count == maximumCount && bin < winner))
+      {
+      maximumCount = count;
+      winner = bin;
+      }
+    }
+  if (maximumCount > 0)
+    {
+    return static_cast<PixelType>(this->m_MinimumLabel + winner);
+    }
+
+  // Only low precedence labels, the last one in the list wins.
+  int lowestRank = -1;
+  for (size_t i = 0; i < bins.size(); ++i)
+    {
+    const int rank = this->m_LowPrecedenceRanks[bins[i]];
+    if (rank > lowestRank)
+      {
+      lowestRank = rank;
+      winner = bins[i];
+      }
+    }
+  return static_cast<PixelType>(this->m_MinimumLabel + winner);
+}
+
+/**
+ * ThreadedGenerateData
+ */
+template<class TImage>
+void VotingResampleImageFilter<TImage>
+::ThreadedGenerateData(const RegionType& outputRegionForThread,
+                       ThreadIdType threadId)
+{
+  if (!this->m_UseTally)
+    {
+    this->ThreadedGenerateDataWithFunction(outputRegionForThread, threadId);
+    return;
+    }
+
+  const ImageType* input = this->GetInput();
+  ImageType* output = this->GetOutput();
+  const RegionType& inputRegion = input->GetBufferedRegion();
+  const PixelType* buffer = input->GetBufferPointer();
+  const OffsetValueType* offsetTable = input->GetOffsetTable();
+
+  OffsetValueType firstIndex[ImageDimension];
+  OffsetValueType lastIndex[ImageDimension];
+  for (unsigned int i = 0; i < ImageDimension; ++i)
+    {
+    firstIndex[i] = inputRegion.GetIndex()[i];
+    lastIndex[i] = firstIndex[i] +
+      static_cast<OffsetValueType>(inputRegion.GetSize()[i]) - 1;
+    }
+
+  LabelTally tally(this->m_NumberOfBins);
+  // Offsets of the voxels of a column (all the axes but the scanline one)
+  std::vector<OffsetValueType> columnOffsets;
+
+  typedef ImageLinearIteratorWithIndex<ImageType> IteratorType;
+  IteratorType it(output, outputRegionForThread);
+  it.SetDirection(0);
+
+  const size_t numberOfLines = outputRegionForThread.GetNumberOfPixels()
+    / std::max(outputRegionForThread.GetSize()[0],
+               static_cast<typename SizeType::SizeValueType>(1));
+  ProgressReporter progress(this, threadId, numberOfLines);
+
+  for (it.GoToBegin(); !it.IsAtEnd(); it.NextLine())
+    {
+    const IndexType lineIndex = it.GetIndex();
+
+    // Voxels outside the input are 0, like ResampleImageFilter does.
+    bool isLineInside = true;
+    for (unsigned int i = 1; i < ImageDimension; ++i)
+      {
+      isLineInside = isLineInside &&
+        this->m_Boxes[i].IsInside[lineIndex[i]];
+      }
+
+    // Voxels replicated outside the input are counted as many times as they
+    // are replicated, like the neighborhood iterator boundary condition.
+    columnOffsets.resize(1);
+    columnOffsets[0] = 0;
+    for (unsigned int i = 1; isLineInside && i < ImageDimension; ++i)
+      {
+      const AxisBoxes& boxes = this->m_Boxes[i];
+      std::vector<OffsetValueType> offsets;
+      offsets.reserve(columnOffsets.size() *
+                      (boxes.End[lineIndex[i]] - boxes.Start[lineIndex[i]] + 1));
+      for (OffsetValueType v = boxes.Start[lineIndex[i]];
+           v <= boxes.End[lineIndex[i]]; ++v)
+        {
+        const OffsetValueType index = std::max(firstIndex[i],
+                                               std::min(lastIndex[i], v));
+        const OffsetValueType offset =
+          (index - firstIndex[i]) * offsetTable[i];
+        for (size_t c = 0; c < columnOffsets.size(); ++c)
+          {
+          offsets.push_back(columnOffsets[c] + offset);
+          }
+        }
+      columnOffsets.swap(offsets);
+      }
+
+    const AxisBoxes& boxes = this->m_Boxes[0];
+    bool isTallyValid = false;
+    OffsetValueType tallyStart = 0;
+    OffsetValueType tallyEnd = -1;
+    for (; !it.IsAtEndOfLine(); ++it)
+      {
+      const OffsetValueType o = it.GetIndex()[0];
+      if (!isLineInside || !boxes.IsInside[o])
+        {
+        it.Set(0);
+        continue;
+        }
+      const OffsetValueType start = boxes.Start[o];
+      const OffsetValueType end = boxes.End[o];
+      OffsetValueType addStart = start;
+      // Slide the tally if the boxes overlap, otherwise tally the whole box.
+      if (isTallyValid && start >= tallyStart && start <= tallyEnd &&
+          end >= tallyEnd)
+        {
+        for (OffsetValueType v = tallyStart; v < start; ++v)
+          {
+          const PixelType* column = buffer +
+            (std::max(firstIndex[0], std::min(lastIndex[0], v)) - firstIndex[0]);
+          for (size_t c = 0; c < columnOffsets.size(); ++c)
+            {
+            tally.Remove(static_cast<size_t>(
+              column[columnOffsets[c]] - this->m_MinimumLabel));
+            }
+          }
+        addStart = tallyEnd + 1;
+        }
+      else
+        {
+        tally.Reset();
+        }
+      for (OffsetValueType v = addStart; v <= end; ++v)
+        {
+        const PixelType* column = buffer +
+          (std::max(firstIndex[0], std::min(lastIndex[0], v)) - firstIndex[0]);
+        for (size_t c = 0; c < columnOffsets.size(); ++c)
+          {
+          tally.Add(static_cast<size_t>(
+            column[columnOffsets[c]] - this->m_MinimumLabel));
+          }
+        }
+      tallyStart = start;
+      tallyEnd = end;
+      isTallyValid = true;
+
+      tally.Compact();
+      it.Set(this->Vote(tally));
+      }
+    tally.Reset();
+    progress.CompletedPixel();
+    }
+}
+
+/**
+ * ThreadedGenerateDataWithFunction
+ */
+template<class TImage>
+void VotingResampleImageFilter<TImage>
+::ThreadedGenerateDataWithFunction(const RegionType& outputRegionForThread,
+                                   ThreadIdType threadId)
+{
+  ImageType* output = this->GetOutput();
+
+  typedef ImageLinearIteratorWithIndex<ImageType> IteratorType;
+  IteratorType it(output, outputRegionForThread);
+  it.SetDirection(0);
+
+  const size_t numberOfLines = outputRegionForThread.GetNumberOfPixels()
+    / std::max(outputRegionForThread.GetSize()[0],
+               static_cast<typename SizeType::SizeValueType>(1));
+  ProgressReporter progress(this, threadId, numberOfLines);
+
+  typename VotingFunctionType::ContinuousIndexType continuousIndex;
+  for (it.GoToBegin(); !it.IsAtEnd(); it.NextLine())
+    {
+    for (; !it.IsAtEndOfLine(); ++it)
+      {
+      const IndexType index = it.GetIndex();
+      bool isInside = true;
+      for (unsigned int i = 0; i < ImageDimension; ++i)
+        {
+        isInside = isInside && this->m_Boxes[i].IsInside[index[i]];
+        continuousIndex[i] = this->m_Boxes[i].ContinuousIndex[index[i]];
+        }
+      it.Set(isInside ?
+        static_cast<PixelType>(
+          this->m_VotingFunction->EvaluateAtContinuousIndex(continuousIndex)) :
+        static_cast<PixelType>(0));
+      }
+    progress.CompletedPixel();
+    }
+}
+
+/**
+ * PrintSelf
+ */
+template<class TImage>
+void VotingResampleImageFilter<TImage>
+::PrintSelf(std::ostream& os, Indent indent) const
+{
+  this->Superclass::PrintSelf(os,indent);
+  os << indent << "OutputSpacing: " << this->m_OutputSpacing << std::endl;
+  os << indent << "OutputOrigin: " << this->m_OutputOrigin << std::endl;
+  os << indent << "Size: " << this->m_Size << std::endl;
+  os << indent << "Radius: " << this->m_Radius << std::endl;
+  os << indent << "MaximumLabelRange: " << this->m_MaximumLabelRange
+     << std::endl;
+}
+
+} // end namespace itk
+
+#endif
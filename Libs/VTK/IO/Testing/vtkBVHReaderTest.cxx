@@ -335,5 +335,34 @@ int vtkBVHReaderTest(int argc, char* argv[])
       }
     }
 
+  // The frames decoded on demand must be the same as the frames read.
+  vtkSmartPointer<vtkBVHReader> onDemandReader =
+    vtkSmartPointer<vtkBVHReader>::New();
+  onDemandReader->SetFileName(bvhFilename.c_str());
+  onDemandReader->SetInitialRotation(identity.GetPointer());
+  onDemandReader->SetOnDemandFrames(true);
+  onDemandReader->SetFrameCacheSize(2);
+  onDemandReader->Update();
+  for (int n = 0; n < 2 * NumberOfFrames; ++n)
+    {
+    // Go forward then backward to use and evict the cached frames.
+    int i = n < NumberOfFrames ? n : 2 * NumberOfFrames - n - 1;
+    onDemandReader->SetFrame(i);
+    for (int j = 0; j < NumberOfBones; ++j)
+      {
+      vtkQuaterniond expected = reader->GetParentToBoneRotation(i, j);
+      vtkQuaterniond rotation = onDemandReader->GetParentToBoneRotation(i, j);
+      for (int k = 0; k < 4; ++k)
+        {
+        if (rotation[k] != expected[k])
+          {
+          std::cout<<"Incorrect on demand rotation for bone #"<<j
+            <<" at frame "<<i<<std::endl;
+          return EXIT_FAILURE;
+          }
+        }
+      }
+    }
+
   return EXIT_SUCCESS;
 }
@@ -27,6 +27,7 @@
 #include "vtkExecutive.h"
 #include "vtkInformation.h"
 #include "vtkInformationVector.h"
+#include "vtkMultiThreader.h"
 #include "vtkNew.h"
 #include "vtkObjectFactory.h"
 #include "vtkPolyData.h"
@@ -35,6 +36,7 @@
 #include <algorithm>
 #include <cctype>
 #include <fstream>
+#include <locale>
 #include <sstream>
 #include <stdexcept>
 
@@ -156,26 +158,60 @@ GetBoneName(const std::string& line, std::string keyword = "JOINT")
   return GetValue<std::string>(line, keyword);
 }
 
+//----------------------------------------------------------------------------
+// Channels of a bone, in the order of the values of a motion line.
+enum ChannelType
+{
+  XRotation = 0,
+  YRotation,
+  ZRotation,
+  Position,
+  UnknownChannel
+};
+
+//----------------------------------------------------------------------------
+ChannelType GetChannelType(const std::string& channel)
+{
+  if (channel == "Xrotation")
+    {
+    return XRotation;
+    }
+  else if (channel == "Yrotation")
+    {
+    return YRotation;
+    }
+  else if (channel == "Zrotation")
+    {
+    return ZRotation;
+    }
+  else if (channel == "Xposition" || channel == "Yposition"
+    || channel == "Zposition")
+    {
+    return Position;
+    }
+  return UnknownChannel;
+}
+
 //----------------------------------------------------------------------------
 vtkQuaterniond GetParentToBoneRotation(
   std::vector<double>::const_iterator& valueIterator,
-  std::vector<std::string> channel,
-  vtkBoneWidget* bone,
-  vtkQuaterniond& initialRotation)
+  const std::vector<int>& channel,
+  const vtkQuaterniond& worldToParentRest,
+  const vtkQuaterniond& initialRotation)
 {
   // /!\ Ignore any translation
   // \todo (?) Stop ignoring translations
 
   vtkQuaterniond rotation;
-  for (std::vector<std::string>::iterator it = channel.begin();
+  for (std::vector<int>::const_iterator it = channel.begin();
     it != channel.end(); ++it)
     {
-    if (*it == "Xrotation" || *it == "Yrotation" || *it == "Zrotation")
+    if (*it == XRotation || *it == YRotation || *it == ZRotation)
       {
       double axis[3];
-      axis[0] = (*it == "Xrotation") ? 1.0 : 0.0;
-      axis[1] = (*it == "Yrotation") ? 1.0 : 0.0;
-      axis[2] = (*it == "Zrotation") ? 1.0 : 0.0;
+      axis[0] = (*it == XRotation) ? 1.0 : 0.0;
+      axis[1] = (*it == YRotation) ? 1.0 : 0.0;
+      axis[2] = (*it == ZRotation) ? 1.0 : 0.0;
 
       vtkQuaterniond newRotation;
       newRotation.SetRotationAngleAndAxis(
@@ -187,7 +223,7 @@ vtkQuaterniond GetParentToBoneRotation(
 
       ++valueIterator;
       }
-   else if (*it == "Xposition" || *it == "Yposition" || *it == "Zposition")
+   else if (*it == Position)
       {
       ++valueIterator;
       }
@@ -197,27 +233,212 @@ vtkQuaterniond GetParentToBoneRotation(
   rotation = initialRotation * rotation * initialRotation.Inverse();
 
   // then in the world's coordinates
-  vtkQuaterniond worldToParentRest = bone->GetWorldToParentRestRotation();
   vtkQuaterniond parentToWorldRest = worldToParentRest.Inverse();
   return (parentToWorldRest * rotation * worldToParentRest).Normalized();
 }
 
 //----------------------------------------------------------------------------
 void
-GetParentToBoneRotations(std::vector<double>& values,
-                         std::vector< std::vector<std::string> >& channels,
+GetParentToBoneRotations(const std::vector<double>& values,
+                         const std::vector< std::vector<int> >& channels,
                          std::vector<vtkQuaterniond>& rotations,
-                         std::vector<vtkBoneWidget*>& bones,
-                         vtkQuaterniond& initialRotation)
+                         const std::vector<vtkQuaterniond>& worldToParentRests,
+                         const vtkQuaterniond& initialRotation)
 {
   std::vector<double>::const_iterator valueIterator = values.begin();
-  assert(channels.size() == bones.size());
-  for (int i = 0; i < channels.size(); ++i)
+  assert(channels.size() == worldToParentRests.size());
+  rotations.reserve(channels.size());
+  for (size_t i = 0; i < channels.size(); ++i)
     {
     rotations.push_back(
       GetParentToBoneRotation(
-        valueIterator, channels[i], bones[i], initialRotation));
+        valueIterator, channels[i], worldToParentRests[i], initialRotation));
+    }
+}
+
+//----------------------------------------------------------------------------
+inline bool IsBlank(char c)
+{
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n'
+    || c == '\v' || c == '\f';
+}
+
+//----------------------------------------------------------------------------
+inline bool IsDigit(char c)
+{
+  return c >= '0' && c <= '9';
+}
+
+//----------------------------------------------------------------------------
+// Parse the number at the cursor and move the cursor after it.
+// The parsing doesn't depend on the locale nor allocate. Numbers with up to
+// 15 significant digits and a power of ten up to 22 are exactly
+// representable, they are converted with a single correctly rounded
+// operation: the value is the same as with strtod() or operator>>.
+// Other numbers fall back to a stream with the classic locale.
+void ParseDouble(const char*& cursor, const char* end, double& value)
+{
+  static const double PowersOfTen[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+  const char* start = cursor;
+  bool negative = false;
+  if (cursor != end && (*cursor == '-' || *cursor == '+'))
+    {
+    negative = (*cursor == '-');
+    ++cursor;
+    }
+  vtkTypeUInt64 mantissa = 0;
+  int significantDigits = 0;
+  int exponent = 0;
+  bool hasDigits = false;
+  for (; cursor != end && IsDigit(*cursor); ++cursor)
+    {
+    hasDigits = true;
+    if (mantissa || *cursor != '0')
+      {
+      if (++significantDigits <= 15)
+        {
+        mantissa = mantissa * 10 + (*cursor - '0');
+        }
+      else
+        {
+        ++exponent;
+        }
+      }
+    }
+  if (cursor != end && *cursor == '.')
+    {
+    for (++cursor; cursor != end && IsDigit(*cursor); ++cursor)
+      {
+      hasDigits = true;
+      if (mantissa || *cursor != '0')
+        {
+        if (++significantDigits <= 15)
+          {
+          mantissa = mantissa * 10 + (*cursor - '0');
+          --exponent;
+          }
+        }
+      else
+        {
+        --exponent;
+        }
+      }
+    }
+  if (hasDigits && cursor != end && (*cursor == 'e' || *cursor == 'E'))
+    {
+    const char* exponentStart = cursor;
+    ++cursor;
+    bool negativeExponent = false;
+    if (cursor != end && (*cursor == '-' || *cursor == '+'))
+      {
+      negativeExponent = (*cursor == '-');
+      ++cursor;
+      }
+    if (cursor == end || !IsDigit(*cursor))
+      {
+      // Not an exponent, e.g. "1e"
+      cursor = exponentStart;
+      }
+    else
+      {
+      int explicitExponent = 0;
+      for (; cursor != end && IsDigit(*cursor); ++cursor)
+        {
+        if (explicitExponent < 10000)
+          {
+          explicitExponent = explicitExponent * 10 + (*cursor - '0');
+          }
+        }
+      exponent += negativeExponent ? -explicitExponent : explicitExponent;
+      }
+    }
+
+  if (hasDigits && significantDigits <= 15 && exponent >= -22 && exponent <= 22)
+    {
+    value = static_cast<double>(mantissa);
+    value = exponent < 0 ?
+      value / PowersOfTen[-exponent] : value * PowersOfTen[exponent];
+    value = negative ? -value : value;
+    }
+  else
+    {
+    std::istringstream ss(std::string(start, cursor));
+    ss.imbue(std::locale::classic());
+    value = 0.;
+    ss >> value;
+    }
+  // Skip the remaining of the token
+  while (cursor != end && !IsBlank(*cursor))
+    {
+    ++cursor;
+    }
+}
+
+//----------------------------------------------------------------------------
+// Parse the values of a motion line. Missing values are considered null.
+void ParseMotionLine(const char* cursor, const char* end,
+                     size_t numberOfValues, std::vector<double>& values)
+{
+  values.clear();
+  while (cursor != end)
+    {
+    if (IsBlank(*cursor))
+      {
+      ++cursor;
+      continue;
+      }
+    double value = 0.;
+    ParseDouble(cursor, end, value);
+    values.push_back(value);
+    }
+  if (values.size() < numberOfValues)
+    {
+    values.resize(numberOfValues, 0.);
+    }
+}
+
+//----------------------------------------------------------------------------
+// Motion lines of the buffer and the data needed to convert them into
+// rotations.
+struct MotionInfo
+{
+  std::vector<const char*> LineStarts;
+  std::vector<const char*> LineEnds;
+  size_t NumberOfValues;
+  const std::vector< std::vector<int> >* Channels;
+  const std::vector<vtkQuaterniond>* WorldToParentRests;
+  vtkQuaterniond InitialRotation;
+  std::vector< std::vector<vtkQuaterniond> >* Frames;
+};
+
+//----------------------------------------------------------------------------
+// Convert the motion lines into frames, the lines are split between the
+// threads.
+VTK_THREAD_RETURN_TYPE ParseMotionsThreaderCallback(void* arg)
+{
+  vtkMultiThreader::ThreadInfo* threadInfo =
+    static_cast<vtkMultiThreader::ThreadInfo*>(arg);
+  MotionInfo* info = static_cast<MotionInfo*>(threadInfo->UserData);
+
+  const size_t numberOfLines = info->LineStarts.size();
+  const size_t threadId = threadInfo->ThreadID;
+  const size_t numberOfThreads = threadInfo->NumberOfThreads;
+  const size_t first = numberOfLines * threadId / numberOfThreads;
+  const size_t last = numberOfLines * (threadId + 1) / numberOfThreads;
+
+  std::vector<double> values;
+  values.reserve(info->NumberOfValues);
+  for (size_t line = first; line < last; ++line)
+    {
+    ParseMotionLine(info->LineStarts[line], info->LineEnds[line],
+                    info->NumberOfValues, values);
+    GetParentToBoneRotations(values, *info->Channels, (*info->Frames)[line],
+                             *info->WorldToParentRests, info->InitialRotation);
     }
+  return VTK_THREAD_RETURN_VALUE;
 }
 
 } // end namespace
@@ -235,6 +456,9 @@ vtkBVHReader::vtkBVHReader()
   this->NumberOfFrames = 0;
   this->FrameRate = 0;
   this->LinkToFirstChild = false;
+  this->NumberOfChannelValues = 0;
+  this->OnDemandFrames = false;
+  this->FrameCacheSize = 16;
   this->InitialRotation = vtkTransform::New();
   this->InitialRotation->RotateZ(180.0);
   this->InitialRotation->RotateX(90.0);
@@ -308,6 +532,19 @@ void vtkBVHReader::SetLinkToFirstChild(bool link)
   this->Modified();
 }
 
+//----------------------------------------------------------------------------
+void vtkBVHReader::SetOnDemandFrames(bool onDemand)
+{
+  if (this->OnDemandFrames == onDemand)
+    {
+    return;
+    }
+
+  this->OnDemandFrames = onDemand;
+  this->RestArmatureIsValid = false;
+  this->Modified();
+}
+
 //----------------------------------------------------------------------------
 int vtkBVHReader::RequestData(vtkInformation *vtkNotUsed(request),
                               vtkInformationVector **vtkNotUsed(inputVector),
@@ -341,6 +578,9 @@ int vtkBVHReader::RequestData(vtkInformation *vtkNotUsed(request),
 
     this->Bones.clear();
     this->Frames.clear();
+    this->FrameOffsets.clear();
+    this->FrameLengths.clear();
+    this->FrameCache.clear();
     if (!this->Parse(file))
       {
       vtkErrorMacro("Error when parsing the file.");
@@ -541,13 +781,24 @@ void vtkBVHReader
   double wxyz[4];
   this->InitialRotation->GetOrientationWXYZ(wxyz);
 
-  vtkQuaterniond InitialRotation;
-  InitialRotation.SetRotationAngleAndAxis(
+  this->InitialQuaternion.SetRotationAngleAndAxis(
     vtkMath::RadiansFromDegrees(wxyz[0]), wxyz[1], wxyz[2], wxyz[3]);
 
+  // Read the header of the motion, up to the first motion line.
+  std::streampos motionStart = file.tellg();
   while (std::getline(file, line))
     {
-    std::string keyword = MoveToNextKeyword(file, line);
+    const size_t first = line.find_first_not_of(" \t\r");
+    if (first != std::string::npos &&
+        (IsDigit(line[first]) || line[first] == '-' || line[first] == '+'
+         || line[first] == '.'))
+      {
+      // First motion line
+      file.clear();
+      file.seekg(motionStart);
+      break;
+      }
+    std::string keyword = GetKeyword(line);
     if (keyword == "Frames:")
       {
       this->NumberOfFrames = GetValue<unsigned int>(line, keyword);
@@ -556,17 +807,197 @@ void vtkBVHReader
       {
       this->FrameRate = GetValue<double>(line, "Frame time:");
       }
-    else
+    motionStart = file.tellg();
+    }
+  if (!file.good())
+    {
+    // No motion line
+    return;
+    }
+
+  // The channels and the rest rotations are shared by all the frames.
+  this->ChannelTypes.assign(channels.size(), std::vector<int>());
+  this->NumberOfChannelValues = 0;
+  for (size_t i = 0; i < channels.size(); ++i)
+    {
+    for (size_t j = 0; j < channels[i].size(); ++j)
+      {
+      const ChannelType type = GetChannelType(channels[i][j]);
+      this->ChannelTypes[i].push_back(type);
+      this->NumberOfChannelValues += (type != UnknownChannel) ? 1 : 0;
+      }
+    }
+  this->WorldToParentRestRotations.clear();
+  for (size_t i = 0; i < this->Bones.size(); ++i)
+    {
+    this->WorldToParentRestRotations.push_back(
+      this->Bones[i]->GetWorldToParentRestRotation());
+    }
+  if (this->ChannelTypes.size() != this->WorldToParentRestRotations.size())
+    {
+    std::cerr<<"Error during the processing:"
+      << " the number of channels doesn't match the number of joints"
+      << std::endl;
+    this->InvalidReader();
+    return;
+    }
+
+  if (this->OnDemandFrames)
+    {
+    this->IndexMotions(static_cast<vtkTypeInt64>(motionStart));
+    return;
+    }
+
+  // Read the motion lines at once, they are parsed in place.
+  file.seekg(0, std::ios::end);
+  const std::streamoff motionSize = file.tellg() - motionStart;
+  file.seekg(motionStart);
+  std::vector<char> buffer(static_cast<size_t>(std::max(
+    motionSize, static_cast<std::streamoff>(0))));
+  if (!buffer.empty())
+    {
+    file.read(&buffer[0], buffer.size());
+    // Less characters are read than the size in text mode with CRLF
+    buffer.resize(static_cast<size_t>(file.gcount()));
+    }
+
+  // Find the motion lines, blank lines and comments are skipped.
+  MotionInfo info;
+  const char* bufferEnd = buffer.empty() ? 0 : &buffer[0] + buffer.size();
+  for (const char* cursor = buffer.empty() ? 0 : &buffer[0];
+       cursor != bufferEnd;)
+    {
+    const char* lineEnd = std::find(cursor, bufferEnd, '\n');
+    const char* first = cursor;
+    while (first != lineEnd && IsBlank(*first))
+      {
+      ++first;
+      }
+    if (first != lineEnd && *first != '#')
+      {
+      info.LineStarts.push_back(first);
+      info.LineEnds.push_back(lineEnd);
+      }
+    cursor = lineEnd == bufferEnd ? bufferEnd : lineEnd + 1;
+    }
+
+  info.NumberOfValues = this->NumberOfChannelValues;
+  info.Channels = &this->ChannelTypes;
+  info.WorldToParentRests = &this->WorldToParentRestRotations;
+  info.InitialRotation = this->InitialQuaternion;
+
+  // \todo (?) incorporate root translation
+  this->Frames.resize(info.LineStarts.size());
+  info.Frames = &this->Frames;
+  vtkNew<vtkMultiThreader> threader;
+  threader->SetNumberOfThreads(std::max(1, std::min(
+    threader->GetNumberOfThreads(),
+    static_cast<int>(info.LineStarts.size()))));
+  threader->SetSingleMethod(ParseMotionsThreaderCallback, &info);
+  threader->SingleMethodExecute();
+}
+
+//----------------------------------------------------------------------------
+void vtkBVHReader::IndexMotions(vtkTypeInt64 motionStart)
+{
+  // Scan the motion lines by chunks, only their position in the file is
+  // kept. Blank lines and comments are skipped.
+  std::ifstream file(this->FileName.c_str(), std::ios::binary);
+  file.seekg(static_cast<std::streamoff>(motionStart));
+  std::vector<char> chunk(1 << 20);
+  vtkTypeInt64 chunkStart = motionStart;
+  vtkTypeInt64 lineStart = -1;
+  bool isComment = false;
+  while (file.good())
+    {
+    file.read(&chunk[0], chunk.size());
+    const vtkTypeInt64 chunkSize = file.gcount();
+    for (vtkTypeInt64 i = 0; i <= chunkSize; ++i)
       {
-      // \todo (?) incorporate root translation
-      std::vector<double> values;
-      GetValues<double>(line, values);
+      const bool isEnd = (i == chunkSize);
+      if (isEnd && file.good())
+        {
+        // The line continues in the next chunk
+        break;
+        }
+      const char c = isEnd ? '\n' : chunk[i];
+      if (c == '\n')
+        {
+        if (lineStart >= 0 && !isComment)
+          {
+          this->FrameOffsets.push_back(lineStart);
+          this->FrameLengths.push_back(
+            static_cast<unsigned int>(chunkStart + i - lineStart));
+          }
+        lineStart = -1;
+        isComment = false;
+        }
+      else if (lineStart < 0 && !IsBlank(c))
+        {
+        lineStart = chunkStart + i;
+        isComment = (c == '#');
+        }
+      }
+    chunkStart += chunkSize;
+    }
+}
+
+//----------------------------------------------------------------------------
+unsigned int vtkBVHReader::GetNumberOfParsedFrames() const
+{
+  return static_cast<unsigned int>(this->OnDemandFrames ?
+    this->FrameOffsets.size() : this->Frames.size());
+}
+
+//----------------------------------------------------------------------------
+const std::vector<vtkQuaterniond>*
+vtkBVHReader::GetFrameRotations(unsigned int frame)
+{
+  if (frame >= this->GetNumberOfParsedFrames())
+    {
+    return NULL;
+    }
+  if (!this->OnDemandFrames)
+    {
+    return &this->Frames[frame];
+    }
 
-      this->Frames.push_back(std::vector<vtkQuaterniond>());
-      GetParentToBoneRotations(
-        values, channels, this->Frames.back(), this->Bones, InitialRotation);
+  // Most recently used frames first
+  for (FrameCacheType::iterator it = this->FrameCache.begin();
+    it != this->FrameCache.end(); ++it)
+    {
+    if (it->first == frame)
+      {
+      this->FrameCache.splice(
+        this->FrameCache.begin(), this->FrameCache, it);
+      return &this->FrameCache.front().second;
       }
     }
+
+  std::ifstream file(this->FileName.c_str(), std::ios::binary);
+  file.seekg(static_cast<std::streamoff>(this->FrameOffsets[frame]));
+  std::vector<char> line(this->FrameLengths[frame] + 1);
+  file.read(&line[0], this->FrameLengths[frame]);
+  if (file.gcount() != static_cast<std::streamsize>(this->FrameLengths[frame]))
+    {
+    vtkErrorMacro("Cannot read the frame #" << frame << " from the file.");
+    return NULL;
+    }
+
+  std::vector<double> values;
+  ParseMotionLine(&line[0], &line[0] + this->FrameLengths[frame],
+                  this->NumberOfChannelValues, values);
+  this->FrameCache.push_front(
+    std::make_pair(frame, std::vector<vtkQuaterniond>()));
+  GetParentToBoneRotations(values, this->ChannelTypes,
+                           this->FrameCache.front().second,
+                           this->WorldToParentRestRotations,
+                           this->InitialQuaternion);
+  while (this->FrameCache.size() > std::max(this->FrameCacheSize, 1u))
+    {
+    this->FrameCache.pop_back();
+    }
+  return &this->FrameCache.front().second;
 }
 
 //----------------------------------------------------------------------------
@@ -578,7 +1009,7 @@ bool vtkBVHReader
     return false;
     }
 
-  unsigned int numberOfFrames = static_cast<unsigned int>(this->Frames.size());
+  unsigned int numberOfFrames = this->GetNumberOfParsedFrames();
   if (numberOfFrames <= frame)
     {
     std::cerr<<"The input frame exceeds the total number of frames."<<std::endl
@@ -589,14 +1020,19 @@ bool vtkBVHReader
   this->Armature->ResetPoseToRest();
   int oldState = this->Armature->SetWidgetState(vtkArmatureWidget::Pose);
 
-  assert(this->Frames[this->Frame].size() == this->Bones.size());
   try
     {
+    const std::vector<vtkQuaterniond>* rotations =
+      this->GetFrameRotations(this->Frame);
+    if (!rotations)
+      {
+      throw std::out_of_range("frame");
+      }
+    assert(rotations->size() == this->Bones.size());
     for (size_t i = 0; i < this->Bones.size(); ++i)
       {
       double axis[3];
-      double angle =
-        this->Frames.at(this->Frame).at(i).GetRotationAngleAndAxis(axis);
+      double angle = rotations->at(i).GetRotationAngleAndAxis(axis);
       this->Bones.at(i)->RotateTailWithParentWXYZ(angle, axis);
       }
     }
@@ -617,7 +1053,9 @@ bool vtkBVHReader
 vtkQuaterniond vtkBVHReader
 ::GetParentToBoneRotation(unsigned int frame, unsigned int boneId)
 {
-  return this->Frames[frame][boneId];
+  const std::vector<vtkQuaterniond>* rotations =
+    this->GetFrameRotations(frame);
+  return rotations ? (*rotations)[boneId] : vtkQuaterniond();
 }
 
 //----------------------------------------------------------------------------
@@ -747,6 +1185,9 @@ void vtkBVHReader::InvalidReader()
     }
 
   this->Frames.clear();
+  this->FrameOffsets.clear();
+  this->FrameLengths.clear();
+  this->FrameCache.clear();
   this->Bones.clear();
 
   this->Frame = 0;
@@ -781,4 +1222,6 @@ void vtkBVHReader::PrintSelf(ostream& os, vtkIndent indent)
   os << indent << "LinkWithFirstChild: " << this->LinkToFirstChild << "\n";
   os << indent << "NumberOfFrames: " << this->NumberOfFrames << "\n";
   os << indent << "FrameRate: " << this->FrameRate << "\n";
+  os << indent << "OnDemandFrames: " << this->OnDemandFrames << "\n";
+  os << indent << "FrameCacheSize: " << this->FrameCacheSize << "\n";
 }
@@ -30,6 +30,9 @@
 // to choose from the different motion frame. The movement data is gathered
 // under The MOTION part of the file. Upon reading, the animation information
 // is stored. This provides faster look up when changing the frame.
+// With OnDemandFrames, only the position of each frame in the file is
+// stored upon reading. The frames are decoded when they are used and the
+// last used frames are kept in a small cache.
 //
 // The polydata is obtained from the armature widget. To learn more about
 // its structure, see the vtkArmatureWidget->GetPolyData().
@@ -45,6 +48,7 @@
 #include "vtkBenderIOExport.h"
 #include "vtkQuaternion.h"
 
+#include <list>
 #include <vector>
 
 class vtkArmatureWidget;
@@ -92,6 +96,21 @@ public:
   void SetLinkToFirstChild(bool link);
   vtkGetMacro(LinkToFirstChild, bool);
 
+  // Description:
+  // When on, the frames are decoded from the file only when they are used
+  // (SetFrame(), ApplyFrameToArmature(), GetParentToBoneRotation()) instead
+  // of all upon reading. The reading time and the memory no longer depend
+  // on the number of frames. Changing it invalids the reader.
+  // Default is false.
+  void SetOnDemandFrames(bool onDemand);
+  vtkGetMacro(OnDemandFrames, bool);
+
+  // Description:
+  // Number of decoded frames kept in memory when OnDemandFrames is on.
+  // Default is 16.
+  vtkSetMacro(FrameCacheSize, unsigned int);
+  vtkGetMacro(FrameCacheSize, unsigned int);
+
   // Description:
   // Get the armature from which the polydata is obtained.
   vtkGetObjectMacro(Armature, vtkArmatureWidget);
@@ -159,6 +178,33 @@ protected:
   typedef std::vector< std::vector<vtkQuaterniond> > FramesList;
   FramesList Frames;
 
+  // Description:
+  // Data needed to decode a motion line into a frame: the type of the
+  // channels of each bone, the rest rotation of each bone and the
+  // initial rotation.
+  std::vector< std::vector<int> > ChannelTypes;
+  size_t NumberOfChannelValues;
+  std::vector<vtkQuaterniond> WorldToParentRestRotations;
+  vtkQuaterniond InitialQuaternion;
+
+  // Description:
+  // On demand frames: position and length of each motion line in the file
+  // and the last decoded frames, most recently used first.
+  bool OnDemandFrames;
+  unsigned int FrameCacheSize;
+  std::vector<vtkTypeInt64> FrameOffsets;
+  std::vector<unsigned int> FrameLengths;
+  typedef std::list<
+    std::pair<unsigned int, std::vector<vtkQuaterniond> > > FrameCacheType;
+  FrameCacheType FrameCache;
+
+  // Description:
+  // Return the rotations of the frame, decoding it if needed. Return NULL
+  // if the frame doesn't exist. The pointer is valid until the next call.
+  const std::vector<vtkQuaterniond>* GetFrameRotations(unsigned int frame);
+  unsigned int GetNumberOfParsedFrames() const;
+  void IndexMotions(vtkTypeInt64 motionStart);
+
   void InvalidReader();
 
   double* TransformPoint(double point[3]) const;
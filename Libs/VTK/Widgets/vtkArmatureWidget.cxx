@@ -49,6 +49,7 @@
 
 // STD includes
 #include <algorithm>
+#include <map>
 
 vtkStandardNewMacro(vtkArmatureWidget);
 
@@ -1072,6 +1073,15 @@ void vtkArmatureWidget::UpdatePolyData()
   restToPose->Reset();
 
   this->PolyData->Reset();
+
+  // Index of each bone in the arrays, to write the parenthood in one pass.
+  std::map<vtkBoneWidget*, vtkIdType> boneIndexes;
+  for (NodeIteratorType it = this->Bones->begin();
+    it != this->Bones->end(); ++it)
+    {
+    boneIndexes[(*it)->Bone] = it - this->Bones->begin();
+    }
+
   for (NodeIteratorType it = this->Bones->begin();
     it != this->Bones->end(); ++it)
     {
@@ -1110,14 +1120,11 @@ void vtkArmatureWidget::UpdatePolyData()
     // Parenthood
     if ((*it)->Parent)
       {
-      for (NodeIteratorType parentIt = this->Bones->begin();
-        parentIt != this->Bones->end(); ++parentIt)
+      std::map<vtkBoneWidget*, vtkIdType>::const_iterator parentIt =
+        boneIndexes.find((*it)->Parent->Bone);
+      if (parentIt != boneIndexes.end())
         {
-        if ((*parentIt)->Bone == (*it)->Parent->Bone)
-          {
-          parenthood->InsertNextValue(parentIt - this->Bones->begin());
-          break;
-          }
+        parenthood->InsertNextValue(parentIt->second);
         }
       }
     else // Root
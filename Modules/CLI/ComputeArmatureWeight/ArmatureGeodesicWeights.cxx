@@ -0,0 +1,337 @@
+/*=========================================================================
+
+  Program: Bender
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+
+#include "ArmatureGeodesicWeights.h"
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <queue>
+
+namespace
+{
+
+const LabelType InvalidEdge = std::numeric_limits<LabelType>::max();
+
+//-----------------------------------------------------------------------------
+struct Front
+{
+  float Distance;
+  size_t Voxel;
+  LabelType Edge;
+
+  Front(float distance, size_t voxel, LabelType edge)
+    : Distance(distance), Voxel(voxel), Edge(edge) {}
+  bool operator>(const Front& other) const
+    {
+    return this->Distance > other.Distance;
+    }
+};
+
+} // end namespace
+
+//-----------------------------------------------------------------------------
+ArmatureGeodesicWeights::ArmatureGeodesicWeights()
+{
+  this->FalloffKernel = GaussianKernel;
+  this->Falloff = 20.;
+  this->MaximumNumberOfInfluences = 4;
+  this->MaximumParenthoodDistance = -1;
+  this->ArmatureTopology = 0;
+}
+
+//-----------------------------------------------------------------------------
+void ArmatureGeodesicWeights::SetKernel(KernelType kernel)
+{
+  this->FalloffKernel = kernel;
+}
+
+//-----------------------------------------------------------------------------
+ArmatureGeodesicWeights::KernelType ArmatureGeodesicWeights::GetKernel() const
+{
+  return this->FalloffKernel;
+}
+
+//-----------------------------------------------------------------------------
+void ArmatureGeodesicWeights::SetFalloff(double falloff)
+{
+  this->Falloff = falloff;
+}
+
+//-----------------------------------------------------------------------------
+double ArmatureGeodesicWeights::GetFalloff() const
+{
+  return this->Falloff;
+}
+
+//-----------------------------------------------------------------------------
+void ArmatureGeodesicWeights
+::SetMaximumNumberOfInfluences(unsigned int influences)
+{
+  this->MaximumNumberOfInfluences = std::max(influences, 1u);
+}
+
+//-----------------------------------------------------------------------------
+unsigned int ArmatureGeodesicWeights::GetMaximumNumberOfInfluences() const
+{
+  return this->MaximumNumberOfInfluences;
+}
+
+//-----------------------------------------------------------------------------
+void ArmatureGeodesicWeights::SetMaximumParenthoodDistance(int distance)
+{
+  this->MaximumParenthoodDistance = distance;
+}
+
+//-----------------------------------------------------------------------------
+void ArmatureGeodesicWeights
+::SetArmatureTopology(const bender::ArmatureTopology* topology)
+{
+  this->ArmatureTopology = topology;
+}
+
+//-----------------------------------------------------------------------------
+bool ArmatureGeodesicWeights::Update(const LabelImageType* bodyPartition,
+                                     const LabelImageType* bonesPartition,
+                                     const unsigned char* abort)
+{
+  this->BodyPartition = bodyPartition;
+  const RegionType region = bodyPartition->GetLargestPossibleRegion();
+  if (bonesPartition->GetLargestPossibleRegion() != region)
+    {
+    std::cerr << "Body and bones partitions must have the same region."
+              << std::endl;
+    return false;
+    }
+
+  const size_t numberOfVoxels = region.GetNumberOfPixels();
+  const unsigned int k = this->MaximumNumberOfInfluences;
+  this->Edges.assign(numberOfVoxels * k, InvalidEdge);
+  this->Distances.assign(numberOfVoxels * k,
+                         std::numeric_limits<float>::max());
+
+  const LabelType* body = bodyPartition->GetBufferPointer();
+  const LabelType* bones = bonesPartition->GetBufferPointer();
+
+  // 26-neighborhood, with the physical length of each step
+  const LabelImageType::SpacingType& spacing = bodyPartition->GetSpacing();
+  const LabelImageType::SizeType& size = region.GetSize();
+  std::vector<VoxelOffsetType> offsets;
+  std::vector<float> steps;
+  for (int z = -1; z <= 1; ++z)
+    {
+    for (int y = -1; y <= 1; ++y)
+      {
+      for (int x = -1; x <= 1; ++x)
+        {
+        if (x == 0 && y == 0 && z == 0)
+          {
+          continue;
+          }
+        VoxelOffsetType offset = {{x, y, z}};
+        offsets.push_back(offset);
+        steps.push_back(static_cast<float>(sqrt(
+          x * x * spacing[0] * spacing[0] +
+          y * y * spacing[1] * spacing[1] +
+          z * z * spacing[2] * spacing[2])));
+        }
+      }
+    }
+
+  // Seed the fronts with the bones voxels
+  std::priority_queue<Front, std::vector<Front>, std::greater<Front> > fronts;
+  for (size_t i = 0; i < numberOfVoxels; ++i)
+    {
+    if (body[i] != ArmatureWeightWriter::BackgroundLabel &&
+        bones[i] >= ArmatureWeightWriter::EdgeLabels)
+      {
+      LabelType edge = static_cast<LabelType>(
+        bones[i] - ArmatureWeightWriter::EdgeLabels);
+      this->Edges[i * k] = edge;
+      this->Distances[i * k] = 0.f;
+      fronts.push(Front(0.f, i, edge));
+      }
+    }
+
+  // Multi-source Dijkstra that keeps the k closest edges of each voxel.
+  // An edge is only propagated from a voxel where it is among the k
+  // closest: beyond, the k closer edges would reach first anyway.
+  size_t count = 0;
+  while (!fronts.empty())
+    {
+    Front front = fronts.top();
+    fronts.pop();
+
+    if (abort && (++count % 100000) == 0 && *abort)
+      {
+      return false;
+      }
+
+    // Skip outdated fronts
+    LabelType* edges = &this->Edges[front.Voxel * k];
+    float* distances = &this->Distances[front.Voxel * k];
+    unsigned int slot = 0;
+    while (slot < k && edges[slot] != front.Edge)
+      {
+      ++slot;
+      }
+    if (slot == k || distances[slot] < front.Distance)
+      {
+      continue;
+      }
+
+    VoxelType voxel;
+    voxel[0] = region.GetIndex(0) + front.Voxel % size[0];
+    voxel[1] = region.GetIndex(1) + (front.Voxel / size[0]) % size[1];
+    voxel[2] = region.GetIndex(2) + front.Voxel / (size[0] * size[1]);
+    for (size_t n = 0; n < offsets.size(); ++n)
+      {
+      VoxelType neighbor = voxel + offsets[n];
+      if (!region.IsInside(neighbor))
+        {
+        continue;
+        }
+      size_t neighborIndex = neighbor[0] - region.GetIndex(0)
+        + size[0] * (neighbor[1] - region.GetIndex(1)
+        + size[1] * (neighbor[2] - region.GetIndex(2)));
+      if (body[neighborIndex] == ArmatureWeightWriter::BackgroundLabel)
+        {
+        continue;
+        }
+
+      float distance = front.Distance + steps[n];
+      LabelType* neighborEdges = &this->Edges[neighborIndex * k];
+      float* neighborDistances = &this->Distances[neighborIndex * k];
+      // Already closer to that edge, or not among the k closest edges
+      unsigned int neighborSlot = 0;
+      while (neighborSlot < k - 1 &&
+             neighborEdges[neighborSlot] != front.Edge &&
+             neighborEdges[neighborSlot] != InvalidEdge)
+        {
+        ++neighborSlot;
+        }
+      if (neighborDistances[neighborSlot] <= distance)
+        {
+        continue;
+        }
+      // Insert sorted, it replaces the previous distance of the edge or
+      // the farthest edge.
+      while (neighborSlot > 0 && neighborDistances[neighborSlot - 1] > distance)
+        {
+        neighborEdges[neighborSlot] = neighborEdges[neighborSlot - 1];
+        neighborDistances[neighborSlot] = neighborDistances[neighborSlot - 1];
+        --neighborSlot;
+        }
+      neighborEdges[neighborSlot] = front.Edge;
+      neighborDistances[neighborSlot] = distance;
+      fronts.push(Front(distance, neighborIndex, front.Edge));
+      }
+    }
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+float ArmatureGeodesicWeights
+::EvaluateKernel(float distance, float closestDistance) const
+{
+  float d = static_cast<float>(distance / this->Falloff);
+  if (this->FalloffKernel == GaussianKernel)
+    {
+    // Relative to the closest bone to not underflow far from the bones,
+    // the ratio between the weights is the same.
+    float d0 = static_cast<float>(closestDistance / this->Falloff);
+    return exp(d0 * d0 - d * d);
+    }
+  return 1.f / (1.f + d * d);
+}
+
+//-----------------------------------------------------------------------------
+bool ArmatureGeodesicWeights::IsRelated(LabelType regionLabel,
+                                        EdgeType edge) const
+{
+  if (this->MaximumParenthoodDistance < 0 ||
+      !this->ArmatureTopology ||
+      this->ArmatureTopology->IsEmpty() ||
+      regionLabel < ArmatureWeightWriter::EdgeLabels)
+    {
+    return true;
+    }
+  return this->ArmatureTopology->GetDistance(
+    regionLabel - ArmatureWeightWriter::EdgeLabels, edge) <=
+      this->MaximumParenthoodDistance;
+}
+
+//-----------------------------------------------------------------------------
+WeightImageType::Pointer ArmatureGeodesicWeights
+::GetWeight(EdgeType edge) const
+{
+  WeightImageType::Pointer weight = WeightImageType::New();
+  weight->CopyInformation(this->BodyPartition);
+  weight->SetRegions(this->BodyPartition->GetLargestPossibleRegion());
+  weight->Allocate();
+
+  const unsigned int k = this->MaximumNumberOfInfluences;
+  const LabelType* body = this->BodyPartition->GetBufferPointer();
+  WeightImagePixelType* weights = weight->GetBufferPointer();
+  const size_t numberOfVoxels =
+    this->BodyPartition->GetLargestPossibleRegion().GetNumberOfPixels();
+  for (size_t i = 0; i < numberOfVoxels; ++i)
+    {
+    if (body[i] == ArmatureWeightWriter::BackgroundLabel)
+      {
+      weights[i] = -1.f;
+      continue;
+      }
+    const LabelType* edges = &this->Edges[i * k];
+    const float* distances = &this->Distances[i * k];
+    // On a bone, the bone takes all the weight
+    if (distances[0] == 0.f)
+      {
+      weights[i] = edges[0] == edge ? 1.f : 0.f;
+      continue;
+      }
+    float sum = 0.f;
+    float edgeWeight = 0.f;
+    float closestDistance = -1.f;
+    for (unsigned int slot = 0; slot < k && edges[slot] != InvalidEdge; ++slot)
+      {
+      if (!this->IsRelated(body[i], edges[slot]))
+        {
+        continue;
+        }
+      if (closestDistance < 0.f)
+        {
+        closestDistance = distances[slot];
+        }
+      float w = this->EvaluateKernel(distances[slot], closestDistance);
+      sum += w;
+      if (edges[slot] == edge)
+        {
+        edgeWeight = w;
+        }
+      }
+    weights[i] = sum > 0.f ? edgeWeight / sum : 0.f;
+    }
+  return weight;
+}
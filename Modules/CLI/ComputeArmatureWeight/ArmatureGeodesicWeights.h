@@ -0,0 +1,99 @@
+/*=========================================================================
+
+  Program: Bender
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+#ifndef __ArmatureGeodesicWeights_h
+#define __ArmatureGeodesicWeights_h
+
+// .NAME ArmatureGeodesicWeights - Weights from geodesic distances to the bones
+// .SECTION General Description
+// Cheap alternative to the heat diffusion of ArmatureWeightWriter.
+// A single multi-source Dijkstra on the 26-neighborhood, constrained to the
+// body partition, propagates from the voxels of every bone of the bones
+// partition and keeps for each voxel the distances to its
+// MaximumNumberOfInfluences closest bones. The weight of an edge is then a
+// falloff kernel of its distance normalized by the kernels of the other
+// kept bones. Voxels on a bone have a weight of 1 for that bone.
+// As with the heat diffusion, bones too far in the family tree of the body
+// partition region of a voxel get no weight.
+
+// ComputeArmatureWeight includes
+#include "ArmatureWeightWriter.h"
+
+// STD includes
+#include <vector>
+
+//-------------------------------------------------------------------------------
+class ArmatureGeodesicWeights
+{
+public:
+  ArmatureGeodesicWeights();
+
+  // Enums the falloff kernels applied to the geodesic distances
+  enum KernelType
+    {
+    GaussianKernel = 0,
+    InverseSquareKernel
+    };
+
+  // Kernel(d) = exp(-(d/falloff)^2) or 1 / (1 + (d/falloff)^2).
+  // Gaussian by default.
+  void SetKernel(KernelType kernel);
+  KernelType GetKernel() const;
+
+  // Falloff distance of the kernel in physical units. 20 by default.
+  void SetFalloff(double falloff);
+  double GetFalloff() const;
+
+  // Number of closest bones kept per voxel. 4 by default.
+  void SetMaximumNumberOfInfluences(unsigned int influences);
+  unsigned int GetMaximumNumberOfInfluences() const;
+
+  // See ArmatureWeightWriter::SetMaximumParenthoodDistance().
+  // The topology is required when the distance is >= 0.
+  void SetMaximumParenthoodDistance(int distance);
+  void SetArmatureTopology(const bender::ArmatureTopology* topology);
+
+  // Compute the distances of all the voxels to their closest bones.
+  // Bones voxels are the voxels >= EdgeLabels of the bones partition.
+  bool Update(const LabelImageType* bodyPartition,
+              const LabelImageType* bonesPartition,
+              const unsigned char* abort = 0);
+
+  // Return the weight image of the edge, -1 outside the body.
+  WeightImageType::Pointer GetWeight(EdgeType edge) const;
+
+private:
+  float EvaluateKernel(float distance, float closestDistance) const;
+  bool IsRelated(LabelType regionLabel, EdgeType edge) const;
+
+  KernelType FalloffKernel;
+  double Falloff;
+  unsigned int MaximumNumberOfInfluences;
+  int MaximumParenthoodDistance;
+  const bender::ArmatureTopology* ArmatureTopology;
+
+  LabelImageType::ConstPointer BodyPartition;
+  // MaximumNumberOfInfluences closest edges (and their distances) for each
+  // voxel, sorted by distance. Unused slots have an InvalidEdge.
+  std::vector<LabelType> Edges;
+  std::vector<float> Distances;
+};
+
+#endif
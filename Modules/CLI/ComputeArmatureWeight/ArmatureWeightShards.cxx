@@ -0,0 +1,484 @@
+/*=========================================================================
+
+  Program: Bender
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+#include "ArmatureWeightShards.h"
+
+// ITK includes
+#include <itkImageFileReader.h>
+#include <itkImageFileWriter.h>
+#include <itksys/SystemTools.hxx>
+
+// STD includes
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+
+// System includes
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+# include <io.h>
+# include <process.h>
+#else
+# include <signal.h>
+# include <unistd.h>
+#endif
+
+namespace
+{
+
+//-----------------------------------------------------------------------------
+std::string GetHostName()
+{
+#ifdef _WIN32
+  const char* host = getenv("COMPUTERNAME");
+  return host ? host : "localhost";
+#else
+  char host[256];
+  if (gethostname(host, sizeof(host)) != 0)
+    {
+    return "localhost";
+    }
+  host[sizeof(host) - 1] = '\0';
+  return host;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+long GetProcessId()
+{
+#ifdef _WIN32
+  return static_cast<long>(_getpid());
+#else
+  return static_cast<long>(getpid());
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Return false only if the process is known to be dead.
+bool IsProcessAlive(long pid)
+{
+#ifdef _WIN32
+  (void)pid;
+  return true;
+#else
+  return kill(static_cast<pid_t>(pid), 0) == 0 || errno != ESRCH;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Create the file only if it does not exist, atomically.
+bool CreateFileExclusively(const std::string& fileName,
+                           const std::string& content)
+{
+#ifdef _WIN32
+  int fd = _open(fileName.c_str(), _O_CREAT | _O_EXCL | _O_WRONLY,
+                 _S_IREAD | _S_IWRITE);
+#else
+  int fd = open(fileName.c_str(), O_CREAT | O_EXCL | O_WRONLY, 0644);
+#endif
+  if (fd < 0)
+    {
+    return false;
+    }
+#ifdef _WIN32
+  _write(fd, content.c_str(), static_cast<unsigned int>(content.size()));
+  _close(fd);
+#else
+  ssize_t written = write(fd, content.c_str(), content.size());
+  (void)written;
+  close(fd);
+#endif
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+std::string NumberToString(EdgeType edge)
+{
+  std::stringstream ss;
+  ss << edge;
+  return ss.str();
+}
+
+} // end namespace
+
+//-----------------------------------------------------------------------------
+ArmatureWeightShards::ArmatureWeightShards()
+{
+  std::stringstream owner;
+  owner << GetHostName() << " " << GetProcessId();
+  this->Owner = owner.str();
+  std::stringstream filePrefix;
+  filePrefix << GetHostName() << "_" << GetProcessId() << "_";
+  this->FilePrefix = filePrefix.str();
+  this->LeaseDuration = 600.;
+  this->Threader = itk::MultiThreader::New();
+  this->RenewalThreadId = -1;
+}
+
+//-----------------------------------------------------------------------------
+ArmatureWeightShards::~ArmatureWeightShards()
+{
+  this->StopLeaseRenewal();
+  std::map<std::string, bool>::iterator it;
+  for (it = this->Leases.begin(); it != this->Leases.end(); ++it)
+    {
+    itksys::SystemTools::RemoveFile(it->first.c_str());
+    }
+}
+
+//-----------------------------------------------------------------------------
+bool ArmatureWeightShards::Initialize(const std::string& weightDirectory)
+{
+  this->ShardDirectory = weightDirectory + "/Shards";
+  if (!itksys::SystemTools::MakeDirectory(this->ShardDirectory.c_str()))
+    {
+    std::cerr << "Could not create the shard directory: "
+              << this->ShardDirectory << std::endl;
+    return false;
+    }
+  this->StartLeaseRenewal();
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+std::string ArmatureWeightShards::GetShardDirectory() const
+{
+  return this->ShardDirectory;
+}
+
+//-----------------------------------------------------------------------------
+void ArmatureWeightShards::SetLeaseDuration(double seconds)
+{
+  this->LeaseDuration = seconds;
+}
+
+//-----------------------------------------------------------------------------
+double ArmatureWeightShards::GetLeaseDuration() const
+{
+  return this->LeaseDuration;
+}
+
+//-----------------------------------------------------------------------------
+std::string ArmatureWeightShards::GetLockFileName(const std::string& name) const
+{
+  return this->ShardDirectory + "/" + name + ".lock";
+}
+
+//-----------------------------------------------------------------------------
+std::string ArmatureWeightShards
+::GetPartitionFileName(const std::string& name) const
+{
+  return this->ShardDirectory + "/" + name + ".mha";
+}
+
+//-----------------------------------------------------------------------------
+ArmatureWeightShards::PartitionsStatusType ArmatureWeightShards
+::AcquirePartitions(const std::string& signature, const unsigned char* abort)
+{
+  const std::string signatureFileName =
+    this->ShardDirectory + "/Partitions.txt";
+  const std::string lockFileName = this->GetLockFileName("Partitions");
+  while (!abort || !*abort)
+    {
+    // The signature is written last, it flags the partitions as cached.
+    if (itksys::SystemTools::FileExists(signatureFileName.c_str(), true))
+      {
+      std::ifstream signatureFile(signatureFileName.c_str());
+      std::stringstream cachedSignature;
+      cachedSignature << signatureFile.rdbuf();
+      if (cachedSignature.str() != signature)
+        {
+        std::cerr << "The partitions cached in " << this->ShardDirectory
+                  << " were computed with different inputs or parameters:"
+                  << std::endl << cachedSignature.str() << std::endl
+                  << "Remove the shard directory to start over." << std::endl;
+        return ArmatureWeightShards::PartitionsFailed;
+        }
+      std::cout << "Use cached partitions from " << this->ShardDirectory
+                << std::endl;
+      return ArmatureWeightShards::PartitionsCached;
+      }
+    if (this->CreateLock(lockFileName))
+      {
+      std::ofstream signatureFile(
+        (this->ShardDirectory + "/Partitions.txt.part").c_str());
+      signatureFile << signature;
+      return ArmatureWeightShards::PartitionsClaimed;
+      }
+    std::cout << "Wait for another process to compute the partitions..."
+              << std::endl;
+    itksys::SystemTools::Delay(1000);
+    }
+  return ArmatureWeightShards::PartitionsFailed;
+}
+
+//-----------------------------------------------------------------------------
+bool ArmatureWeightShards::WritePartition(LabelImageType* partition,
+                                          const std::string& name)
+{
+  // Write aside first so other processes never read a partial image.
+  std::string partialFileName =
+    this->ShardDirectory + "/" + this->FilePrefix + name + ".mha";
+  typedef itk::ImageFileWriter<LabelImageType> WriterType;
+  WriterType::Pointer writer = WriterType::New();
+  writer->SetFileName(partialFileName);
+  writer->SetInput(partition);
+  writer->SetUseCompression(1);
+  try
+    {
+    writer->Update();
+    }
+  catch (itk::ExceptionObject& e)
+    {
+    std::cerr << "Could not cache partition " << name << ": " << e << std::endl;
+    return false;
+    }
+  return std::rename(partialFileName.c_str(),
+                     this->GetPartitionFileName(name).c_str()) == 0;
+}
+
+//-----------------------------------------------------------------------------
+bool ArmatureWeightShards::StorePartitions(LabelImageType* bodyPartition,
+                                           LabelImageType* bonesPartition)
+{
+  const std::string lockFileName = this->GetLockFileName("Partitions");
+  bool res = this->WritePartition(bodyPartition, "DilatedBodyPartition")
+    && this->WritePartition(bonesPartition, "BonesPartition")
+    && std::rename((this->ShardDirectory + "/Partitions.txt.part").c_str(),
+                   (this->ShardDirectory + "/Partitions.txt").c_str()) == 0;
+  if (!res)
+    {
+    std::cerr << "Could not cache the partitions in "
+              << this->ShardDirectory << std::endl;
+    }
+  this->RemoveLock(lockFileName);
+  return res;
+}
+
+//-----------------------------------------------------------------------------
+LabelImageType::Pointer ArmatureWeightShards::ReadBodyPartition() const
+{
+  typedef itk::ImageFileReader<LabelImageType> ReaderType;
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName(this->GetPartitionFileName("DilatedBodyPartition"));
+  reader->Update();
+  return reader->GetOutput();
+}
+
+//-----------------------------------------------------------------------------
+LabelImageType::Pointer ArmatureWeightShards::ReadBonesPartition() const
+{
+  typedef itk::ImageFileReader<LabelImageType> ReaderType;
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName(this->GetPartitionFileName("BonesPartition"));
+  reader->Update();
+  return reader->GetOutput();
+}
+
+//-----------------------------------------------------------------------------
+bool ArmatureWeightShards::IsEdgeDone(const std::string& weightFileName) const
+{
+  return itksys::SystemTools::FileExists(weightFileName.c_str(), true);
+}
+
+//-----------------------------------------------------------------------------
+bool ArmatureWeightShards::ClaimEdge(EdgeType edge,
+                                     const std::string& weightFileName)
+{
+  if (!this->CreateLock(this->GetLockFileName("weight_" + NumberToString(edge))))
+    {
+    return false;
+    }
+  // The edge might have been committed between the check and the claim.
+  if (this->IsEdgeDone(weightFileName))
+    {
+    this->RemoveLock(this->GetLockFileName("weight_" + NumberToString(edge)));
+    return false;
+    }
+  this->Mutex.Lock();
+  this->WeightFileNames[edge] = weightFileName;
+  this->Mutex.Unlock();
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+std::string ArmatureWeightShards::GetPartialFileName(EdgeType edge)
+{
+  this->Mutex.Lock();
+  std::string weightFileName = this->WeightFileNames[edge];
+  this->Mutex.Unlock();
+  return this->ShardDirectory + "/" + this->FilePrefix
+    + itksys::SystemTools::GetFilenameName(weightFileName);
+}
+
+//-----------------------------------------------------------------------------
+bool ArmatureWeightShards::CommitEdge(EdgeType edge)
+{
+  std::string partialFileName = this->GetPartialFileName(edge);
+  this->Mutex.Lock();
+  std::string weightFileName = this->WeightFileNames[edge];
+  this->Mutex.Unlock();
+
+  bool res = std::rename(partialFileName.c_str(), weightFileName.c_str()) == 0;
+  if (!res)
+    {
+    std::cerr << "Could not move " << partialFileName << " to "
+              << weightFileName << std::endl;
+    }
+  this->ReleaseEdge(edge);
+  return res;
+}
+
+//-----------------------------------------------------------------------------
+void ArmatureWeightShards::ReleaseEdge(EdgeType edge)
+{
+  this->RemoveLock(this->GetLockFileName("weight_" + NumberToString(edge)));
+  this->Mutex.Lock();
+  this->WeightFileNames.erase(edge);
+  this->Mutex.Unlock();
+}
+
+//-----------------------------------------------------------------------------
+bool ArmatureWeightShards::ClaimPacking()
+{
+  return this->CreateLock(this->GetLockFileName("Packing"));
+}
+
+//-----------------------------------------------------------------------------
+void ArmatureWeightShards::ReleasePacking()
+{
+  this->RemoveLock(this->GetLockFileName("Packing"));
+}
+
+//-----------------------------------------------------------------------------
+bool ArmatureWeightShards::CreateLock(const std::string& lockFileName)
+{
+  if (!CreateFileExclusively(lockFileName, this->Owner))
+    {
+    if (!this->IsLockStale(lockFileName))
+      {
+      return false;
+      }
+    std::cout << "Reclaim stale lock " << lockFileName << std::endl;
+    itksys::SystemTools::RemoveFile(lockFileName.c_str());
+    if (!CreateFileExclusively(lockFileName, this->Owner))
+      {
+      return false;
+      }
+    }
+  this->Mutex.Lock();
+  this->Leases[lockFileName] = true;
+  this->Mutex.Unlock();
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+bool ArmatureWeightShards::IsLockStale(const std::string& lockFileName) const
+{
+  long modifiedTime = itksys::SystemTools::ModifiedTime(lockFileName.c_str());
+  if (modifiedTime == 0)
+    {
+    // The lock has been released in the meantime.
+    return true;
+    }
+  if (difftime(time(0), static_cast<time_t>(modifiedTime)) > this->LeaseDuration)
+    {
+    return true;
+    }
+  // Faster than waiting for the lease to expire when the process was
+  // interrupted on this host.
+  std::ifstream lockFile(lockFileName.c_str());
+  std::string host;
+  long pid = -1;
+  lockFile >> host >> pid;
+  return host == GetHostName() && pid >= 0 && pid != GetProcessId()
+    && !IsProcessAlive(pid);
+}
+
+//-----------------------------------------------------------------------------
+void ArmatureWeightShards::RemoveLock(const std::string& lockFileName)
+{
+  this->Mutex.Lock();
+  this->Leases.erase(lockFileName);
+  this->Mutex.Unlock();
+  itksys::SystemTools::RemoveFile(lockFileName.c_str());
+}
+
+//-----------------------------------------------------------------------------
+void ArmatureWeightShards::StartLeaseRenewal()
+{
+  if (this->RenewalThreadId >= 0)
+    {
+    return;
+    }
+  this->RenewalThreadId = this->Threader->SpawnThread(
+    &ArmatureWeightShards::RenewLeases, this);
+}
+
+//-----------------------------------------------------------------------------
+void ArmatureWeightShards::StopLeaseRenewal()
+{
+  if (this->RenewalThreadId < 0)
+    {
+    return;
+    }
+  this->Threader->TerminateThread(this->RenewalThreadId);
+  this->RenewalThreadId = -1;
+}
+
+//-----------------------------------------------------------------------------
+ITK_THREAD_RETURN_TYPE ArmatureWeightShards::RenewLeases(void* arg)
+{
+  typedef itk::MultiThreader::ThreadInfoStruct  ThreadInfoType;
+  ThreadInfoType* infoStruct = reinterpret_cast< ThreadInfoType* >( arg );
+  ArmatureWeightShards* self =
+    reinterpret_cast< ArmatureWeightShards* >( infoStruct->UserData );
+
+  // Renew 4 times per lease.
+  const double renewalPeriod = self->LeaseDuration / 4.;
+  time_t lastRenewal = time(0);
+  while (true)
+    {
+    infoStruct->ActiveFlagLock->Lock();
+    int active = *infoStruct->ActiveFlag;
+    infoStruct->ActiveFlagLock->Unlock();
+    if (!active)
+      {
+      break;
+      }
+    if (difftime(time(0), lastRenewal) >= renewalPeriod)
+      {
+      self->Mutex.Lock();
+      std::map<std::string, bool>::iterator it;
+      for (it = self->Leases.begin(); it != self->Leases.end(); ++it)
+        {
+        itksys::SystemTools::Touch(it->first.c_str(), false);
+        }
+      self->Mutex.Unlock();
+      lastRenewal = time(0);
+      }
+    itksys::SystemTools::Delay(200);
+    }
+  return ITK_THREAD_RETURN_VALUE;
+}
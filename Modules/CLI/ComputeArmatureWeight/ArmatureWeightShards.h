@@ -0,0 +1,142 @@
+/*=========================================================================
+
+  Program: Bender
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+#ifndef __ArmatureWeightShards_h
+#define __ArmatureWeightShards_h
+
+// .NAME ArmatureWeightShards - Share the weight computation between processes
+// .SECTION General Description
+// Coordinates several ComputeArmatureWeight processes that write in the same
+// weight directory. Everything is done through files in a "Shards"
+// subdirectory of the weight directory:
+//  - the dilated body partition and the bones partition are computed once by
+//  the first process and cached for the others.
+//  - each edge is claimed by creating a lock file. The lock is a lease
+//  renewed by a background thread as long as the process is alive. A lock
+//  whose lease expired (or whose process died on the same host) is reclaimed.
+//  - weights are written in the shard directory first and moved to the weight
+//  directory once complete, an existing weight file means the edge is done.
+//  - the weights are packed by the process that finds all the edges done,
+//  under a lock so that only one process packs.
+// Two processes may compute the same edge if they reclaim the same stale
+// lock at the same time. This only wastes time: the weight file is replaced
+// atomically.
+
+// ComputeArmatureWeight includes
+#include "ArmatureWeightWriter.h"
+
+// ITK includes
+#include <itkMultiThreader.h>
+#include <itkSimpleFastMutexLock.h>
+
+// STD includes
+#include <map>
+#include <string>
+
+//-------------------------------------------------------------------------------
+class ArmatureWeightShards
+{
+public:
+  ArmatureWeightShards();
+  ~ArmatureWeightShards();
+
+  // Create the shard directory in the weight directory.
+  bool Initialize(const std::string& weightDirectory);
+  std::string GetShardDirectory() const;
+
+  // Duration (in seconds) after which a lock that is not renewed is
+  // considered stale. 600s by default.
+  void SetLeaseDuration(double seconds);
+  double GetLeaseDuration() const;
+
+  // Enum the status of the partitions returned by AcquirePartitions().
+  enum PartitionsStatusType
+    {
+    PartitionsFailed = 0,
+    PartitionsCached,
+    PartitionsClaimed
+    };
+
+  // Wait until the partitions are cached by another process or until they
+  // are claimed by this process. In the latter case, StorePartitions() must
+  // be called. The signature describes the inputs and parameters used to
+  // compute the partitions, a cache computed with a different signature
+  // is an error.
+  PartitionsStatusType AcquirePartitions(const std::string& signature,
+                                         const unsigned char* abort = 0);
+  bool StorePartitions(LabelImageType* bodyPartition,
+                       LabelImageType* bonesPartition);
+  LabelImageType::Pointer ReadBodyPartition() const;
+  LabelImageType::Pointer ReadBonesPartition() const;
+
+  // Return true if the final weight file of an edge exists.
+  bool IsEdgeDone(const std::string& weightFileName) const;
+
+  // Try to claim the edge. Return true if this process owns the edge and
+  // should compute its weight in GetPartialFileName(edge).
+  bool ClaimEdge(EdgeType edge, const std::string& weightFileName);
+  std::string GetPartialFileName(EdgeType edge);
+
+  // Move the partial weight file to its final place and release the lock.
+  bool CommitEdge(EdgeType edge);
+  // Release the lock without committing, the edge can be claimed again.
+  void ReleaseEdge(EdgeType edge);
+
+  // Try to claim the packing of the weights once all the edges are done.
+  // Only one process packs at a time.
+  bool ClaimPacking();
+  void ReleasePacking();
+
+private:
+  ArmatureWeightShards(const ArmatureWeightShards&);  //Not implemented
+  void operator=(const ArmatureWeightShards&);  //Not implemented
+
+  std::string GetLockFileName(const std::string& name) const;
+  std::string GetPartitionFileName(const std::string& name) const;
+
+  // Atomically create the lock file, reclaim it if it is stale.
+  bool CreateLock(const std::string& lockFileName);
+  bool IsLockStale(const std::string& lockFileName) const;
+  void RemoveLock(const std::string& lockFileName);
+
+  bool WritePartition(LabelImageType* partition, const std::string& name);
+
+  void StartLeaseRenewal();
+  void StopLeaseRenewal();
+  static ITK_THREAD_RETURN_TYPE RenewLeases(void* arg);
+
+  std::string ShardDirectory;
+  // "host pid" written in the locks
+  std::string Owner;
+  // Prefix of the files written aside by this process
+  std::string FilePrefix;
+  double LeaseDuration;
+
+  // Locks owned by this process, by lock file name.
+  std::map<std::string, bool> Leases;
+  // Final weight file names, by edge
+  std::map<EdgeType, std::string> WeightFileNames;
+  itk::SimpleFastMutexLock Mutex;
+
+  itk::MultiThreader::Pointer Threader;
+  int RenewalThreadId;
+};
+
+#endif
@@ -298,6 +298,7 @@ ArmatureWeightWriter::ArmatureWeightWriter()
 {
   // Input images and polydata
   this->Armature = 0;
+  this->ArmatureTopology = 0;
   this->BodyPartition = 0;
   this->BonesPartition = 0;
   this->Id = 0;
@@ -349,11 +350,39 @@ void ArmatureWeightWriter::SetArmature(vtkPolyData* arm)
     this->Armature->Delete();
     }
   this->Armature = arm;
+  this->OwnArmatureTopology = bender::ArmatureTopology();
   this->Modified();
 }
 
 //-----------------------------------------------------------------------------
-void ArmatureWeightWriter::SetBodyPartition(CharImageType::Pointer partition)
+void ArmatureWeightWriter
+::SetArmatureTopology(const bender::ArmatureTopology* topology)
+{
+  if (topology == this->ArmatureTopology)
+    {
+    return;
+    }
+  this->ArmatureTopology = topology;
+  this->Modified();
+}
+
+//-----------------------------------------------------------------------------
+const bender::ArmatureTopology* ArmatureWeightWriter
+::GetArmatureTopology() const
+{
+  if (this->ArmatureTopology)
+    {
+    return this->ArmatureTopology;
+    }
+  if (this->OwnArmatureTopology.IsEmpty() && this->Armature)
+    {
+    this->OwnArmatureTopology.SetArmature(this->Armature);
+    }
+  return &this->OwnArmatureTopology;
+}
+
+//-----------------------------------------------------------------------------
+void ArmatureWeightWriter::SetBodyPartition(LabelImageType::Pointer partition)
 {
   if (this->BodyPartition == partition)
     {
@@ -365,13 +394,13 @@ void ArmatureWeightWriter::SetBodyPartition(CharImageType::Pointer partition)
 }
 
 //-----------------------------------------------------------------------------
-CharImageType::Pointer ArmatureWeightWriter::GetBodyPartition()
+LabelImageType::Pointer ArmatureWeightWriter::GetBodyPartition()
 {
   return this->BodyPartition;
 }
 
 //-----------------------------------------------------------------------------
-void ArmatureWeightWriter::SetBones(CharImageType::Pointer bones)
+void ArmatureWeightWriter::SetBones(LabelImageType::Pointer bones)
 {
   if (this->BonesPartition == bones)
     {
@@ -383,7 +412,7 @@ void ArmatureWeightWriter::SetBones(CharImageType::Pointer bones)
 }
 
 //-----------------------------------------------------------------------------
-CharImageType::Pointer ArmatureWeightWriter::GetBones()
+LabelImageType::Pointer ArmatureWeightWriter::GetBones()
 {
   return this->BonesPartition;
 }
@@ -443,7 +472,7 @@ EdgeType ArmatureWeightWriter::GetId()const
 }
 
 //-----------------------------------------------------------------------------
-EdgeType ArmatureWeightWriter::GetId(CharType label) const
+EdgeType ArmatureWeightWriter::GetId(LabelType label) const
 {
   return static_cast<EdgeType>(label - ArmatureWeightWriter::EdgeLabels);
 }
@@ -461,10 +490,10 @@ bool ArmatureWeightWriter::Write()
   // Only downsample when not using weights
   bool downsample = !this->BinaryWeight && this->ScaleFactor != 1.0;
 
-  const CharImageType::SizeType& inputSize =
+  const LabelImageType::SizeType& inputSize =
     this->BodyPartition->GetLargestPossibleRegion().GetSize();
-  CharImageType::SizeType outSize;
-  typedef CharImageType::SizeType::SizeValueType SizeValueType;
+  LabelImageType::SizeType outSize;
+  typedef LabelImageType::SizeType::SizeValueType SizeValueType;
   outSize[0] = static_cast<SizeValueType>(inputSize[0] / this->ScaleFactor);
   outSize[1] = static_cast<SizeValueType>(inputSize[1] / this->ScaleFactor);
   outSize[2] = static_cast<SizeValueType>(inputSize[2] / this->ScaleFactor);
@@ -487,8 +516,8 @@ bool ArmatureWeightWriter::Write()
               << " " << outSize[2] << std::endl;
     }
 
-  CharImageType::Pointer downSampledBodyPartition;
-  CharImageType::Pointer downSampledBonesPartition;
+  LabelImageType::Pointer downSampledBodyPartition;
+  LabelImageType::Pointer downSampledBonesPartition;
   if (!downsample)
     {
     downSampledBodyPartition = this->BodyPartition;
@@ -496,21 +525,21 @@ bool ArmatureWeightWriter::Write()
     }
   else
     {
-    downSampledBodyPartition = DownsampleImage<CharImageType>(
+    downSampledBodyPartition = DownsampleImage<LabelImageType>(
       this->BodyPartition, realScaleFactor);
 
-    downSampledBonesPartition = DownsampleImage<CharImageType>(
+    downSampledBonesPartition = DownsampleImage<LabelImageType>(
       this->BonesPartition, realScaleFactor);
     }
 
   if ( downsample && this->GetDebugInfo() )
     {
-    bender::IOUtils::WriteDebugImage<CharImageType>(
+    bender::IOUtils::WriteDebugImage<LabelImageType>(
       downSampledBodyPartition,
       "DownsampledBodyPartition.nrrd",
       this->DebugFolder);
 
-    bender::IOUtils::WriteDebugImage<CharImageType>(
+    bender::IOUtils::WriteDebugImage<LabelImageType>(
       downSampledBonesPartition,
       "DownsampledBonesPartition.nrrd",
       this->DebugFolder);
@@ -567,7 +596,7 @@ bool ArmatureWeightWriter::Write()
 
 //-----------------------------------------------------------------------------
 CharImageType::Pointer ArmatureWeightWriter
-::CreateDomain(const CharImageType* bodyPartition)
+::CreateDomain(const LabelImageType* bodyPartition)
 {
   std::cout<<"Initalizing computation region for edge #"
     << this->Id << std::endl;
@@ -597,15 +626,15 @@ CharImageType::Pointer ArmatureWeightWriter
   double cylinderLength = vtkMath::Normalize(cylinderCenterLine);
 
   CharImageType::Pointer domain = CharImageType::New();
-  Allocate<CharImageType, CharImageType>(bodyPartition, domain);
+  Allocate<LabelImageType, CharImageType>(bodyPartition, domain);
 
   // Expand the region based on the bodypartition
-  CharType edgeLabel = this->GetLabel();
+  LabelType edgeLabel = this->GetLabel();
 
   // Scan through Domain and BodyPartition at the same time. (Same size)
   itk::ImageRegionIteratorWithIndex<CharImageType> domainIt(
     domain, domain->GetLargestPossibleRegion());
-  itk::ImageRegionConstIteratorWithIndex<CharImageType> bodyPartitionIt(
+  itk::ImageRegionConstIteratorWithIndex<LabelImageType> bodyPartitionIt(
     bodyPartition,bodyPartition->GetLargestPossibleRegion());
   for (domainIt.GoToBegin(); !domainIt.IsAtEnd();
     ++domainIt, ++bodyPartitionIt)
@@ -654,8 +683,8 @@ CharImageType::Pointer ArmatureWeightWriter
 //-----------------------------------------------------------------------------
 WeightImageType::Pointer ArmatureWeightWriter
 ::CreateWeight(const CharImageType* domain,
-               const CharImageType* bodyPartition,
-               const CharImageType* bonesPartition)
+               const LabelImageType* bodyPartition,
+               const LabelImageType* bonesPartition)
 {
   if (this->GetDebugInfo())
     {
@@ -665,7 +694,7 @@ WeightImageType::Pointer ArmatureWeightWriter
     }
 
   // Attribute -1.0 to outside of the body, 0 inside.
-  typedef itk::BinaryThresholdImageFilter<CharImageType, WeightImageType>
+  typedef itk::BinaryThresholdImageFilter<LabelImageType, WeightImageType>
     ThresholdFilterType;
   ThresholdFilterType::Pointer threshold = ThresholdFilterType::New();
   threshold->SetInput(bodyPartition);
@@ -701,15 +730,15 @@ WeightImageType::Pointer ArmatureWeightWriter
       this->GetParenthoodDistances(this->GetId());
 
     // Not very efficient but clearer
-    CharImageType::Pointer maskedBodyPartition =
+    LabelImageType::Pointer maskedBodyPartition =
       this->ApplyDistanceMask(bodyPartition, distances);
-    CharImageType::Pointer maskedBonesPartition =
+    LabelImageType::Pointer maskedBonesPartition =
       this->ApplyDistanceMask(bonesPartition, distances);
     if ( this->GetDebugInfo() )
       {
-      bender::IOUtils::WriteDebugImage<CharImageType>(
+      bender::IOUtils::WriteDebugImage<LabelImageType>(
         maskedBodyPartition, "MaskedBodyPartition.nrrd", this->DebugFolder);
-      bender::IOUtils::WriteDebugImage<CharImageType>(
+      bender::IOUtils::WriteDebugImage<LabelImageType>(
         maskedBonesPartition, "MaskedBonesPartition.nrrd", this->DebugFolder);
       }
 
@@ -761,14 +790,14 @@ WeightImageType::Pointer ArmatureWeightWriter
 //-----------------------------------------------------------------------------
 void ArmatureWeightWriter
 ::CleanWeight(WeightImageType* weight,
-              const CharImageType* bodyPartition) const
+              const LabelImageType* bodyPartition) const
 {
   std::vector<unsigned int> distances =
     this->GetParenthoodDistances(this->GetId());
 
   itk::ImageRegionIteratorWithIndex<WeightImageType> weightIt(
     weight, weight->GetLargestPossibleRegion());
-  itk::ImageRegionConstIteratorWithIndex<CharImageType> bodyPartitionIt(
+  itk::ImageRegionConstIteratorWithIndex<LabelImageType> bodyPartitionIt(
     bodyPartition, bodyPartition->GetLargestPossibleRegion());
   for (weightIt.GoToBegin(), bodyPartitionIt.GoToBegin();
     !weightIt.IsAtEnd();
@@ -793,16 +822,16 @@ void ArmatureWeightWriter
 }
 
 //-----------------------------------------------------------------------------
-CharImageType::Pointer ArmatureWeightWriter
-::ApplyDistanceMask(const CharImageType* image,
+LabelImageType::Pointer ArmatureWeightWriter
+::ApplyDistanceMask(const LabelImageType* image,
                     const std::vector<unsigned int>& distances) const
 {
-  CharImageType::Pointer newImage = CharImageType::New();
-  Allocate<CharImageType, CharImageType>(image, newImage);
+  LabelImageType::Pointer newImage = LabelImageType::New();
+  Allocate<LabelImageType, LabelImageType>(image, newImage);
 
-  itk::ImageRegionConstIteratorWithIndex<CharImageType> imageIt(
+  itk::ImageRegionConstIteratorWithIndex<LabelImageType> imageIt(
     image, image->GetLargestPossibleRegion());
-  itk::ImageRegionIteratorWithIndex<CharImageType> newImageIt(
+  itk::ImageRegionIteratorWithIndex<LabelImageType> newImageIt(
     newImage, newImage->GetLargestPossibleRegion());
   for (imageIt.GoToBegin(), newImageIt.GoToBegin();
     !imageIt.IsAtEnd(); ++imageIt, ++newImageIt)
@@ -826,14 +855,14 @@ CharImageType::Pointer ArmatureWeightWriter
 
 //-----------------------------------------------------------------------------
 void ArmatureWeightWriter
-::ApplyDistanceMask(const CharImageType* bodyPartition,
+::ApplyDistanceMask(const LabelImageType* bodyPartition,
                     WeightImageType::Pointer& weight,
                     const std::vector<unsigned int>& distances) const
 {
   // Fill weight image by allowing only "related bone" in weight regions
   itk::ImageRegionIteratorWithIndex<WeightImageType> weightIt(
     weight, weight->GetLargestPossibleRegion());
-  itk::ImageRegionConstIteratorWithIndex<CharImageType> bodyPartitionIt(
+  itk::ImageRegionConstIteratorWithIndex<LabelImageType> bodyPartitionIt(
     bodyPartition, bodyPartition->GetLargestPossibleRegion());
   for (weightIt.GoToBegin(), bodyPartitionIt.GoToBegin();
     !weightIt.IsAtEnd(); ++weightIt, ++bodyPartitionIt)
@@ -853,72 +882,33 @@ std::vector<unsigned int> ArmatureWeightWriter
 ::GetParenthoodDistances(EdgeType boneId) const
 {
   std::vector<unsigned int> distances;
-  vtkIdTypeArray* parenthood = vtkIdTypeArray::SafeDownCast(
-    this->Armature->GetCellData()->GetArray("Parenthood"));
-  if (!parenthood)
+  const bender::ArmatureTopology* topology = this->GetArmatureTopology();
+  if (!topology || topology->IsEmpty())
     {
     return distances; // No parenthood array, assume every bone is related
     }
 
-  //
-  // Use Djikstras to compute distance map
-  //
-
-  // Init edges and distance map
-  std::vector<bool> edges (parenthood->GetNumberOfTuples(), false);
-  distances.resize(parenthood->GetNumberOfTuples(), VTK_INT_MAX);
-  distances[boneId] = 0;
-
-  for (int count = 0; count < parenthood->GetNumberOfTuples(); ++count)
+  const bender::ArmatureTopology::DistanceType* boneDistances =
+    topology->GetDistances(boneId);
+  distances.resize(topology->GetNumberOfBones());
+  for (size_t i = 0; i < distances.size(); ++i)
     {
-    int distance = VTK_INT_MAX;
-    size_t currentId;
-    for (size_t i = 0; i < distances.size(); ++i)
-      {
-      if (distances[i] < distance && edges[i] == false)
-        {
-        distance = distances[i];
-        currentId = i;
-        }
-      }
-    edges[currentId] = true; //visited
-
-    if (distance == VTK_INT_MAX)
-      {
-      std::cerr<<"ERROR:"<<std::endl<<"While computing edge distance map, "
-        "every edge should be accessible !"<<std::endl;
-      break;
-      }
-
-    for (vtkIdType id = 0; id < parenthood->GetNumberOfTuples(); ++id)
-      {
-      int newDistance = VTK_INT_MAX;
-      if (parenthood->GetValue(currentId) == id // ID is currentID parent
-          || parenthood->GetValue(id) == currentId) // ID is currentID child
-        {
-        newDistance = 1 + distance;
-        }
-
-      if (newDistance < distances[id])
-        {
-        distances[id] = newDistance;
-        }
-      }
+    distances[i] =
+      boneDistances[i] == bender::ArmatureTopology::InfiniteDistance ?
+        VTK_INT_MAX : boneDistances[i];
     }
-
   return distances;
 }
 
-
 //-----------------------------------------------------------------------------
-CharType ArmatureWeightWriter::GetLabel() const
+LabelType ArmatureWeightWriter::GetLabel() const
 {
   return this->GetLabel(this->Id);
 }
 
 //-----------------------------------------------------------------------------
-CharType ArmatureWeightWriter::GetLabel(EdgeType id) const
+LabelType ArmatureWeightWriter::GetLabel(EdgeType id) const
 {
   // 0 is background, 1 is body interior so Armature Edge must start with 2
-  return static_cast<CharType>(id + ArmatureWeightWriter::EdgeLabels);
+  return static_cast<LabelType>(id + ArmatureWeightWriter::EdgeLabels);
 }
@@ -36,6 +36,7 @@ class vtkPolyData;
 
 // Bender includes
 #include "HeatDiffusionProblem.h"
+#include <benderArmatureTopology.h>
 
 typedef unsigned char CharType;
 typedef unsigned short LabelType;
@@ -97,11 +98,17 @@ public:
   void SetArmature(vtkPolyData* armature);
   vtkGetObjectMacro(Armature, vtkPolyData);
 
-  void SetBodyPartition(CharImageType::Pointer partition);
-  CharImageType::Pointer GetBodyPartition();
+  // Bone hierarchy of the armature, shared between writers to not
+  // recompute the bone distances for each edge. If not set, it is
+  // computed from the armature.
+  void SetArmatureTopology(const bender::ArmatureTopology* topology);
+  const bender::ArmatureTopology* GetArmatureTopology() const;
 
-  void SetBones(CharImageType::Pointer bones);
-  CharImageType::Pointer GetBones();
+  void SetBodyPartition(LabelImageType::Pointer partition);
+  LabelImageType::Pointer GetBodyPartition();
+
+  void SetBones(LabelImageType::Pointer bones);
+  LabelImageType::Pointer GetBones();
 
   vtkSetMacro(SmoothingIterations, int);
   vtkGetMacro(SmoothingIterations, int);
@@ -142,28 +149,29 @@ protected:
 
   // Input images and polydata
   vtkPolyData* Armature;
-  CharImageType::Pointer BodyPartition;
-  CharImageType::Pointer BonesPartition;
+  const bender::ArmatureTopology* ArmatureTopology;
+  LabelImageType::Pointer BodyPartition;
+  LabelImageType::Pointer BonesPartition;
 
   // Edge Id
   EdgeType Id;
-  CharType GetLabel(EdgeType id) const;
-  CharType GetLabel() const;
-  EdgeType GetId(CharType label) const;
+  LabelType GetLabel(EdgeType id) const;
+  LabelType GetLabel() const;
+  EdgeType GetId(LabelType label) const;
 
   // Create weight domain based on the armature
   // and the given body and bones partitions.
   // The returned image contains 1 (DomainLabel) at each voxel when the Id edge
   // has weight, 0 otherwise.
   // The domain is later used to compute the interpolated and diffused  weights.
-  CharImageType::Pointer CreateDomain(const CharImageType* bodyPartition);
+  CharImageType::Pointer CreateDomain(const LabelImageType* bodyPartition);
 
   // Create weight based on the domain
   // and the given body and bones partitions
   WeightImageType::Pointer CreateWeight(
     const CharImageType* domain,
-    const CharImageType* bodyPartition,
-    const CharImageType* bonesPartition);
+    const LabelImageType* bodyPartition,
+    const LabelImageType* bonesPartition);
 
   // "Mask" resampled image with the body partition
   // All the weight outside the body are marked off to -1.0
@@ -171,24 +179,24 @@ protected:
   // to a bone too far in the family tree are attributed to
   // the proper value (-1.0 for outside and 0.0 inside).
   void CleanWeight(WeightImageType* weight,
-    const CharImageType* bodyPartition) const;
+    const LabelImageType* bodyPartition) const;
 
-  // Uses Djikstra's algorithm to compute the map of distances
-  // between the given edge and all the other edges.
+  // Return the map of distances between the given edge and all the
+  // other edges, read from the armature topology.
   std::vector<unsigned int> GetParenthoodDistances(EdgeType boneID) const;
 
   // Creates a copy of the input image and restricts it to the
   // area within the maximum parenthood distance.
   // Any point outside this distance is assigned the BackgroundLabel
   // value. This basically acts as a custom mask filter.
-  CharImageType::Pointer ApplyDistanceMask(
-    const CharImageType* image,
+  LabelImageType::Pointer ApplyDistanceMask(
+    const LabelImageType* image,
     const std::vector<unsigned int>& distances) const;
 
   // Using the given weight image, restricts it to the area within the
   // maximum parenthood distance.
   // Any point outside this distance is assigned to -1.0f value.
-  void ApplyDistanceMask(const CharImageType* bodyPartition,
+  void ApplyDistanceMask(const LabelImageType* bodyPartition,
      WeightImageType::Pointer& weight,
      const std::vector<unsigned int>& distances) const;
 
@@ -213,6 +221,8 @@ private:
 
   CharImageType::Pointer Domain;
   RegionType ROI;
+  // Topology computed from the armature if none is set.
+  mutable bender::ArmatureTopology OwnArmatureTopology;
 };
 
 //-------------------------------------------------------------------------------
@@ -220,7 +230,7 @@ class LocalizedBodyHeatDiffusionProblem: public HeatDiffusionProblem<3>
 {
 public:
   LocalizedBodyHeatDiffusionProblem(const CharImageType* domain,
-                                    const CharImageType* sourceMap,
+                                    const LabelImageType* sourceMap,
                                     LabelType hotSourceLabel)
     :Domain(domain),
     SourceMap(sourceMap),
@@ -249,7 +259,7 @@ public:
 
 private:
   CharImageType::ConstPointer Domain;   //a binary image that describes the domain
-  CharImageType::ConstPointer SourceMap; //a label image that defines the heat sources
+  LabelImageType::ConstPointer SourceMap; //a label image that defines the heat sources
   LabelType HotSourceLabel; //any source voxel with this label will be assigned weight 1
 
   RegionType WholeDomain;
@@ -260,7 +270,7 @@ class GlobalBodyHeatDiffusionProblem: public HeatDiffusionProblem<3>
 {
 public:
   GlobalBodyHeatDiffusionProblem(
-    const CharImageType* body, const CharImageType* bones)
+    const LabelImageType* body, const LabelImageType* bones)
       :Body(body),Bones(bones)
   {
   }
@@ -284,8 +294,8 @@ public:
     }
 
 private:
-  CharImageType::ConstPointer Body;
-  CharImageType::ConstPointer Bones;
+  LabelImageType::ConstPointer Body;
+  LabelImageType::ConstPointer Bones;
 };
 
 #endif
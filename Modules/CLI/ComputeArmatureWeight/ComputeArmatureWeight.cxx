@@ -22,9 +22,13 @@
 
 // Bender includes
 #include "ComputeArmatureWeightCLP.h"
+#include "ArmatureGeodesicWeights.h"
+#include "ArmatureWeightShards.h"
 #include "ArmatureWeightThreader.h"
 #include "ArmatureWeightWriter.h"
+#include <benderArmatureTopology.h>
 #include <benderIOUtils.h>
+#include <benderWeightMapIO.h>
 
 // ITK includes
 #include <itkBinaryBallStructuringElement.h>
@@ -52,7 +56,6 @@
 #include <vtkSmartPointer.h>
 
 typedef itk::Image<unsigned short, 3>  LabelImageType;
-typedef itk::Image<unsigned char, 3>  CharImageType;
 
 typedef itk::Image<WeightImagePixelType, 3>  WeightImageType;
 
@@ -155,6 +158,8 @@ template <class ImageType> int ExpandForegroundOnce(
 
 //-------------------------------------------------------------------------------
 static ArmatureWeightThreader ThreadHandler;
+// Only set when the computation is shared with other processes.
+static ArmatureWeightShards* Shards = 0;
 
 //-------------------------------------------------------------------------------
 ITK_THREAD_RETURN_TYPE ThreaderCallback(void* arg)
@@ -175,11 +180,22 @@ ITK_THREAD_RETURN_TYPE ThreaderCallback(void* arg)
   // Compute weight
   if (! writer->Write())
     {
+    if (Shards)
+      {
+      Shards->ReleaseEdge(writer->GetId());
+      }
     writer->Delete();
     ThreadHandler.Fail(infoStruct->ThreadID,
       "There was a problem while trying to write the weight. Stopping.");
     return ITK_THREAD_RETURN_VALUE;
     }
+  if (Shards && !Shards->CommitEdge(writer->GetId()))
+    {
+    writer->Delete();
+    ThreadHandler.Fail(infoStruct->ThreadID,
+      "There was a problem while trying to commit the weight. Stopping.");
+    return ITK_THREAD_RETURN_VALUE;
+    }
 
   writer->Delete();
   ThreadHandler.Success(infoStruct->ThreadID);
@@ -228,7 +244,7 @@ int main( int argc, char * argv[] )
   //----------------------------
   // Read label map
   //----------------------------
-  typedef itk::ImageFileReader<CharImageType> BodyPartitionReaderType;
+  typedef itk::ImageFileReader<LabelImageType> BodyPartitionReaderType;
   BodyPartitionReaderType::Pointer bodyPartitionReader =
     BodyPartitionReaderType::New();
   bodyPartitionReader->SetFileName(SkinnedVolume.c_str());
@@ -270,6 +286,10 @@ int main( int argc, char * argv[] )
     return EXIT_FAILURE;
     }
 
+  // Bone distances shared by all the edges
+  bender::ArmatureTopology armatureTopology;
+  armatureTopology.SetArmature(armaturePolyData);
+
   //----------------------------
   // Get some statistics
   //----------------------------
@@ -279,7 +299,7 @@ int main( int argc, char * argv[] )
   // \todo Be able to process non-continous arrays of lables [1, 3, 4 ...]
   // \todo Define backgound and unknow label values
 
-  typedef itk::StatisticsImageFilter<CharImageType> StatisticsType;
+  typedef itk::StatisticsImageFilter<LabelImageType> StatisticsType;
   StatisticsType::Pointer statistics = StatisticsType::New();
   itk::PluginFilterWatcher watchStatistics(statistics,
                                        "Get Statistics",
@@ -295,51 +315,104 @@ int main( int argc, char * argv[] )
   bender::IOUtils::FilterEnd("Read inputs");
 
   //--------------------------------------------
-  // Dilate the body partition
+  // Share the computation with other processes
   //--------------------------------------------
-
-  bender::IOUtils::FilterStart("Dilate body partition");
-
-  CharImageType::Pointer dilatedBodyPartition =
-    bodyPartitionReader->GetOutput();
-  bender::IOUtils::FilterProgress("Dilate body partition", 0.25, 1.0, 0.0);
-
-  int numPaddedVoxels =0;
-  for(int i = 0; i < Padding; i++)
+  ArmatureWeightShards shards;
+  bool computePartitions = true;
+  if (Shard)
     {
-    numPaddedVoxels += ExpandForegroundOnce<CharImageType>(
-      dilatedBodyPartition,
-      BackgroundValue);
-    std::cout<<"Padded "<<numPaddedVoxels<<" voxels"<<std::endl;
-
-    bender::IOUtils::FilterProgress(
-      "Dilate body partition", 0.75, 1.0 / Padding, 0.25);
+    shards.SetLeaseDuration(LeaseDuration);
+    if (!shards.Initialize(WeightDirectory))
+      {
+      return EXIT_FAILURE;
+      }
+    Shards = &shards;
+
+    std::stringstream signature;
+    signature << "RestLabelmap: " << RestLabelmap << "\n"
+              << "SkinnedVolume: " << SkinnedVolume << "\n"
+              << "BackgroundValue: " << BackgroundValue << "\n"
+              << "BoneLabel: " << BoneLabel << "\n"
+              << "Padding: " << Padding << "\n";
+    ArmatureWeightShards::PartitionsStatusType status =
+      shards.AcquirePartitions(signature.str(),
+        CLPProcessInformation ? &CLPProcessInformation->Abort : 0);
+    if (status == ArmatureWeightShards::PartitionsFailed)
+      {
+      return EXIT_FAILURE;
+      }
+    computePartitions = (status == ArmatureWeightShards::PartitionsClaimed);
     }
 
-  if (Debug)
+  LabelImageType::Pointer dilatedBodyPartition;
+  LabelImageType::Pointer bonesPartition;
+  if (!computePartitions)
     {
-    bender::IOUtils::WriteDebugImage<CharImageType>(
-      dilatedBodyPartition, "DilatedBodyPartition.mha", debugDir);
+    try
+      {
+      dilatedBodyPartition = shards.ReadBodyPartition();
+      bonesPartition = shards.ReadBonesPartition();
+      }
+    catch (itk::ExceptionObject &e)
+      {
+      std::cerr<<"Could not read cached partitions, got error: "<<std::endl;
+      e.Print(std::cout);
+      return EXIT_FAILURE;
+      }
     }
+  else
+    {
+    //--------------------------------------------
+    // Dilate the body partition
+    //--------------------------------------------
 
-  bender::IOUtils::FilterEnd("Dilate body partition");
+    bender::IOUtils::FilterStart("Dilate body partition");
 
-  //--------------------------------------------
-  // Compute the bone partition
-  //--------------------------------------------
+    dilatedBodyPartition = bodyPartitionReader->GetOutput();
+    bender::IOUtils::FilterProgress("Dilate body partition", 0.25, 1.0, 0.0);
 
-  bender::IOUtils::FilterStart("Compute Bones Partition");
+    int numPaddedVoxels =0;
+    for(int i = 0; i < Padding; i++)
+      {
+      numPaddedVoxels += ExpandForegroundOnce<LabelImageType>(
+        dilatedBodyPartition,
+        BackgroundValue);
+      std::cout<<"Padded "<<numPaddedVoxels<<" voxels"<<std::endl;
 
-  CharImageType::Pointer bonesPartition =
-    SimpleBoneSegmentation<LabelImageType, CharImageType>(
-      bodyReader->GetOutput(), dilatedBodyPartition, BoneLabel);
-  if (Debug)
-    {
-    bender::IOUtils::WriteDebugImage<CharImageType>(
-      bonesPartition, "BonesPartition.mha", debugDir);
-    }
+      bender::IOUtils::FilterProgress(
+        "Dilate body partition", 0.75, 1.0 / Padding, 0.25);
+      }
+
+    if (Debug)
+      {
+      bender::IOUtils::WriteDebugImage<LabelImageType>(
+        dilatedBodyPartition, "DilatedBodyPartition.mha", debugDir);
+      }
+
+    bender::IOUtils::FilterEnd("Dilate body partition");
+
+    //--------------------------------------------
+    // Compute the bone partition
+    //--------------------------------------------
+
+    bender::IOUtils::FilterStart("Compute Bones Partition");
+
+    bonesPartition =
+      SimpleBoneSegmentation<LabelImageType, LabelImageType>(
+        bodyReader->GetOutput(), dilatedBodyPartition, BoneLabel);
+    if (Debug)
+      {
+      bender::IOUtils::WriteDebugImage<LabelImageType>(
+        bonesPartition, "BonesPartition.mha", debugDir);
+      }
+
+    bender::IOUtils::FilterEnd("Compute Bones Partition");
 
-  bender::IOUtils::FilterEnd("Compute Bones Partition");
+    if (Shard && !shards.StorePartitions(dilatedBodyPartition, bonesPartition))
+      {
+      return EXIT_FAILURE;
+      }
+    }
 
 
   //--------------------------------------------
@@ -356,6 +429,27 @@ int main( int argc, char * argv[] )
 
   int numDigits = NumDigits(maxLabel);
 
+  // All the geodesic weights are computed at once
+  ArmatureGeodesicWeights geodesicWeights;
+  if (Geodesic)
+    {
+    bender::IOUtils::FilterStart("Compute geodesic distances");
+    geodesicWeights.SetKernel(GeodesicKernel == "InverseSquare" ?
+      ArmatureGeodesicWeights::InverseSquareKernel :
+      ArmatureGeodesicWeights::GaussianKernel);
+    geodesicWeights.SetFalloff(GeodesicFalloff);
+    geodesicWeights.SetMaximumNumberOfInfluences(MaximumNumberOfInfluences);
+    geodesicWeights.SetMaximumParenthoodDistance(MaximumParenthoodDistance);
+    geodesicWeights.SetArmatureTopology(&armatureTopology);
+    if (!geodesicWeights.Update(dilatedBodyPartition, bonesPartition,
+          CLPProcessInformation ? &CLPProcessInformation->Abort : 0))
+      {
+      std::cerr << "Could not compute the geodesic distances." << std::endl;
+      return EXIT_FAILURE;
+      }
+    bender::IOUtils::FilterEnd("Compute geodesic distances");
+    }
+
   // Compute the weight of each bones in a separate thread
   std::cout << "Compute from edge #" << FirstEdge << " to edge #" << LastEdge
             << " (Processing in parrallel ? " << !RunSequential<<" )"
@@ -383,17 +477,62 @@ int main( int argc, char * argv[] )
         }
       }
 
+    std::stringstream filename;
+    filename << WeightDirectory << "/weight_"
+      << std::setfill('0') << std::setw(numDigits) << i << ".mha";
+    if (Shard)
+      {
+      if (shards.IsEdgeDone(filename.str()))
+        {
+        std::cout << "Edge #" << i << " is already computed" << std::endl;
+        continue;
+        }
+      if (!shards.ClaimEdge(i, filename.str()))
+        {
+        std::cout << "Edge #" << i << " is computed by another process"
+                  << std::endl;
+        continue;
+        }
+      }
+
+    if (Geodesic)
+      {
+      std::string weightFileName =
+        Shard ? shards.GetPartialFileName(i) : filename.str();
+      try
+        {
+        bender::IOUtils::WriteImage<WeightImageType>(
+          geodesicWeights.GetWeight(i), weightFileName);
+        }
+      catch (itk::ExceptionObject &e)
+        {
+        std::cerr << "There was a problem while trying to write the weight: "
+                  << e << " Stopping" << std::endl;
+        if (Shard)
+          {
+          shards.ReleaseEdge(i);
+          }
+        return EXIT_FAILURE;
+        }
+      if (Shard && !shards.CommitEdge(i))
+        {
+        std::cerr << "Failed to commit the weight of edge #" << i
+                  << ". Stopping" << std::endl;
+        return EXIT_FAILURE;
+        }
+      continue;
+      }
+
     ArmatureWeightWriter* writeWeight = ArmatureWeightWriter::New();
 
     // Inputs
     writeWeight->SetBodyPartition(dilatedBodyPartition);
     writeWeight->SetArmature(armaturePolyData);
+    writeWeight->SetArmatureTopology(&armatureTopology);
     writeWeight->SetBones(bonesPartition);
-    // Output filename
-    std::stringstream filename;
-    filename << WeightDirectory << "/weight_"
-      << std::setfill('0') << std::setw(numDigits) << i << ".mha";
-    writeWeight->SetFilename(filename.str());
+    // Output filename, written aside until complete when sharing
+    writeWeight->SetFilename(
+      Shard ? shards.GetPartialFileName(i) : filename.str());
 
     // Edge Id
     writeWeight->SetId(i);
@@ -420,6 +559,17 @@ int main( int argc, char * argv[] )
         {
         std::cerr<<"There was a problem while trying to write the weight."
           <<" Stopping"<<std::endl;
+        if (Shard)
+          {
+          shards.ReleaseEdge(i);
+          }
+        }
+      else if (Shard && !shards.CommitEdge(i))
+        {
+        std::cerr << "Failed to commit the weight of edge #" << i
+                  << ". Stopping" << std::endl;
+        writeWeight->Delete();
+        return EXIT_FAILURE;
         }
 
       writeWeight->Delete();
@@ -449,5 +599,73 @@ int main( int argc, char * argv[] )
     }
 
   bender::IOUtils::FilterEnd("Compute weights");
+
+  //--------------------------------------------
+  // Pack the weights into a single file
+  //--------------------------------------------
+  if (PackWeights)
+    {
+    bender::IOUtils::FilterStart("Pack weights");
+
+    // Only pack a complete set of weights, the packed weights would otherwise
+    // be out of date as soon as the missing weights are computed.
+    std::vector<std::string> fnames;
+    for (int i = 0; i <= static_cast<int>(maxLabel) - 2; ++i)
+      {
+      std::stringstream filename;
+      filename << WeightDirectory << "/weight_"
+        << std::setfill('0') << std::setw(numDigits) << i << ".mha";
+      if (!itksys::SystemTools::FileExists(filename.str().c_str(), true))
+        {
+        std::cout << "Edge #" << i << " has no weight, the weights are not"
+                  << " packed." << std::endl;
+        fnames.clear();
+        break;
+        }
+      fnames.push_back(filename.str());
+      }
+
+    // When sharing, the weights are complete once the last process is done:
+    // the processes finishing earlier find missing weights. The first
+    // process to claim the packing packs, the others skip it.
+    bool pack = !fnames.empty();
+    const std::string packedFileName =
+      bender::GetPackedWeightFileName(WeightDirectory);
+    if (pack && Shard)
+      {
+      pack = shards.ClaimPacking();
+      bender::PackedWeights packedHeader;
+      if (pack && bender::ReadPackedWeights(
+            packedFileName, fnames, packedHeader, true))
+        {
+        std::cout << "The weights are already packed." << std::endl;
+        shards.ReleasePacking();
+        pack = false;
+        }
+      else if (!pack)
+        {
+        std::cout << "The weights are packed by another process." << std::endl;
+        }
+      }
+
+    if (pack)
+      {
+      bender::PackedWeights packedWeights;
+      bool res = bender::PackWeights(fnames, MaximumNumberOfInfluences,
+        packedWeights, CLPProcessInformation ? &CLPProcessInformation->Abort : 0)
+        && bender::WritePackedWeights(packedWeights, packedFileName);
+      if (Shard)
+        {
+        shards.ReleasePacking();
+        }
+      if (!res)
+        {
+        std::cerr << "Could not pack the weights." << std::endl;
+        return EXIT_FAILURE;
+        }
+      }
+
+    bender::IOUtils::FilterEnd("Pack weights");
+    }
   return EXIT_SUCCESS;
 }
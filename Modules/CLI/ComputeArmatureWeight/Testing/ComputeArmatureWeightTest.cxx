@@ -1,5 +1,13 @@
 #include "itkTestMain.h"
 
+// ITK includes
+#include <itksys/Process.h>
+#include <itksys/SystemTools.hxx>
+
+// STD includes
+#include <cstdlib>
+#include <vector>
+
 #ifdef WIN32
 #define MODULE_IMPORT __declspec(dllimport)
 #else
@@ -8,7 +16,61 @@
 
 extern "C" MODULE_IMPORT int ModuleEntryPoint(int, char * []);
 
+//-----------------------------------------------------------------------------
+// Run the module executable in several processes at the same time:
+//   ModuleProcesses <numberOfProcesses> <executable> <module arguments...>
+// The weight directory (4th module argument) is emptied first so that no
+// edge is skipped because of a previous run.
+int ModuleProcesses(int argc, char* argv[])
+{
+  if (argc < 7)
+    {
+    std::cerr << "Usage: " << argv[0] << " <numberOfProcesses> <executable>"
+              << " <restLabelmap> <armature> <skinnedLabelmap>"
+              << " <weightDirectory> [options]" << std::endl;
+    return EXIT_FAILURE;
+    }
+  const int numberOfProcesses = atoi(argv[1]);
+  const std::string weightDirectory = argv[6];
+  itksys::SystemTools::RemoveADirectory(weightDirectory.c_str());
+  if (!itksys::SystemTools::MakeDirectory(weightDirectory.c_str()))
+    {
+    std::cerr << "Can't create " << weightDirectory << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  std::vector<const char*> command(argv + 2, argv + argc);
+  command.push_back(0);
+
+  std::vector<itksysProcess*> processes;
+  for (int i = 0; i < numberOfProcesses; ++i)
+    {
+    itksysProcess* process = itksysProcess_New();
+    itksysProcess_SetCommand(process, &command[0]);
+    itksysProcess_SetPipeShared(process, itksysProcess_Pipe_STDOUT, 1);
+    itksysProcess_SetPipeShared(process, itksysProcess_Pipe_STDERR, 1);
+    itksysProcess_Execute(process);
+    processes.push_back(process);
+    }
+
+  int res = EXIT_SUCCESS;
+  for (size_t i = 0; i < processes.size(); ++i)
+    {
+    itksysProcess_WaitForExit(processes[i], 0);
+    if (itksysProcess_GetState(processes[i]) != itksysProcess_State_Exited
+        || itksysProcess_GetExitValue(processes[i]) != 0)
+      {
+      std::cerr << "Process #" << i << " failed" << std::endl;
+      res = EXIT_FAILURE;
+      }
+    itksysProcess_Delete(processes[i]);
+    }
+  return res;
+}
+
+//-----------------------------------------------------------------------------
 void RegisterTests()
 {
   StringToTestFunctionMap["ModuleEntryPoint"] = ModuleEntryPoint;
+  StringToTestFunctionMap["ModuleProcesses"] = ModuleProcesses;
 }
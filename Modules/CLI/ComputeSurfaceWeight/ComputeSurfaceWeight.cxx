@@ -0,0 +1,419 @@
+/*=========================================================================
+
+  Program: Bender
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+#include "ComputeSurfaceWeightCLP.h"
+
+//------- Bender-----------
+#include "benderIOUtils.h"
+#include "EigenSparseSolve.h"
+
+//--------VTK --------------
+#include <vtkCellArray.h>
+#include <vtkFloatArray.h>
+#include <vtkIdList.h>
+#include <vtkMath.h>
+#include <vtkNew.h>
+#include <vtkOBBTree.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+#include <vtkTransform.h>
+#include <vtkTransformPolyDataFilter.h>
+#include <vtkTriangleFilter.h>
+
+//--------standard-------------
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+typedef Eigen::Triplet<float> Triplet;
+
+//-------------------------------------------------------------------------------
+inline int NumDigits(unsigned int a)
+{
+  int numDigits = 0;
+  while(a>0)
+    {
+    a = a/10;
+    ++numDigits;
+    }
+  return numDigits;
+}
+
+//-------------------------------------------------------------------------------
+struct Segment
+{
+  double A[3];
+  double B[3];
+};
+
+//-------------------------------------------------------------------------------
+// Return the squared distance between x and the segment [a,b].
+// closest is set to the closest point of the segment.
+double SegmentDistance2(const double x[3], const Segment& segment,
+                        double closest[3])
+{
+  double ab[3];
+  double ax[3];
+  vtkMath::Subtract(segment.B, segment.A, ab);
+  vtkMath::Subtract(x, segment.A, ax);
+  double length2 = vtkMath::Dot(ab, ab);
+  double t = length2 > 0. ? vtkMath::Dot(ax, ab) / length2 : 0.;
+  t = std::min(1., std::max(0., t));
+  for (int i = 0; i < 3; ++i)
+    {
+    closest[i] = segment.A[i] + t * ab[i];
+    }
+  return vtkMath::Distance2BetweenPoints(x, closest);
+}
+
+//-------------------------------------------------------------------------------
+// Return true if the segment from the surface vertex x to the point target
+// does not cross the surface. The start of the segment is moved slightly
+// toward the target to not intersect the triangles around x.
+bool IsVisible(vtkOBBTree* surfaceTree, const double x[3],
+               const double target[3], vtkPoints* intersections)
+{
+  double start[3];
+  for (int i = 0; i < 3; ++i)
+    {
+    start[i] = x[i] + 1e-3 * (target[i] - x[i]);
+    }
+  return surfaceTree->IntersectWithLine(
+    start, const_cast<double*>(target), intersections, 0) == 0;
+}
+
+//-------------------------------------------------------------------------------
+// Compute the cotangent stiffness matrix (i.e. minus the cotangent
+// Laplacian) of the triangle mesh and the area associated to each vertex
+// (a third of the area of the triangles around it).
+void ComputeCotangentLaplacian(vtkPolyData* mesh,
+                               std::vector<Triplet>& stiffness,
+                               std::vector<double>& areas)
+{
+  vtkPoints* points = mesh->GetPoints();
+  areas.assign(points->GetNumberOfPoints(), 0.);
+
+  vtkCellArray* triangles = mesh->GetPolys();
+  vtkNew<vtkIdList> cell;
+  triangles->InitTraversal();
+  while(triangles->GetNextCell(cell.GetPointer()))
+    {
+    if (cell->GetNumberOfIds() != 3)
+      {
+      continue;
+      }
+    vtkIdType ids[3] = {cell->GetId(0), cell->GetId(1), cell->GetId(2)};
+    double x[3][3];
+    for (int i = 0; i < 3; ++i)
+      {
+      points->GetPoint(ids[i], x[i]);
+      }
+
+    double e01[3], e02[3], normal[3];
+    vtkMath::Subtract(x[1], x[0], e01);
+    vtkMath::Subtract(x[2], x[0], e02);
+    vtkMath::Cross(e01, e02, normal);
+    double doubleArea = vtkMath::Norm(normal);
+    if (doubleArea <= 0.)
+      {
+      continue; // degenerated triangle
+      }
+    for (int i = 0; i < 3; ++i)
+      {
+      areas[ids[i]] += doubleArea / 6.;
+      }
+
+    // For each corner, the cotangent of its angle weights the opposite edge
+    for (int corner = 0; corner < 3; ++corner)
+      {
+      int i = (corner + 1) % 3;
+      int j = (corner + 2) % 3;
+      double u[3], v[3];
+      vtkMath::Subtract(x[i], x[corner], u);
+      vtkMath::Subtract(x[j], x[corner], v);
+      // |u x v| is the same for the 3 corners
+      float w = static_cast<float>(0.5 * vtkMath::Dot(u, v) / doubleArea);
+      stiffness.push_back(Triplet(ids[i], ids[j], -w));
+      stiffness.push_back(Triplet(ids[j], ids[i], -w));
+      stiffness.push_back(Triplet(ids[i], ids[i], w));
+      stiffness.push_back(Triplet(ids[j], ids[j], w));
+      }
+    }
+}
+
+//-------------------------------------------------------------------------------
+int main( int argc, char * argv[] )
+{
+  PARSE_ARGS;
+
+  //----------------------------
+  // Read inputs
+  //----------------------------
+  bender::IOUtils::FilterStart("Read inputs");
+
+  vtkSmartPointer<vtkPolyData> surface;
+  surface.TakeReference(
+    bender::IOUtils::ReadPolyData(InputSurface.c_str(), !IsSurfaceInRAS));
+  if (!surface)
+    {
+    std::cerr << "Can't read surface " << InputSurface << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  vtkSmartPointer<vtkPolyData> armature;
+  armature.TakeReference(
+    bender::IOUtils::ReadPolyData(ArmaturePoly.c_str(), !IsArmatureInRAS));
+  if (!armature)
+    {
+    std::cerr << "Can't read armature " << ArmaturePoly << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  std::vector<Segment> bones;
+  vtkCellArray* armatureSegments = armature->GetLines();
+  vtkNew<vtkIdList> cell;
+  armatureSegments->InitTraversal();
+  while(armatureSegments->GetNextCell(cell.GetPointer()))
+    {
+    Segment bone;
+    armature->GetPoints()->GetPoint(cell->GetId(0), bone.A);
+    armature->GetPoints()->GetPoint(cell->GetId(1), bone.B);
+    bones.push_back(bone);
+    }
+  const size_t numBones = bones.size();
+  if (numBones < 1)
+    {
+    std::cerr << "No bone found in the armature." << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // The points are kept by the triangle filter, only the cells change.
+  vtkNew<vtkTriangleFilter> triangulator;
+  triangulator->SetInput(surface);
+  triangulator->PassVertsOff();
+  triangulator->PassLinesOff();
+  triangulator->Update();
+  vtkPolyData* mesh = triangulator->GetOutput();
+  const vtkIdType numPoints = mesh->GetNumberOfPoints();
+
+  bender::IOUtils::FilterEnd("Read inputs");
+
+  //----------------------------
+  // Heat the vertices
+  //----------------------------
+  bender::IOUtils::FilterStart("Compute heat sources");
+
+  vtkNew<vtkOBBTree> surfaceTree;
+  surfaceTree->SetDataSet(mesh);
+  surfaceTree->BuildLocator();
+  vtkNew<vtkPoints> intersections;
+
+  // Heat received by each vertex, and the bones it comes from.
+  std::vector<double> heats(numPoints, 0.);
+  std::vector<std::vector<size_t> > heatSources(numPoints);
+  int numUnheated = 0;
+  std::vector<std::pair<double, size_t> > boneDistances(numBones);
+  std::vector<double> closestPoints(3 * numBones);
+  for (vtkIdType pi = 0; pi < numPoints; ++pi)
+    {
+    double x[3];
+    mesh->GetPoint(pi, x);
+    for (size_t bone = 0; bone < numBones; ++bone)
+      {
+      boneDistances[bone] = std::make_pair(
+        SegmentDistance2(x, bones[bone], &closestPoints[3 * bone]), bone);
+      }
+    std::sort(boneDistances.begin(), boneDistances.end());
+
+    // The closest visible bone heats the vertex. Bones at the same
+    // distance share the heat.
+    double minDistance2 = -1.;
+    for (size_t i = 0; i < numBones; ++i)
+      {
+      double distance2 = boneDistances[i].first;
+      if (minDistance2 >= 0. && distance2 > minDistance2 * 1.0002)
+        {
+        break;
+        }
+      size_t bone = boneDistances[i].second;
+      if (!IsVisible(surfaceTree.GetPointer(), x,
+                     &closestPoints[3 * bone], intersections.GetPointer()))
+        {
+        continue;
+        }
+      if (minDistance2 < 0.)
+        {
+        minDistance2 = distance2;
+        }
+      heatSources[pi].push_back(bone);
+      }
+
+    if (heatSources[pi].empty())
+      {
+      ++numUnheated;
+      }
+    else
+      {
+      heats[pi] = HeatConstant /
+        std::max(minDistance2, std::numeric_limits<double>::epsilon());
+      }
+    if (pi % 1000 == 0)
+      {
+      bender::IOUtils::FilterProgress("Compute heat sources",
+        static_cast<float>(pi) / numPoints, 1.0, 0.0);
+      }
+    }
+  if (Debug)
+    {
+    std::cout << numUnheated << " vertices can't see any bone" << std::endl;
+    }
+
+  bender::IOUtils::FilterEnd("Compute heat sources");
+
+  //----------------------------
+  // Solve the bone heat equation
+  //----------------------------
+  bender::IOUtils::FilterStart("Solve heat equation");
+
+  // (-Lcot + Area * H) w_bone = Area * H * p_bone
+  // where p_bone is 1 at the vertices heated by the bone.
+  std::vector<Triplet> triplets;
+  std::vector<double> areas;
+  ComputeCotangentLaplacian(mesh, triplets, areas);
+  for (vtkIdType pi = 0; pi < numPoints; ++pi)
+    {
+    // Isolated or unheated components of the mesh would make the system
+    // singular, a tiny heat loss brings their weights to 0.
+    heats[pi] *= areas[pi];
+    double diagonal = heats[pi] + 1e-8 * std::max(areas[pi], 1.);
+    triplets.push_back(Triplet(pi, pi, static_cast<float>(diagonal)));
+    }
+  std::vector<double>().swap(areas);
+
+  SpMat A(numPoints, numPoints);
+  A.setFromTriplets(triplets.begin(), triplets.end());
+  std::vector<Triplet>().swap(triplets);
+  SparseSolver solver(A);
+
+  // Same names as the weight images of ComputeArmatureWeight.
+  int numDigits = NumDigits(numBones + 1);
+
+  vtkSmartPointer<vtkPolyData> outputSurface =
+    vtkSmartPointer<vtkPolyData>::NewInstance(surface);
+  outputSurface->DeepCopy(surface);
+  vtkPointData* pointData = outputSurface->GetPointData();
+  pointData->Initialize();
+
+  // Solve one bone at a time and write the clamped and thresholded weights
+  // in the output arrays, only the sums are kept to normalize them.
+  std::vector<vtkFloatArray*> outputSurfaceVertexWeights;
+  std::vector<double> sums(numPoints, 0.);
+  Eigen::VectorXf rhs(numPoints);
+  for (size_t bone = 0; bone < numBones; ++bone)
+    {
+    rhs.setZero();
+    for (vtkIdType pi = 0; pi < numPoints; ++pi)
+      {
+      const std::vector<size_t>& sources = heatSources[pi];
+      if (std::find(sources.begin(), sources.end(), bone) != sources.end())
+        {
+        rhs[pi] = static_cast<float>(heats[pi] / sources.size());
+        }
+      }
+    Eigen::VectorXf weights = solver.Solve(rhs);
+
+    std::stringstream name;
+    name << "weight_" << std::setfill('0') << std::setw(numDigits) << bone;
+    vtkFloatArray* arr = vtkFloatArray::New();
+    arr->SetNumberOfComponents(1);
+    arr->SetNumberOfTuples(numPoints);
+    arr->SetName(name.str().c_str());
+    pointData->AddArray(arr);
+    outputSurfaceVertexWeights.push_back(arr);
+    arr->Delete();
+
+    for (vtkIdType pi = 0; pi < numPoints; ++pi)
+      {
+      float w = std::min(1.f, weights[pi]);
+      if (w < MinimumWeight)
+        {
+        w = 0.f;
+        }
+      arr->SetValue(pi, w);
+      sums[pi] += w;
+      }
+
+    bender::IOUtils::FilterProgress("Solve heat equation",
+      static_cast<float>(bone + 1) / numBones, 1.0, 0.0);
+    }
+
+  bender::IOUtils::FilterEnd("Solve heat equation");
+
+  //----------------------------
+  // Write weights
+  //----------------------------
+  bender::IOUtils::FilterStart("Write weights");
+
+  int numZeros = 0;
+  for (vtkIdType pi = 0; pi < numPoints; ++pi)
+    {
+    const double sum = sums[pi];
+    numZeros += sum == 0.;
+    for (size_t bone = 0; bone < numBones; ++bone)
+      {
+      vtkFloatArray* arr = outputSurfaceVertexWeights[bone];
+      arr->SetValue(pi,
+        sum > 0. ? static_cast<float>(arr->GetValue(pi) / sum) : 0.f);
+      }
+    }
+  if (Debug)
+    {
+    std::cout << numZeros << " points have zero weight" << std::endl;
+    }
+
+  if (!IsSurfaceInRAS)
+    {
+    vtkSmartPointer<vtkTransform> transform =
+      vtkSmartPointer<vtkTransform>::New();
+    transform->RotateZ(180.0);
+
+    vtkSmartPointer<vtkTransformPolyDataFilter> transformer =
+      vtkSmartPointer<vtkTransformPolyDataFilter>::New();
+    transformer->SetInput(outputSurface);
+    transformer->SetTransform(transform);
+    transformer->Update();
+
+    bender::IOUtils::WritePolyData(transformer->GetOutput(), OutputSurface);
+    }
+  else
+    {
+    bender::IOUtils::WritePolyData(outputSurface, OutputSurface);
+    }
+
+  bender::IOUtils::FilterEnd("Write weights");
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,246 @@
+/*=========================================================================
+
+  Program: Bender
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+#include "itkTestMain.h"
+
+// Bender includes
+#include "benderIOUtils.h"
+
+// VTK includes
+#include <vtkCellArray.h>
+#include <vtkFloatArray.h>
+#include <vtkMath.h>
+#include <vtkNew.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+
+#ifdef WIN32
+#define MODULE_IMPORT __declspec(dllimport)
+#else
+#define MODULE_IMPORT
+#endif
+
+// This will be linked against the ModuleEntryPoint in ComputeSurfaceWeightLib
+extern "C" MODULE_IMPORT int ModuleEntryPoint(int, char * []);
+
+int ComputeSurfaceWeightTwoBonesTest(int argc, char * argv[]);
+
+void RegisterTests()
+{
+  StringToTestFunctionMap["ModuleEntryPoint"] = ModuleEntryPoint;
+  StringToTestFunctionMap["ComputeSurfaceWeightTwoBonesTest"] =
+    ComputeSurfaceWeightTwoBonesTest;
+}
+
+namespace
+{
+
+const double Length = 20.;
+const double Radius = 2.;
+
+//-----------------------------------------------------------------------------
+// Closed tube along the x axis, from 0 to Length, with capped ends.
+void CreateLimb(vtkPolyData* limb)
+{
+  const int numberOfRings = 41;
+  const int resolution = 16;
+  vtkNew<vtkPoints> points;
+  vtkNew<vtkCellArray> triangles;
+  for (int ring = 0; ring < numberOfRings; ++ring)
+    {
+    const double x = Length * ring / (numberOfRings - 1);
+    for (int i = 0; i < resolution; ++i)
+      {
+      const double angle = 2. * vtkMath::Pi() * i / resolution;
+      points->InsertNextPoint(x, Radius * cos(angle), Radius * sin(angle));
+      }
+    }
+  for (int ring = 0; ring < numberOfRings - 1; ++ring)
+    {
+    for (int i = 0; i < resolution; ++i)
+      {
+      vtkIdType a = ring * resolution + i;
+      vtkIdType b = ring * resolution + (i + 1) % resolution;
+      vtkIdType c = a + resolution;
+      vtkIdType d = b + resolution;
+      vtkIdType triangle1[3] = {a, b, d};
+      vtkIdType triangle2[3] = {a, d, c};
+      triangles->InsertNextCell(3, triangle1);
+      triangles->InsertNextCell(3, triangle2);
+      }
+    }
+  // Caps
+  for (int end = 0; end < 2; ++end)
+    {
+    vtkIdType center = points->InsertNextPoint(end * Length, 0., 0.);
+    vtkIdType first = end * (numberOfRings - 1) * resolution;
+    for (int i = 0; i < resolution; ++i)
+      {
+      vtkIdType triangle[3] =
+        {center, first + (i + 1) % resolution, first + i};
+      if (end)
+        {
+        std::swap(triangle[1], triangle[2]);
+        }
+      triangles->InsertNextCell(3, triangle);
+      }
+    }
+  limb->SetPoints(points.GetPointer());
+  limb->SetPolys(triangles.GetPointer());
+}
+
+//-----------------------------------------------------------------------------
+// Two bones along the axis of the limb, jointed at its middle.
+void CreateArmature(vtkPolyData* armature)
+{
+  vtkNew<vtkPoints> points;
+  points->InsertNextPoint(1., 0., 0.);
+  points->InsertNextPoint(Length / 2., 0., 0.);
+  points->InsertNextPoint(Length - 1., 0., 0.);
+  vtkNew<vtkCellArray> bones;
+  vtkIdType bone1[2] = {0, 1};
+  vtkIdType bone2[2] = {1, 2};
+  bones->InsertNextCell(2, bone1);
+  bones->InsertNextCell(2, bone2);
+  armature->SetPoints(points.GetPointer());
+  armature->SetLines(bones.GetPointer());
+}
+
+} // end namespace
+
+//-----------------------------------------------------------------------------
+int ComputeSurfaceWeightTwoBonesTest(int argc, char * argv[])
+{
+  if (argc < 2)
+    {
+    std::cerr << "Usage: " << argv[0] << " <temporary directory>" << std::endl;
+    return EXIT_FAILURE;
+    }
+  const std::string temp(argv[1]);
+  const std::string limbFileName = temp + "/ComputeSurfaceWeightLimb.vtk";
+  const std::string armatureFileName =
+    temp + "/ComputeSurfaceWeightArmature.vtk";
+  const std::string outputFileName =
+    temp + "/ComputeSurfaceWeightTwoBonesTest.vtk";
+
+  vtkNew<vtkPolyData> limb;
+  CreateLimb(limb.GetPointer());
+  vtkNew<vtkPolyData> armature;
+  CreateArmature(armature.GetPointer());
+  if (!bender::IOUtils::WritePolyData(limb.GetPointer(), limbFileName)
+      || !bender::IOUtils::WritePolyData(armature.GetPointer(),
+                                         armatureFileName))
+    {
+    std::cerr << "Can't write the inputs in " << temp << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  char* moduleArgv[] = {
+    argv[0],
+    const_cast<char*>(limbFileName.c_str()),
+    const_cast<char*>(armatureFileName.c_str()),
+    const_cast<char*>(outputFileName.c_str()),
+    const_cast<char*>("--surfaceInRAS"),
+    const_cast<char*>("--armatureInRAS")
+    };
+  if (ModuleEntryPoint(6, moduleArgv) != EXIT_SUCCESS)
+    {
+    std::cerr << "ComputeSurfaceWeight failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  vtkSmartPointer<vtkPolyData> output;
+  output.TakeReference(
+    bender::IOUtils::ReadPolyData(outputFileName.c_str(), false));
+  if (!output || output->GetNumberOfPoints() != limb->GetNumberOfPoints())
+    {
+    std::cerr << "Can't read the output " << outputFileName << std::endl;
+    return EXIT_FAILURE;
+    }
+  vtkFloatArray* weights[2] = {
+    vtkFloatArray::SafeDownCast(
+      output->GetPointData()->GetArray("weight_0")),
+    vtkFloatArray::SafeDownCast(
+      output->GetPointData()->GetArray("weight_1"))
+    };
+  if (!weights[0] || !weights[1])
+    {
+    std::cerr << "Missing weight arrays" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  bool res = true;
+  vtkIdType peaks[2] = {0, 0};
+  for (vtkIdType pi = 0; pi < output->GetNumberOfPoints(); ++pi)
+    {
+    const float sum = weights[0]->GetValue(pi) + weights[1]->GetValue(pi);
+    if (std::fabs(sum - 1.f) > 1e-4)
+      {
+      std::cerr << "Weights of vertex " << pi << " sum to " << sum
+                << std::endl;
+      res = false;
+      }
+    for (int bone = 0; bone < 2; ++bone)
+      {
+      if (weights[bone]->GetValue(pi) > weights[bone]->GetValue(peaks[bone]))
+        {
+        peaks[bone] = pi;
+        }
+      }
+    }
+
+  // Each bone weight peaks on its half of the limb and dominates there,
+  // except close to the joint.
+  for (int bone = 0; bone < 2; ++bone)
+    {
+    const double x = output->GetPoint(peaks[bone])[0];
+    if (x < bone * Length / 2. || x > (bone + 1) * Length / 2.)
+      {
+      std::cerr << "Weight of bone " << bone << " peaks at x=" << x
+                << std::endl;
+      res = false;
+      }
+    }
+  for (vtkIdType pi = 0; pi < output->GetNumberOfPoints(); ++pi)
+    {
+    const double x = output->GetPoint(pi)[0];
+    if (std::fabs(x - Length / 2.) < 2. * Radius)
+      {
+      continue;
+      }
+    const int bone = x < Length / 2. ? 0 : 1;
+    if (weights[bone]->GetValue(pi) < 0.5)
+      {
+      std::cerr << "Vertex " << pi << " at x=" << x << " has a weight of "
+                << weights[bone]->GetValue(pi) << " for bone " << bone
+                << std::endl;
+      res = false;
+      }
+    }
+  return res ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -29,6 +29,7 @@
 #include "itkImageFileWriter.h"
 #include "itkImageRegionConstIterator.h"
 #include "itkImageRegionIterator.h"
+#include "itkMultiThreader.h"
 #include "itkRelabelComponentImageFilter.h"
 #include "itkConstantPadImageFilter.h"
 
@@ -36,9 +37,11 @@
 #include "itkPluginUtilities.h"
 
 // VTK includes
-#include <vtkCleanPolyData.h>
 #include <vtkCellArray.h>
 #include <vtkCellData.h>
+#include <vtkIdTypeArray.h>
+#include <vtkIntArray.h>
+#include <vtkPoints.h>
 #include <vtkTetra.h>
 #include <vtkTransform.h>
 #include <vtkTransformPolyDataFilter.h>
@@ -54,7 +57,10 @@
 #include <Cleaver/PaddedVolume.h>
 #include <Cleaver/ScalarField.h>
 #include <Cleaver/Volume.h>
-#include <LabelMapField.h>
+#include <LabelIndicatorField.h>
+
+// STD includes
+#include <algorithm>
 
 
 // Use an anonymous namespace to keep class types and function names
@@ -67,9 +73,10 @@ namespace
 template <class InputPixelType, class LabelPixelType>
 int DoIt( int argc, char * argv[] );
 
-template <class InputImageType, class LabelImageType>
-std::vector<typename LabelImageType::Pointer>
-SplitLabelMaps(typename InputImageType::Pointer image, bool verbose);
+template <class InputImageType>
+typename InputImageType::Pointer
+RelabelLabelMap(typename InputImageType::Pointer image,
+                unsigned long& numberOfObjects, bool verbose);
 } // end of anonymous namespace
 
 int main( int argc, char * argv[] )
@@ -142,14 +149,13 @@ namespace
 //----------------------------------------------------------------------------
 //
 //----------------------------------------------------------------------------
-template <class InputImageType, class LabelImageType>
-std::vector<typename LabelImageType::Pointer>
-SplitLabelMaps(typename InputImageType::Pointer image, bool verbose)
+template <class InputImageType>
+typename InputImageType::Pointer
+RelabelLabelMap(typename InputImageType::Pointer image,
+                unsigned long& numberOfObjects, bool verbose)
 {
   typedef itk::RelabelComponentImageFilter<InputImageType,
                                            InputImageType> RelabelFilterType;
-  typedef itk::BinaryThresholdImageFilter<InputImageType,
-                                          LabelImageType> ThresholdFilterType;
 
   // Assign continuous labels to the connected components, background is
   // considered to be 0 and will be ignored in the relabeling process.
@@ -157,45 +163,33 @@ SplitLabelMaps(typename InputImageType::Pointer image, bool verbose)
   relabelFilter->SetInput( image );
   relabelFilter->Update();
 
+  numberOfObjects = relabelFilter->GetNumberOfObjects();
   if (verbose)
     {
-    std::cout << "Found " <<
-      relabelFilter->GetNumberOfObjects() << " labels." << std::endl;
+    std::cout << "Found " << numberOfObjects << " labels." << std::endl;
     }
+  return relabelFilter->GetOutput();
+}
 
-  // Extract the labels
-  typedef typename RelabelFilterType::LabelType LabelType;
-  typename ThresholdFilterType::Pointer skinThresholdFilter =
+//----------------------------------------------------------------------------
+template <class InputImageType, class LabelImageType>
+typename LabelImageType::Pointer
+ThresholdLabelMap(typename InputImageType::Pointer image,
+                  unsigned long lower, unsigned long upper,
+                  typename LabelImageType::PixelType insideValue,
+                  typename LabelImageType::PixelType outsideValue)
+{
+  typedef itk::BinaryThresholdImageFilter<InputImageType,
+                                          LabelImageType> ThresholdFilterType;
+  typename ThresholdFilterType::Pointer thresholdFilter =
     ThresholdFilterType::New();
-
-  // Create a list of images corresponding to labels
-  std::vector<typename LabelImageType::Pointer> labels;
-
-  // The skin label will become background for internal (smaller) organs
-  skinThresholdFilter->SetInput(relabelFilter->GetOutput());
-  skinThresholdFilter->SetLowerThreshold(1);
-  skinThresholdFilter->SetUpperThreshold(relabelFilter->GetNumberOfObjects()+1);
-  skinThresholdFilter->SetInsideValue(-1);
-  skinThresholdFilter->SetOutsideValue(0);
-  skinThresholdFilter->Update();
-  labels.push_back(skinThresholdFilter->GetOutput());
-
-  for (LabelType i = 1, end = relabelFilter->GetNumberOfObjects()+1; i < end;
-       ++i)
-    {
-    typename ThresholdFilterType::Pointer organThresholdFilter =
-      ThresholdFilterType::New();
-    organThresholdFilter->SetInput(relabelFilter->GetOutput());
-    organThresholdFilter->SetLowerThreshold(i);
-    organThresholdFilter->SetUpperThreshold(i);
-    organThresholdFilter->SetInsideValue(i);
-    organThresholdFilter->SetOutsideValue(-1);
-    organThresholdFilter->Update();
-
-    labels.push_back(organThresholdFilter->GetOutput());
-    }
-
-  return labels;
+  thresholdFilter->SetInput(image);
+  thresholdFilter->SetLowerThreshold(lower);
+  thresholdFilter->SetUpperThreshold(upper);
+  thresholdFilter->SetInsideValue(insideValue);
+  thresholdFilter->SetOutsideValue(outsideValue);
+  thresholdFilter->Update();
+  return thresholdFilter->GetOutput();
 }
 
 //----------------------------------------------------------------------------
@@ -204,6 +198,39 @@ bool IsPointValid(Cleaver::vec3 pos)
   return vtkBrokenCells::IsPointValid(pos.x, pos.y, pos.z);
 }
 
+//----------------------------------------------------------------------------
+struct CopyPointsInfo
+{
+  Cleaver::Vertex3D* const* Vertices;
+  size_t NumberOfVertices;
+  float* Points;
+  unsigned char* InvalidPoints;
+};
+
+//----------------------------------------------------------------------------
+// Copy the positions of the vertices into the points and flag the invalid
+// ones. The vertices are split between the threads.
+ITK_THREAD_RETURN_TYPE CopyPointsThreaderCallback(void* arg)
+{
+  typedef itk::MultiThreader::ThreadInfoStruct ThreadInfoType;
+  ThreadInfoType* infoStruct = static_cast<ThreadInfoType*>(arg);
+  CopyPointsInfo* info = static_cast<CopyPointsInfo*>(infoStruct->UserData);
+
+  const size_t threadId = infoStruct->ThreadID;
+  const size_t numberOfThreads = infoStruct->NumberOfThreads;
+  const size_t first = info->NumberOfVertices * threadId / numberOfThreads;
+  const size_t last = info->NumberOfVertices * (threadId + 1) / numberOfThreads;
+  for (size_t i = first; i < last; ++i)
+    {
+    const Cleaver::vec3& pos = info->Vertices[i]->pos();
+    info->Points[3*i] = pos.x;
+    info->Points[3*i + 1] = pos.y;
+    info->Points[3*i + 2] = pos.z;
+    info->InvalidPoints[i] = IsPointValid(pos) ? 0 : 1;
+    }
+  return ITK_THREAD_RETURN_VALUE;
+}
+
 //----------------------------------------------------------------------------
 //
 //----------------------------------------------------------------------------
@@ -226,46 +253,64 @@ int DoIt( int argc, char * argv[] )
   typename InputImageType::DirectionType imageDirection =
     reader->GetOutput()->GetDirection();
 
-  std::vector<typename LabelImageType::Pointer> labels =
-    SplitLabelMaps<InputImageType, LabelImageType>(reader->GetOutput(), Verbose);
+  // The relabeled image is the only copy of the labels, the field of each
+  // label is computed on the fly from it.
+  typedef Cleaver::LabelIndicatorField<InputPixelType> LabelFieldType;
+  typedef typename LabelFieldType::RegionType RegionType;
+  unsigned long numberOfObjects = 0;
+  typename InputImageType::Pointer labelMap =
+    RelabelLabelMap<InputImageType>(reader->GetOutput(), numberOfObjects,
+                                    Verbose);
+  // The skin and one label per object.
+  const size_t numberOfLabels = numberOfObjects + 1;
+  std::vector<RegionType> labelRegions =
+    LabelFieldType::ComputeLabelRegions(labelMap, numberOfLabels);
 
   // Constants for undesired material
-  const char airMaterial = 0;
-  char paddedVolumeMaterial = labels.size();
+  const unsigned char airMaterial = 0;
+  unsigned char paddedVolumeMaterial = numberOfLabels;
 
   // Get a map from the original labels to the new labels
   std::map<LabelPixelType, InputPixelType> materialToLabel;
 
-  for(size_t i = 0; i < labels.size(); ++i)
+  itk::ImageRegionConstIterator<InputImageType> imageIterator(
+    reader->GetOutput(), reader->GetOutput()->GetLargestPossibleRegion());
+  itk::ImageRegionConstIterator<InputImageType> labelsIterator(
+    labelMap, labelMap->GetLargestPossibleRegion());
+  for ( ;!imageIterator.IsAtEnd()
+          && !labelsIterator.IsAtEnd()
+          && materialToLabel.size() < numberOfObjects;
+        ++imageIterator, ++labelsIterator)
     {
-    itk::ImageRegionConstIterator<InputImageType> imageIterator(
-      reader->GetOutput(), reader->GetOutput()->GetLargestPossibleRegion());
-    itk::ImageRegionConstIterator<LabelImageType> labelsIterator(
-      labels[i], labels[i]->GetLargestPossibleRegion());
-    for ( ;!imageIterator.IsAtEnd()
-            && !labelsIterator.IsAtEnd();++imageIterator, ++labelsIterator)
+    const LabelPixelType material =
+      static_cast<LabelPixelType>(labelsIterator.Value());
+    if (material != airMaterial &&
+        materialToLabel.find(material) == materialToLabel.end())
       {
-      if (labelsIterator.Value() != -1 &&
-          labelsIterator.Value() != airMaterial &&
-          labelsIterator.Value() != paddedVolumeMaterial)
-        {
-        materialToLabel[labelsIterator.Value()] = imageIterator.Value();
-        assert(labelsIterator.Value() == i);
-        break;
-        }
+      materialToLabel[material] = imageIterator.Value();
       }
-    if (SaveLabelImages)
+    }
+
+  if (SaveLabelImages)
+    {
+    for(size_t i = 0; i < numberOfLabels; ++i)
       {
+      // The skin label will become background for internal (smaller) organs
+      typename LabelImageType::Pointer label = i == 0 ?
+        ThresholdLabelMap<InputImageType, LabelImageType>(
+          labelMap, 1, numberOfLabels, -1, 0) :
+        ThresholdLabelMap<InputImageType, LabelImageType>(
+          labelMap, i, i, i, -1);
       std::stringstream fileName;
       fileName << "label" << i << ".nrrd";
       bender::IOUtils::WriteDebugImage<LabelImageType>(
-        labels[i], fileName.str());
+        label, fileName.str());
       }
     }
 
   if (Verbose)
     {
-    std::cout << labels.size() <<  " materials:" << std::endl;
+    std::cout << numberOfLabels <<  " materials:" << std::endl;
       std::cout << "  material: 0 <=> label: 0"<< std::endl;
     typename std::map<LabelPixelType, InputPixelType>::const_iterator it;
     for (it = materialToLabel.begin(); it != materialToLabel.end(); ++it)
@@ -276,10 +321,20 @@ int DoIt( int argc, char * argv[] )
     }
 
   std::vector<Cleaver::ScalarField*> labelMaps;
-  for(size_t i = 0; i < labels.size(); ++i)
+  // The skin label will become background for internal (smaller) organs
+  RegionType skinRegion;
+  for(size_t i = 1; i < numberOfLabels; ++i)
     {
-    labelMaps.push_back(
-      new Cleaver::LabelMapField<LabelPixelType>(labels[i]));
+    skinRegion = LabelFieldType::MergeRegions(skinRegion, labelRegions[i]);
+    }
+  labelMaps.push_back(new LabelFieldType(
+    labelMap, 1, static_cast<InputPixelType>(numberOfLabels), -1., 0.,
+    skinRegion));
+  for(size_t i = 1; i < numberOfLabels; ++i)
+    {
+    labelMaps.push_back(new LabelFieldType(
+      labelMap, static_cast<InputPixelType>(i), static_cast<InputPixelType>(i),
+      static_cast<float>(i), -1., labelRegions[i]));
     }
 
   if(labelMaps.empty())
@@ -316,7 +371,7 @@ int DoIt( int argc, char * argv[] )
   for(size_t i=0; i < labelMaps.size(); ++i)
     delete labelMaps[i];
   labelMaps.clear();
-  labels.clear();
+  labelMap = NULL;
   reader = NULL;
 
   if (!cleaverMesh)
@@ -343,27 +398,36 @@ int DoIt( int argc, char * argv[] )
   //  Fill polydata arrays
   //-----------------------
 
-  // Points and cell arrays
-  vtkNew<vtkPoints> points;
-  points->SetNumberOfPoints(cleaverMesh->tets.size() * 4);
+  // Only the vertices of the exported tetrahedra are kept, they are given
+  // a compact id in the order they are first referenced.
+  vtkIdType numberOfCells = 0;
+  std::vector<vtkIdType> vertexIds(cleaverMesh->verts.size(), -1);
+  std::vector<Cleaver::Vertex3D*> vertices;
+  vertices.reserve(cleaverMesh->verts.size());
 
-  vtkNew<vtkCellArray> meshTetras;
-  meshTetras->Allocate(meshTetras->EstimateSize(4, cleaverMesh->tets.size()));
+  // Legacy cell array layout: (4, id0, id1, id2, id3) per cell
+  vtkNew<vtkIdTypeArray> connectivity;
+  connectivity->SetNumberOfValues(cleaverMesh->tets.size() * 5);
+  vtkIdType* cellIds = connectivity->GetPointer(0);
 
   vtkNew<vtkIntArray> cellData;
   cellData->SetName("MaterialId");
-  cellData->SetNumberOfTuples(cleaverMesh->tets.size());
-  cellData->Allocate(cleaverMesh->tets.size());
-
-  vtkSmartPointer<vtkBrokenCells> brokenCells =
-    vtkSmartPointer<vtkBrokenCells>::New();
-  brokenCells->SetPoints(points.GetPointer());
-  brokenCells->SetVerbose(Verbose);
-
-  std::map<LabelPixelType, unsigned long> materialCount;
+  cellData->SetNumberOfValues(cleaverMesh->tets.size());
+  int* materialIds = cellData->GetPointer(0);
+
+  // Look up tables indexed by material
+  const size_t numberOfMaterials = paddedVolumeMaterial + 1;
+  std::vector<int> materialLabels(numberOfMaterials, 0);
+  typename std::map<LabelPixelType, InputPixelType>::const_iterator labelIt;
+  for (labelIt = materialToLabel.begin(); labelIt != materialToLabel.end();
+       ++labelIt)
+    {
+    materialLabels[labelIt->first] = labelIt->second;
+    }
+  std::vector<unsigned long> materialCount(numberOfMaterials, 0);
   for(size_t i = 0; i < cleaverMesh->tets.size(); ++i)
     {
-    char material = cleaverMesh->tets[i]->mat_label;
+    const unsigned char material = cleaverMesh->tets[i]->mat_label;
 
     ++materialCount[material];
 
@@ -373,43 +437,99 @@ int DoIt( int argc, char * argv[] )
       continue;
       }
 
-    vtkNew<vtkTetra> meshTetra;
+    *cellIds++ = 4;
     for (size_t j = 0; j < 4; ++j)
       {
-      Cleaver::vec3 &pos = cleaverMesh->tets[i]->verts[j]->pos();
-      size_t vertexIndex = cleaverMesh->tets[i]->verts[j]->tm_v_index;
-
-      points->SetPoint(vertexIndex, pos.x, pos.y, pos.z);
-      meshTetra->GetPointIds()->SetId(j, vertexIndex);
-
-      // If invalid, flag the cell so it can be rebuild later
-      if (! IsPointValid(pos))
+      Cleaver::Vertex3D* vertex = cleaverMesh->tets[i]->verts[j];
+      const size_t vertexIndex = vertex->tm_v_index;
+      if (vertexIndex >= vertexIds.size())
         {
-        std::cerr << "Invalid point (" << pos.x << ", " << pos.y << ", " << pos.z
-                  << ") at cell " << i
-          << ", this point will be patched up but something went wrong with"
-          << " Cleaver !" << std::endl;
-        brokenCells->AddCell(vertexIndex, meshTetra.GetPointer());
+        vertexIds.resize(vertexIndex + 1, -1);
         }
+      if (vertexIds[vertexIndex] < 0)
+        {
+        vertexIds[vertexIndex] = vertices.size();
+        vertices.push_back(vertex);
+        }
+      *cellIds++ = vertexIds[vertexIndex];
       }
-
-    meshTetras->InsertNextCell(meshTetra.GetPointer());
-    cellData->InsertNextValue(materialToLabel[material]);
+    materialIds[numberOfCells++] = materialLabels[material];
     }
+  vertexIds.clear();
+  connectivity->SetNumberOfValues(numberOfCells * 5);
+  connectivity->Squeeze();
+  cellData->SetNumberOfValues(numberOfCells);
+  cellData->Squeeze();
+
   if (Verbose)
     {
     std::cout << "Cell count per material:" << std::endl;
-    typename std::map<LabelPixelType, unsigned long>::const_iterator it;
-    for (it = materialCount.begin(); it != materialCount.end(); ++it)
+    for (size_t material = 0; material < numberOfMaterials; ++material)
       {
-      std::cout << "  material " << static_cast<long>(it->first)
-                << " = " << static_cast<long>(it->second) << std::endl;
+      if (materialCount[material])
+        {
+        std::cout << "  material " << material
+                  << " = " << materialCount[material] << std::endl;
+        }
       }
+    std::cout << "Exported " << numberOfCells << " cells and "
+              << vertices.size() << " points." << std::endl;
     }
 
+  vtkNew<vtkCellArray> meshTetras;
+  meshTetras->SetCells(numberOfCells, connectivity.GetPointer());
+
+  // Copy the points and look for the invalid ones
+  vtkNew<vtkPoints> points;
+  points->SetDataTypeToFloat();
+  points->SetNumberOfPoints(vertices.size());
+  std::vector<unsigned char> invalidPoints(vertices.size(), 0);
+
+  CopyPointsInfo copyInfo;
+  copyInfo.Vertices = vertices.empty() ? 0 : &vertices[0];
+  copyInfo.NumberOfVertices = vertices.size();
+  copyInfo.Points = static_cast<float*>(points->GetVoidPointer(0));
+  copyInfo.InvalidPoints = invalidPoints.empty() ? 0 : &invalidPoints[0];
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  threader->SetSingleMethod(CopyPointsThreaderCallback, &copyInfo);
+  threader->SingleMethodExecute();
+  vertices.clear();
+
   // No need for the mesh anymore, release the memory.
   delete cleaverMesh;
 
+  // Flag the cells with an invalid point so they can be rebuild later
+  vtkSmartPointer<vtkBrokenCells> brokenCells =
+    vtkSmartPointer<vtkBrokenCells>::New();
+  brokenCells->SetPoints(points.GetPointer());
+  brokenCells->SetVerbose(Verbose);
+  if (std::find(invalidPoints.begin(), invalidPoints.end(), 1)
+      != invalidPoints.end())
+    {
+    const vtkIdType* cell = connectivity->GetPointer(0);
+    for (vtkIdType i = 0; i < numberOfCells; ++i, cell += 5)
+      {
+      vtkNew<vtkTetra> meshTetra;
+      for (int j = 0; j < 4; ++j)
+        {
+        meshTetra->GetPointIds()->SetId(j, cell[j + 1]);
+        }
+      for (int j = 0; j < 4; ++j)
+        {
+        const vtkIdType pointId = cell[j + 1];
+        if (invalidPoints[pointId])
+          {
+          double* pos = points->GetPoint(pointId);
+          std::cerr << "Invalid point (" << pos[0] << ", " << pos[1] << ", "
+                    << pos[2] << ") at cell " << i
+            << ", this point will be patched up but something went wrong with"
+            << " Cleaver !" << std::endl;
+          brokenCells->AddCell(pointId, meshTetra.GetPointer());
+          }
+        }
+      }
+    }
+
   if (brokenCells->GetNumberOfBrokenCells() || Verbose)
     {
     std::cerr << "There are " << brokenCells->GetNumberOfBrokenCells()
@@ -424,23 +544,16 @@ int DoIt( int argc, char * argv[] )
   // No need for the cell fixer anymore, release the memory.
   brokenCells = NULL;
 
-  //-----------------------------
-  //  Create and clean polydata
-  //-----------------------------
+  //-------------------
+  //  Create polydata
+  //-------------------
 
+  // The points are already compact, there is no need to clean the polydata.
   vtkSmartPointer<vtkPolyData> vtkMesh = vtkSmartPointer<vtkPolyData>::New();
   vtkMesh->SetPoints(points.GetPointer());
   vtkMesh->SetPolys(meshTetras.GetPointer());
   vtkMesh->GetCellData()->SetScalars(cellData.GetPointer());
 
-  if (Verbose)
-    {
-    std::cout << "Clean PolyData..." << std::endl;
-    }
-  vtkNew<vtkCleanPolyData> cleanFilter;
-  cleanFilter->PointMergingOff(); // Prevent from creating triangles or lines
-  cleanFilter->SetInput(vtkMesh);
-
   //---------------------------------------
   //  Transform polydata to fit the image
   //---------------------------------------
@@ -506,7 +619,7 @@ int DoIt( int argc, char * argv[] )
     }
   // Actual transformation
   vtkNew<vtkTransformPolyDataFilter> transformFilter;
-  transformFilter->SetInput(cleanFilter->GetOutput());
+  transformFilter->SetInput(vtkMesh);
   transformFilter->SetTransform(transform.GetPointer());
 
   // Conserve memory
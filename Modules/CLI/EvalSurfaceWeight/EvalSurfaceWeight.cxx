@@ -204,8 +204,9 @@ int main( int argc, char * argv[] )
     }
 
   //----------------------------
-  // Read the first weight image
-  // and all file names
+  // Read all file names, then the packed
+  // weights if they are up to date,
+  // otherwise the first weight image
   //----------------------------
   std::vector<std::string> fnames;
   bender::GetWeightFileNames(WeightDirectory, fnames);
@@ -216,12 +217,22 @@ int main( int argc, char * argv[] )
     return 1;
     }
 
-  typedef itk::ImageFileReader<WeightImage>  ReaderType;
-  ReaderType::Pointer reader = ReaderType::New();
-  reader->SetFileName(fnames[0].c_str());
-  reader->Update();
-
-  WeightImage::Pointer weight0 = reader->GetOutput();
+  bender::PackedWeights packedWeights;
+  const bool usePackedWeights = bender::ReadPackedWeights(
+    bender::GetPackedWeightFileName(WeightDirectory), fnames, packedWeights);
+  WeightImage::Pointer weight0;
+  if (usePackedWeights)
+    {
+    weight0 = bender::GetPackedWeightMask(packedWeights);
+    }
+  else
+    {
+    typedef itk::ImageFileReader<WeightImage>  ReaderType;
+    ReaderType::Pointer reader = ReaderType::New();
+    reader->SetFileName(fnames[0].c_str());
+    reader->Update();
+    weight0 = reader->GetOutput();
+    }
   Region weightRegion = weight0->GetLargestPossibleRegion();
 
   if (Debug)
@@ -294,7 +305,14 @@ int main( int argc, char * argv[] )
   // Read Weights
   //----------------------------
   WeightMap weightMap;
-  bender::ReadWeights(fnames, domainVoxels, weightMap);
+  if (usePackedWeights)
+    {
+    bender::ReadPackedWeights(packedWeights, domainVoxels, weightMap);
+    }
+  else
+    {
+    bender::ReadWeights(fnames, domainVoxels, weightMap);
+    }
   weightMap.SetMaskImage(weight0, 0.);
   vtkIdTypeArray* filiation = vtkIdTypeArray::SafeDownCast(
     armature.GetPointer() ? armature->GetCellData()->GetArray("Parenthood") : 0);
@@ -33,6 +33,8 @@
 #include <vtkCellArray.h>
 #include <vtkCellData.h>
 #include <vtkDoubleArray.h>
+#include <vtkFieldData.h>
+#include <vtkIntArray.h>
 #include <vtkTetra.h>
 #include <vtkPolyData.h>
 #include <vtkPolyDataWriter.h>
@@ -83,9 +85,16 @@ int main( int argc, char * argv[] )
 
   vtkIntArray * materialIdArray = vtkIntArray::SafeDownCast(
     tetraMesh->GetCellData()->GetScalars());
+  if (!materialIdArray)
+    {
+    std::cerr << "No material id cell scalars in the input mesh" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // The points, cells and material ids are shared with the input mesh, only
+  // the material parameters are added.
+  output->ShallowCopy(tetraMesh);
 
-  output->DeepCopy(tetraMesh);
-  
   // Create new array to store material parameters
   vtkNew<vtkDoubleArray> cellPropArray;
 
@@ -97,31 +106,68 @@ int main( int argc, char * argv[] )
   size_t const numOFMaterialParameters = 2;
   cellPropArray->SetNumberOfComponents(numOFMaterialParameters);
 
-  for(size_t i = 0; i < materialIdArray->GetDataSize(); ++i)
+  if (MaterialTable)
+    {
+    // Store the parameters once per material in the field data. The
+    // "MaterialId" field array gives the material of each row of the
+    // "MaterialParameters" field array.
+    vtkNew<vtkIntArray> tableIdArray;
+    tableIdArray->SetName("MaterialId");
+    tableIdArray->SetNumberOfTuples(materialMap.size());
+    cellPropArray->SetNumberOfTuples(materialMap.size());
+    vtkIdType row = 0;
+    for (MaterialMapType::const_iterator it = materialMap.begin();
+         it != materialMap.end(); ++it, ++row)
+      {
+      MaterialMapType::mapped_type a(numOFMaterialParameters,0.0);
+      for (size_t k = 0; k < it->second.size() && k < a.size(); ++k)
+        {
+        a[k] = it->second[k];
+        }
+      tableIdArray->SetValue(row, it->first);
+      cellPropArray->SetTupleValue(row, &a[0]);
+      }
+    output->GetFieldData()->AddArray(tableIdArray.GetPointer());
+    output->GetFieldData()->AddArray(cellPropArray.GetPointer());
+    output->GetCellData()->SetScalars(materialIdArray);
+    bender::IOUtils::WritePolyData(output, OutputMesh);
+    return EXIT_SUCCESS;
+    }
+
+  const vtkIdType numberOfCells = materialIdArray->GetNumberOfTuples();
+  cellPropArray->SetNumberOfTuples(numberOfCells);
+  MaterialMapType::const_iterator material = materialMap.end();
+  for(vtkIdType i = 0; i < numberOfCells; ++i)
     {
     MaterialMapType::mapped_type a(numOFMaterialParameters,0.0);
     int                         id = materialIdArray->GetValue(i);
-  
+
+    // Consecutive cells mostly share the same material
+    if (material == materialMap.end() || material->first != id)
+      {
+      material = materialMap.find(id);
+      }
+
     // assign zero to this element if there is no material property for it
-    if(materialMap.end() == materialMap.find(id))
+    if(materialMap.end() == material)
       {
-      cellPropArray->InsertNextTupleValue(&a[0]);
+      cellPropArray->SetTupleValue(i, &a[0]);
       continue;
       }
 
     // There should be at least two and no more than five parameters per element
-    if(materialMap[id].size() < 2 && materialMap[id].size() > numOFMaterialParameters)
+    if(material->second.size() < 2 && material->second.size() > numOFMaterialParameters)
       {
       std::cerr << "Not enough material parameters." << std::endl;
       return EXIT_FAILURE;
       }
 
-    for (size_t k = 0, k_end = materialMap[id].size(); k != k_end; ++k)
-      a[k] = materialMap[id][k];
+    for (size_t k = 0, k_end = material->second.size(); k != k_end; ++k)
+      a[k] = material->second[k];
 
-    cellPropArray->InsertNextTupleValue(&a[0]);
+    cellPropArray->SetTupleValue(i, &a[0]);
     }
-    
+
   output->GetCellData()->AddArray(cellPropArray.GetPointer());
   output->GetCellData()->SetScalars(materialIdArray);
   bender::IOUtils::WritePolyData(output, OutputMesh);
@@ -22,8 +22,15 @@
 #include "ModelQuadricClusteringDecimationCLP.h"
 #include "benderIOUtils.h"
 
+// ITK includes
+#include <itkMultiThreader.h>
+#include <itksys/SystemTools.hxx>
+
 // VTK includes
+#include <vtkCellArray.h>
 #include <vtkNew.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
 #include <vtkPolyData.h>
 #include <vtkQuadricClustering.h>
 #include <vtkSmartPointer.h>
@@ -32,7 +39,11 @@
 #include <vtkPluginFilterWatcher.h>
 
 // STD includes
+#include <algorithm>
+#include <cmath>
 #include <exception>
+#include <sstream>
+#include <vector>
 
 namespace
 {
@@ -52,6 +63,146 @@ template<class T> bool CheckVector(std::vector<T>& vec)
   return isVectorValid;
 }
 
+//----------------------------------------------------------------------------
+// Level of detail: decimation of the input with its own number of divisions.
+struct DecimationLevel
+{
+  DecimationLevel() : Scale(1.), Failed(false)
+    {
+    this->Divisions[0] = this->Divisions[1] = this->Divisions[2] = 1;
+    }
+
+  double Scale;
+  int Divisions[3];
+  vtkSmartPointer<vtkPolyData> Input;
+  vtkSmartPointer<vtkPolyData> Output;
+  bool Failed;
+};
+
+//----------------------------------------------------------------------------
+struct DecimationSettings
+{
+  bool UseInputPoints;
+  bool UseFeatureEdges;
+  bool UseFeaturePoints;
+  bool DebugMode;
+};
+
+//----------------------------------------------------------------------------
+struct DecimateInfo
+{
+  std::vector<DecimationLevel>* Levels;
+  const DecimationSettings* Settings;
+};
+
+//----------------------------------------------------------------------------
+// Return a polydata that shares the points and the cells of the model but
+// not its cell arrays: the traversal of a cell array isn't thread safe.
+vtkSmartPointer<vtkPolyData> ShareModel(vtkPolyData* model)
+{
+  vtkSmartPointer<vtkPolyData> sharedModel =
+    vtkSmartPointer<vtkPolyData>::New();
+  sharedModel->SetPoints(model->GetPoints());
+  sharedModel->GetPointData()->ShallowCopy(model->GetPointData());
+  vtkNew<vtkCellArray> verts;
+  verts->SetCells(model->GetNumberOfVerts(), model->GetVerts()->GetData());
+  sharedModel->SetVerts(verts.GetPointer());
+  vtkNew<vtkCellArray> lines;
+  lines->SetCells(model->GetNumberOfLines(), model->GetLines()->GetData());
+  sharedModel->SetLines(lines.GetPointer());
+  vtkNew<vtkCellArray> polys;
+  polys->SetCells(model->GetNumberOfPolys(), model->GetPolys()->GetData());
+  sharedModel->SetPolys(polys.GetPointer());
+  vtkNew<vtkCellArray> strips;
+  strips->SetCells(model->GetNumberOfStrips(), model->GetStrips()->GetData());
+  sharedModel->SetStrips(strips.GetPointer());
+  return sharedModel;
+}
+
+//----------------------------------------------------------------------------
+// The progress is only reported when the levels are decimated one after the
+// other.
+bool Decimate(DecimationLevel& level, const DecimationSettings& settings,
+              bool watchProgress = false,
+              ModuleProcessInformation* processInformation = 0,
+              double progressFraction = 1., double progressStart = 0.)
+{
+  vtkNew<vtkQuadricClustering> decimator;
+  decimator->SetInput(level.Input);
+
+  decimator->SetUseInputPoints(settings.UseInputPoints);
+  decimator->SetUseFeatureEdges(settings.UseFeatureEdges);
+  decimator->SetUseFeaturePoints(settings.UseFeaturePoints);
+  decimator->AutoAdjustNumberOfDivisionsOff();
+  decimator->SetNumberOfXDivisions(level.Divisions[0]);
+  decimator->SetNumberOfYDivisions(level.Divisions[1]);
+  decimator->SetNumberOfZDivisions(level.Divisions[2]);
+
+  if (settings.DebugMode && watchProgress)
+    {
+    decimator->Print(std::cout);
+    decimator->DebugOn();
+    }
+
+  try
+    {
+    if (watchProgress)
+      {
+      vtkPluginFilterWatcher watchDecimate(decimator.GetPointer(),
+        "Reducing", processInformation, progressFraction, progressStart);
+      decimator->Update();
+      }
+    else
+      {
+      decimator->Update();
+      }
+    }
+  catch (std::bad_alloc&)
+    {
+    level.Failed = true;
+    return false;
+    }
+  // Detach the output from the pipeline, it may be the input of the next
+  // level.
+  level.Output = vtkSmartPointer<vtkPolyData>::New();
+  level.Output->ShallowCopy(decimator->GetOutput());
+  return true;
+}
+
+//----------------------------------------------------------------------------
+// Decimate the levels, the levels are split between the threads.
+ITK_THREAD_RETURN_TYPE DecimateThreaderCallback(void* arg)
+{
+  typedef itk::MultiThreader::ThreadInfoStruct ThreadInfoType;
+  ThreadInfoType* infoStruct = static_cast<ThreadInfoType*>(arg);
+  DecimateInfo* info = static_cast<DecimateInfo*>(infoStruct->UserData);
+
+  const size_t threadId = infoStruct->ThreadID;
+  const size_t numberOfThreads = infoStruct->NumberOfThreads;
+  std::vector<DecimationLevel>& levels = *info->Levels;
+  for (size_t i = threadId; i < levels.size(); i += numberOfThreads)
+    {
+    Decimate(levels[i], *info->Settings);
+    }
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+//----------------------------------------------------------------------------
+std::string GetLevelFileName(const std::string& fileName, size_t level)
+{
+  std::stringstream levelFileName;
+  const std::string path = itksys::SystemTools::GetFilenamePath(fileName);
+  if (!path.empty())
+    {
+    levelFileName << path << "/";
+    }
+  levelFileName
+    << itksys::SystemTools::GetFilenameWithoutLastExtension(fileName)
+    << "_" << level
+    << itksys::SystemTools::GetFilenameLastExtension(fileName);
+  return levelFileName.str();
+}
+
 } // end namespace
 
 int main( int argc, char * argv[] )
@@ -76,14 +227,6 @@ int main( int argc, char * argv[] )
       <<std::endl;
     }
 
-  vtkNew<vtkQuadricClustering> decimator;
-  decimator->SetInput(model);
-
-  decimator->SetUseInputPoints(UseInputPoints);
-  decimator->SetUseFeatureEdges(UseFeatureEdges);
-  decimator->SetUseFeaturePoints(UseFeaturePoints);
-  decimator->AutoAdjustNumberOfDivisionsOff();
-
   if (UseNumberOfDivisions)
     {
     if (! CheckVector<int>(Divisions))
@@ -91,10 +234,6 @@ int main( int argc, char * argv[] )
       std::cerr<<"ERROR: Invalid number of divisions."<<std::endl;
       return EXIT_FAILURE;
       }
-
-    decimator->SetNumberOfXDivisions(Divisions[0]);
-    decimator->SetNumberOfYDivisions(Divisions[1]);
-    decimator->SetNumberOfZDivisions(Divisions[2]);
     }
   else
     {
@@ -103,51 +242,119 @@ int main( int argc, char * argv[] )
       std::cerr<<"ERROR: Invalid spacing."<<std::endl;
       return EXIT_FAILURE;
       }
+    }
 
-    double bounds[6];
-    model->GetBounds(bounds);
-
-    double divisions[3];
-    for (int i = 0; i < 3; ++i)
+  // The first level uses the divisions or the spacing, each other level
+  // scales the spacing (i.e. divides the divisions) by its factor.
+  std::vector<DecimationLevel> levels(1);
+  for (size_t i = 0; i < LevelScales.size(); ++i)
+    {
+    if (LevelScales[i] <= 0.)
       {
-      divisions[i] = ceil((bounds[2*i+1] - bounds[2*i]) / Spacing[i]);
+      std::cerr<<"ERROR: Invalid level scale."<<std::endl;
+      return EXIT_FAILURE;
       }
-
-    decimator->SetNumberOfXDivisions(static_cast<int>(divisions[0]));
-    decimator->SetNumberOfYDivisions(static_cast<int>(divisions[1]));
-    decimator->SetNumberOfZDivisions(static_cast<int>(divisions[2]));
+    levels.push_back(DecimationLevel());
+    levels.back().Scale = LevelScales[i];
     }
 
-  if (DebugMode)
+  // Computing the bounds now also makes them safe to read from the threads.
+  double bounds[6];
+  model->GetBounds(bounds);
+  for (size_t level = 0; level < levels.size(); ++level)
     {
-    decimator->Print(std::cout);
-    decimator->DebugOn();
+    for (int i = 0; i < 3; ++i)
+      {
+      double divisions = 0.;
+      if (UseNumberOfDivisions)
+        {
+        divisions = floor(Divisions[i] / levels[level].Scale + 0.5);
+        }
+      else
+        {
+        divisions = ceil((bounds[2*i+1] - bounds[2*i])
+                         / (Spacing[i] * levels[level].Scale));
+        }
+      levels[level].Divisions[i] =
+        std::max(1, static_cast<int>(divisions));
+      }
     }
 
-  vtkPluginFilterWatcher watchDecimate(decimator.GetPointer(),
-    "Reducing", CLPProcessInformation, 0.0, 1.0);
-  try
+  DecimationSettings settings;
+  settings.UseInputPoints = UseInputPoints;
+  settings.UseFeatureEdges = UseFeatureEdges;
+  settings.UseFeaturePoints = UseFeaturePoints;
+  settings.DebugMode = DebugMode;
+
+  if (levels.size() == 1 || Cascade)
     {
-    decimator->Update();
+    // Each level decimates the previous one.
+    const double progressFraction = 1. / levels.size();
+    for (size_t level = 0; level < levels.size(); ++level)
+      {
+      levels[level].Input = level ? levels[level - 1].Output : model;
+      if (!Decimate(levels[level], settings, true, CLPProcessInformation,
+                    progressFraction, level * progressFraction))
+        {
+        break;
+        }
+      }
     }
-  catch (std::bad_alloc&)
+  else
     {
-    std::cerr <<"Could not allocate memory for the given inputs. \n"
-      << "-> Stopping."<<std::endl;
-    return EXIT_FAILURE;
+    // All the levels decimate the input model in parallel.
+    for (size_t level = 0; level < levels.size(); ++level)
+      {
+      levels[level].Input = ShareModel(model);
+      }
+    DecimateInfo decimateInfo;
+    decimateInfo.Levels = &levels;
+    decimateInfo.Settings = &settings;
+    itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+    threader->SetNumberOfThreads(std::min(
+      threader->GetNumberOfThreads(), static_cast<int>(levels.size())));
+    threader->SetSingleMethod(DecimateThreaderCallback, &decimateInfo);
+    threader->SingleMethodExecute();
     }
 
-  vtkSmartPointer<vtkPolyData> decimatedModel = decimator->GetOutput();
-
-  if (DebugMode)
+  for (size_t level = 0; level < levels.size(); ++level)
     {
-    std::cout << "Decimated model:\n"
-              << "  Points: " << decimatedModel->GetNumberOfPoints() << "\n"
-              << "  Cells: " << decimatedModel->GetNumberOfCells() << "\n"
-              << std::endl;
+    if (levels[level].Failed || !levels[level].Output)
+      {
+      std::cerr <<"Could not allocate memory for the given inputs. \n"
+        << "-> Stopping."<<std::endl;
+      return EXIT_FAILURE;
+      }
     }
 
-  bender::IOUtils::WritePolyData(decimatedModel, DecimatedModel.c_str());
+  const vtkIdType numberOfInputCells = model->GetNumberOfCells();
+  for (size_t level = 0; level < levels.size(); ++level)
+    {
+    vtkPolyData* decimatedModel = levels[level].Output;
+    if (DebugMode || levels.size() > 1)
+      {
+      std::cout << "Decimated model";
+      if (levels.size() > 1)
+        {
+        std::cout << " (level " << level << ")";
+        }
+      std::cout << ":\n"
+                << "  Divisions: " << levels[level].Divisions[0] << " x "
+                << levels[level].Divisions[1] << " x "
+                << levels[level].Divisions[2] << "\n"
+                << "  Points: " << decimatedModel->GetNumberOfPoints() << "\n"
+                << "  Cells: " << decimatedModel->GetNumberOfCells();
+      if (numberOfInputCells > 0)
+        {
+        std::cout << " (" << 100. * decimatedModel->GetNumberOfCells()
+          / numberOfInputCells << "% of the input)";
+        }
+      std::cout << "\n" << std::endl;
+      }
+
+    bender::IOUtils::WritePolyData(decimatedModel, level == 0 ?
+      DecimatedModel : GetLevelFileName(DecimatedModel, level));
+    }
 
   return EXIT_SUCCESS;
 }
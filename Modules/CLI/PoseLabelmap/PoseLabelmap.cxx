@@ -728,8 +728,9 @@ int DoIt(int argc, char* argv[])
     }
 
   //----------------------------
-  // Read the first weight image
-  // and all file names
+  // Read all file names, then the packed
+  // weights if they are up to date,
+  // otherwise the first weight image
   //----------------------------
   std::vector<std::string> fnames;
   bender::GetWeightFileNames(WeightDirectory, fnames);
@@ -741,12 +742,22 @@ int DoIt(int argc, char* argv[])
     return 1;
     }
 
-  typedef itk::ImageFileReader<WeightImage>  ReaderType;
-  ReaderType::Pointer reader = ReaderType::New();
-  reader->SetFileName(fnames[0].c_str());
-  reader->Update();
-
-  WeightImage::Pointer weight0 = reader->GetOutput();
+  bender::PackedWeights packedWeights;
+  const bool usePackedWeights = bender::ReadPackedWeights(
+    bender::GetPackedWeightFileName(WeightDirectory), fnames, packedWeights);
+  WeightImage::Pointer weight0;
+  if (usePackedWeights)
+    {
+    weight0 = bender::GetPackedWeightMask(packedWeights);
+    }
+  else
+    {
+    typedef itk::ImageFileReader<WeightImage>  ReaderType;
+    ReaderType::Pointer reader = ReaderType::New();
+    reader->SetFileName(fnames[0].c_str());
+    reader->Update();
+    weight0 = reader->GetOutput();
+    }
   Region weightRegion = weight0->GetLargestPossibleRegion();
   std::cout << "Weight volume description: " << std::endl;
   std::cout << weightRegion << std::endl;
@@ -801,7 +812,14 @@ int DoIt(int argc, char* argv[])
   WeightMap weightMap;
   weightMap.SetMinWeightValue(0.0000000001);
   //bender::ReadWeights(fnames,domainVoxels,weightMap);
-  bender::ReadWeightsFromImage<T>(fnames, labelMap, weightMap);
+  if (usePackedWeights)
+    {
+    bender::ReadPackedWeightsFromImage<T>(packedWeights, labelMap, weightMap);
+    }
+  else
+    {
+    bender::ReadWeightsFromImage<T>(fnames, labelMap, weightMap);
+    }
   // Don't interpolate weights outside of the domain (i.e. outside the body).
   // -1. is outside of domain
   // 0. is no weight for bone 0
@@ -848,12 +848,24 @@ int main( int argc, char * argv[] )
     // Read the first weight image
     std::cout<<"Reading weight from images."<<std::endl;
 
-    typedef itk::ImageFileReader<WeightImage>  ReaderType;
-    ReaderType::Pointer reader = ReaderType::New();
-    reader->SetFileName(weightFilenames[0].c_str());
-    reader->Update();
-
-    WeightImage::Pointer weight0 =  reader->GetOutput();
+    // Use the packed weights if they are up to date
+    bender::PackedWeights packedWeights;
+    const bool usePackedWeights = bender::ReadPackedWeights(
+      bender::GetPackedWeightFileName(WeightDirectory), weightFilenames,
+      packedWeights);
+    WeightImage::Pointer weight0;
+    if (usePackedWeights)
+      {
+      weight0 = bender::GetPackedWeightMask(packedWeights);
+      }
+    else
+      {
+      typedef itk::ImageFileReader<WeightImage>  ReaderType;
+      ReaderType::Pointer reader = ReaderType::New();
+      reader->SetFileName(weightFilenames[0].c_str());
+      reader->Update();
+      weight0 =  reader->GetOutput();
+      }
     Region weightRegion = weight0->GetLargestPossibleRegion();
 
     //----------------------------
@@ -880,8 +892,15 @@ int main( int argc, char * argv[] )
     std::cout<<numPoints<<" vertices, "<<domainVoxels.size()<<" voxels"<<std::endl;
 
     WeightMap weightMap;
-    bender::ReadWeights(weightFilenames, domainVoxels, weightMap,
-                        CLPProcessInformation ? &CLPProcessInformation->Abort : 0);
+    if (usePackedWeights)
+      {
+      bender::ReadPackedWeights(packedWeights, domainVoxels, weightMap);
+      }
+    else
+      {
+      bender::ReadWeights(weightFilenames, domainVoxels, weightMap,
+                          CLPProcessInformation ? &CLPProcessInformation->Abort : 0);
+      }
     weightMap.SetMaskImage(weight0, 0.);
 
     if (CLPProcessInformation && CLPProcessInformation->Abort)
@@ -0,0 +1,253 @@
+/*=========================================================================
+
+  Program: Bender
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+
+// ITK includes
+#include "itkChangeLabelImageFilter.h"
+#include "itkConstantPadImageFilter.h"
+#include "itkImageFileReader.h"
+#include "itkImageFileWriter.h"
+#include "itkVotingResampleImageFilter.h"
+
+#include "itkPluginUtilities.h"
+#include "PreprocessLabelmapCLP.h"
+
+// VotingResample includes
+#include "VotingResample.h"
+
+// STD includes
+#include <numeric>
+
+// Use an anonymous namespace to keep class types and function names
+// from colliding when module is used as shared object module.  Every
+// thing should be in an anonymous namespace except for the module
+// entry point, e.g. main()
+//
+namespace
+{
+template <class T> int DoIt( int argc, char * argv[] );
+} // end of anonymous namespace
+
+//----------------------------------------------------------------------------
+int main( int argc, char * argv[] )
+{
+  PARSE_ARGS;
+
+  itk::ImageIOBase::IOPixelType     pixelType;
+  itk::ImageIOBase::IOComponentType componentType;
+
+  try
+    {
+    itk::GetImageType(InputVolume, pixelType, componentType);
+
+    switch( componentType )
+      {
+      case itk::ImageIOBase::UCHAR:
+        return DoIt<unsigned char>( argc, argv );
+        break;
+      case itk::ImageIOBase::CHAR:
+        return DoIt<char>( argc, argv );
+        break;
+      case itk::ImageIOBase::USHORT:
+        return DoIt<unsigned short>( argc, argv );
+        break;
+      case itk::ImageIOBase::SHORT:
+        return DoIt<short>( argc, argv );
+        break;
+      case itk::ImageIOBase::UINT:
+        return DoIt<unsigned int>( argc, argv );
+        break;
+      case itk::ImageIOBase::INT:
+        return DoIt<int>( argc, argv );
+        break;
+      case itk::ImageIOBase::ULONG:
+        return DoIt<unsigned long>( argc, argv );
+        break;
+      case itk::ImageIOBase::LONG:
+        return DoIt<long>( argc, argv );
+        break;
+      case itk::ImageIOBase::FLOAT:
+        return DoIt<float>( argc, argv );
+        break;
+      case itk::ImageIOBase::DOUBLE:
+        return DoIt<double>( argc, argv );
+        break;
+      case itk::ImageIOBase::UNKNOWNCOMPONENTTYPE:
+      default:
+        std::cout << "unknown component type" << std::endl;
+        break;
+      }
+    }
+
+  catch( itk::ExceptionObject & excep )
+    {
+    std::cerr << argv[0] << ": exception caught !" << std::endl;
+    std::cerr << excep << std::endl;
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
+
+namespace
+{
+
+//----------------------------------------------------------------------------
+template <class T>
+int DoIt( int argc, char * argv[] )
+{
+  PARSE_ARGS;
+
+  typedef T PixelType;
+  typedef itk::Image<PixelType, 3> ImageType;
+  typedef typename ImageType::SizeType SizeType;
+
+  typedef itk::ImageFileReader<ImageType>  ReaderType;
+  typedef itk::ImageFileWriter<ImageType> WriterType;
+
+  typedef itk::ChangeLabelImageFilter<ImageType, ImageType> ChangeLabelType;
+  typedef itk::ConstantPadImageFilter<ImageType, ImageType> PadType;
+  typedef itk::VotingResampleImageFilter<ImageType> VotingResampleType;
+
+  // Check the parameters of each step
+  const bool changeLabels = InputLabel.size() > 0 || OutputLabel.size() > 0;
+  int totalNumberOfInputLabels =
+    std::accumulate(InputLabelNumber.begin(), InputLabelNumber.end(), 0);
+  if (changeLabels
+      && (OutputLabel.size() != InputLabelNumber.size()
+          || InputLabel.size() <= 0
+          || InputLabelNumber.size() <= 0
+          || OutputLabel.size() <= 0
+          || InputLabel.size() != totalNumberOfInputLabels))
+    {
+    std::cerr << "Error, bad input sizes:" << std::endl
+      << "InputLabel size: " << InputLabel.size() << "\t"
+      << "InputLabelNumber size: " << InputLabelNumber.size() << "\t"
+      << "OutputLabel size: " << OutputLabel.size() << std::endl
+      << "The sum of all the InputLabelNumber values shoud be equal to the"
+      << " size of InputLabel."<<std::endl
+      << "The size of OutputLabel should be the same as the size of"
+      << " InputLabelNumber." << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  if (outputSpacing.size() != ImageType::ImageDimension)
+    {
+    std::cerr<<"Given spacing doesn't have the same dimension as the input"
+      <<"image."<<std::endl;
+    return EXIT_FAILURE;
+    }
+  bool resample = false;
+  for (size_t i = 0; i < outputSpacing.size(); ++i)
+    {
+    resample = resample || outputSpacing[i] > 1e-6;
+    }
+
+  // Read
+  typename ReaderType::Pointer reader = ReaderType::New();
+  itk::PluginFilterWatcher watchReader(reader, "Read Volume",
+                                       CLPProcessInformation);
+  reader->SetFileName( InputVolume.c_str() );
+  ImageType* output = reader->GetOutput();
+
+  // Change label
+  typename ChangeLabelType::Pointer changeLabel = ChangeLabelType::New();
+  itk::PluginFilterWatcher watchChangeLabel(changeLabel,
+                                            "Change label",
+                                            CLPProcessInformation);
+  if (changeLabels)
+    {
+    size_t k = 0;
+    for (size_t i = 0; i < InputLabelNumber.size(); ++i)
+      {
+      const int outputLabel = OutputLabel[i];
+      const size_t numberOfLabels = InputLabelNumber[i];
+      for (size_t j = 0; j < numberOfLabels; ++j)
+        {
+        const int inputLabel = InputLabel[k + j];
+        changeLabel->SetChange(inputLabel, outputLabel);
+        }
+      k += numberOfLabels;
+      }
+    // Reuse the buffer of the reader instead of allocating a new volume.
+    changeLabel->InPlaceOn();
+    changeLabel->SetInput( output );
+    output = changeLabel->GetOutput();
+    }
+
+  // Pad
+  typename PadType::Pointer pad = PadType::New();
+  itk::PluginFilterWatcher watchPad(pad,
+                                    "Pad image",
+                                    CLPProcessInformation);
+  if (PadThickness > 0)
+    {
+    SizeType padSize;
+    padSize.Fill(static_cast<typename SizeType::SizeValueType>(PadThickness));
+    pad->SetInput( output );
+    pad->SetConstant( static_cast<PixelType>(PadValue) );
+    pad->SetPadLowerBound( padSize );
+    pad->SetPadUpperBound( padSize );
+    // The resampling requests the whole padded image, it must be kept for
+    // all the streamed pieces.
+    pad->SetReleaseDataFlag(!resample || StreamDivisions <= 1);
+    output = pad->GetOutput();
+    }
+
+  // Voting resample
+  typename VotingResampleType::Pointer voting = VotingResampleType::New();
+  itk::PluginFilterWatcher watchVoting(voting,
+                                       "Voting Resample",
+                                       CLPProcessInformation);
+  if (resample)
+    {
+    // The output geometry depends on the geometry of the padded image.
+    output->UpdateOutputInformation();
+    SizeType outputSize;
+    typename ImageType::PointType outputOrigin;
+    typename ImageType::SpacingType outputVotingSpacing;
+    ComputeVotingResampleGeometry<ImageType>(output, outputSpacing,
+                                             autoadjustSpacing,
+                                             outputSize, outputOrigin,
+                                             outputVotingSpacing);
+    voting->SetInput( output );
+    voting->SetHighPrecedenceLabels(highPrecedenceLabels);
+    voting->SetLowPrecedenceLabels(lowPrecedenceLabels);
+    voting->SetRadius(radius);
+    voting->SetSize(outputSize);
+    voting->SetOutputSpacing(outputVotingSpacing);
+    voting->SetOutputOrigin(outputOrigin);
+    output = voting->GetOutput();
+    }
+
+  // Write
+  typename WriterType::Pointer writer = WriterType::New();
+  itk::PluginFilterWatcher watchWriter(writer,
+                                       "Write Volume",
+                                       CLPProcessInformation);
+  writer->SetFileName( OutputVolume.c_str() );
+  writer->SetInput( output );
+  writer->SetNumberOfStreamDivisions( StreamDivisions );
+  writer->SetUseCompression(1);
+  writer->Update();
+
+  return EXIT_SUCCESS;
+}
+
+} // end of anonymous namespace
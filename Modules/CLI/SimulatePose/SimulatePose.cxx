@@ -20,9 +20,21 @@
 
 // Bender includes
 #include "SimulatePoseCLP.h"
+#include "SimulationCheckpoint.h"
+#include "SimulationFrameWriter.h"
+#include "benderBinaryIO.h"
 #include "benderIOUtils.h"
 #include "vtkQuaternion.h"
 
+// ITK includes
+#include <itkTimeProbe.h>
+#include <itksys/SystemTools.hxx>
+
+// OpenMP includes
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 // OpenGL includes
 //#include <GL/glew.h>
 //#include <GL/glut.h>
@@ -33,6 +45,8 @@
 #include <sofa/component/collision/DefaultCollisionGroupManager.h>
 #include <sofa/component/collision/DefaultContactManager.h>
 #include <sofa/component/collision/DefaultPipeline.h>
+#include <sofa/component/collision/DirectSAP.h>
+#include <sofa/component/collision/IncrSAP.h>
 #include <sofa/component/collision/LineModel.h>
 #include <sofa/component/collision/LocalMinDistance.h>
 #include <sofa/component/collision/MinProximityIntersection.h>
@@ -50,8 +64,10 @@
 #include <sofa/component/projectiveconstraintset/SkeletalMotionConstraint.h>
 #include <sofa/component/topology/MeshTopology.h>
 #include <sofa/component/typedef/Sofa_typedef.h>
+#ifndef SIMULATEPOSE_HEADLESS
 #include <sofa/gui/GUIManager.h>
 #include <sofa/gui/Main.h>
+#endif
 #include <sofa/helper/vector.h>
 #include <sofa/simulation/common/Node.h>
 #include <sofa/simulation/graph/DAGSimulation.h>
@@ -64,7 +80,7 @@
 #include <plugins/Flexible/material/StabilizedNeoHookeanForceField.h>
 
 // SofaCUDA includes
-#ifdef SOFA_CUDA
+#if defined(SOFA_CUDA) && !defined(SIMULATEPOSE_HEADLESS)
 #include <plugins/SofaCUDA/sofa/gpu/cuda/CudaTetrahedronFEMForceField.h>
 #include <plugins/SofaCUDA/sofa/gpu/cuda/CudaCollisionDetection.h>
 #include <plugins/SofaCUDA/sofa/gpu/cuda/CudaMechanicalObject.h>
@@ -85,8 +101,10 @@
 #include <vtkCellDataToPointData.h>
 #include <vtkDataArray.h>
 #include <vtkDataSetSurfaceFilter.h>
+#include <vtkFieldData.h>
 #include <vtkFloatArray.h>
 #include <vtkIdTypeArray.h>
+#include <vtkIntArray.h>
 #include <vtkNew.h>
 #include <vtkPointData.h>
 #include <vtkPolyData.h>
@@ -100,6 +118,13 @@
 #include <vtkMath.h>
 #include <vtkTriangleFilter.h>
 
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <fstream>
+#include <vector>
+
 // ---------------------------------------------------------------------
 // ---
 // ---------------------------------------------------------------------
@@ -116,6 +141,7 @@ using namespace sofa::component::visualmodel;
 using namespace sofa::component::shapefunction;
 using namespace sofa::helper;
 using namespace sofa::simulation;
+using sofa::component::interactionforcefield::StiffSpringForceField;
 
 /// helper function for more compact component creation
 // ---------------------------------------------------------------------
@@ -135,52 +161,121 @@ bool isCellInLabel(vtkIdType cellId, vtkIntArray* materialIds, int filterLabel)
   return materialIds->GetValue(cellId) == filterLabel;
 }
 
+/// Materials of the cells incident to each point.
+/// The materials of a point are stored as a bitmask of the indices of the
+/// materials, it is computed in a single pass over the cells and shared by
+/// all the functions that filter points by label.
+// ---------------------------------------------------------------------
+class PointMaterials
+{
+public:
+  PointMaterials();
+  PointMaterials(vtkPolyData* polyMesh);
+
+  bool IsPointInLabel(vtkIdType pointId, int label) const;
+  vtkIdType CountNumberOfPointsInLabel(int label) const;
+
+  // Binary serialization for the setup cache
+  void Write(std::ostream& stream) const;
+  bool Read(std::istream& stream);
+
+protected:
+  // Return the index of the label in Labels, -1 if not found.
+  int GetLabelIndex(int label) const;
+
+  std::vector<int> Labels;
+  vtkIdType NumberOfPoints;
+  size_t WordsPerPoint;
+  std::vector<vtkTypeUInt64> Masks;
+};
+
+// ---------------------------------------------------------------------
+PointMaterials::PointMaterials()
+  : NumberOfPoints(0), WordsPerPoint(0)
+{
+}
+
 // ---------------------------------------------------------------------
-bool isPointInLabel(vtkIdList* cellIdList, vtkIntArray* materialIds, int filterLabel)
+PointMaterials::PointMaterials(vtkPolyData* polyMesh)
+  : NumberOfPoints(0), WordsPerPoint(0)
 {
-  // Search if the point belongs to a cell that has the material Id filterLabel.
-  for(vtkIdType c = 0; c < cellIdList->GetNumberOfIds(); ++c)
+  vtkIntArray* materialIds = vtkIntArray::SafeDownCast(
+    polyMesh->GetCellData()->GetArray("MaterialId"));
+  if (!polyMesh->GetPoints() || !materialIds)
     {
-    if (materialIds->GetValue(cellIdList->GetId(c)) == filterLabel)
+    std::cerr << "No material ids" << std::endl;
+    return;
+    }
+  this->NumberOfPoints = polyMesh->GetNumberOfPoints();
+
+  // Sorted list of the materials
+  const int* materials = materialIds->GetPointer(0);
+  const vtkIdType numberOfCells = materialIds->GetNumberOfTuples();
+  this->Labels.assign(materials, materials + numberOfCells);
+  std::sort(this->Labels.begin(), this->Labels.end());
+  this->Labels.erase(std::unique(this->Labels.begin(), this->Labels.end()),
+                     this->Labels.end());
+  this->WordsPerPoint = (this->Labels.size() + 63) / 64;
+  this->Masks.resize(this->NumberOfPoints * this->WordsPerPoint, 0);
+
+  // The tetrahedra are stored as polys
+  const vtkIdType firstPolyId =
+    polyMesh->GetNumberOfVerts() + polyMesh->GetNumberOfLines();
+  vtkCellArray* cells = polyMesh->GetPolys();
+  vtkIdType npts = 0;
+  vtkIdType* pts = 0;
+  cells->InitTraversal();
+  for (vtkIdType cellId = firstPolyId;
+       cells->GetNextCell(npts, pts) && cellId < numberOfCells; ++cellId)
+    {
+    const int index = this->GetLabelIndex(materials[cellId]);
+    const size_t word = index / 64;
+    const vtkTypeUInt64 bit = static_cast<vtkTypeUInt64>(1) << (index % 64);
+    for (vtkIdType i = 0; i < npts; ++i)
       {
-      return true;
+      this->Masks[pts[i] * this->WordsPerPoint + word] |= bit;
       }
     }
-  return false;
 }
 
 // ---------------------------------------------------------------------
-bool isPointInLabel(vtkPolyData* polyMesh, int filterLabel, vtkIdType pointId)
+int PointMaterials::GetLabelIndex(int label) const
 {
-  vtkIntArray* materialIds = vtkIntArray::SafeDownCast(
-    polyMesh->GetCellData()->GetArray("MaterialId"));
-  vtkSmartPointer<vtkIdList> cellIdList =
-    vtkSmartPointer<vtkIdList>::New();
-  polyMesh->GetPointCells(pointId, cellIdList);
-  return isPointInLabel(cellIdList, materialIds, filterLabel);
+  std::vector<int>::const_iterator it =
+    std::lower_bound(this->Labels.begin(), this->Labels.end(), label);
+  if (it == this->Labels.end() || *it != label)
+    {
+    return -1;
+    }
+  return static_cast<int>(it - this->Labels.begin());
 }
 
 // ---------------------------------------------------------------------
-vtkIdType countNumberOfPointsInLabel(
-  vtkPolyData* polyMesh, int filterLabel)
+bool PointMaterials::IsPointInLabel(vtkIdType pointId, int label) const
 {
-  vtkIdType count = 0;
+  const int index = this->GetLabelIndex(label);
+  if (index < 0 || pointId < 0 || pointId >= this->NumberOfPoints)
+    {
+    return false;
+    }
+  const vtkTypeUInt64 bit = static_cast<vtkTypeUInt64>(1) << (index % 64);
+  return (this->Masks[pointId * this->WordsPerPoint + index / 64] & bit) != 0;
+}
 
-  vtkPoints* points = polyMesh->GetPoints();
-  vtkIntArray* materialIds = vtkIntArray::SafeDownCast(
-    polyMesh->GetCellData()->GetArray("MaterialId"));
-  if (!points || !materialIds)
+// ---------------------------------------------------------------------
+vtkIdType PointMaterials::CountNumberOfPointsInLabel(int label) const
+{
+  const int index = this->GetLabelIndex(label);
+  if (index < 0)
     {
-    std::cerr << "No material ids" << std::endl;
-    return count;
+    return 0;
     }
-  const vtkIdType numberOfPoints = points->GetNumberOfPoints();
-  vtkSmartPointer<vtkIdList> cellIdList =
-    vtkSmartPointer<vtkIdList>::New();
-  for (vtkIdType i = 0; i < numberOfPoints; ++i)
+  const size_t word = index / 64;
+  const vtkTypeUInt64 bit = static_cast<vtkTypeUInt64>(1) << (index % 64);
+  vtkIdType count = 0;
+  for (vtkIdType i = 0; i < this->NumberOfPoints; ++i)
     {
-    polyMesh->GetPointCells(i, cellIdList);
-    if (isPointInLabel(cellIdList, materialIds, filterLabel))
+    if (this->Masks[i * this->WordsPerPoint + word] & bit)
       {
       ++count;
       }
@@ -188,20 +283,134 @@ vtkIdType countNumberOfPointsInLabel(
   return count;
 }
 
+// ---------------------------------------------------------------------
+void PointMaterials::Write(std::ostream& stream) const
+{
+  bender::BinaryIO::WriteVector(stream, this->Labels);
+  bender::BinaryIO::WriteValue(
+    stream, static_cast<vtkTypeUInt64>(this->NumberOfPoints));
+  bender::BinaryIO::WriteValue(
+    stream, static_cast<vtkTypeUInt64>(this->WordsPerPoint));
+  bender::BinaryIO::WriteVector(stream, this->Masks);
+}
+
+// ---------------------------------------------------------------------
+bool PointMaterials::Read(std::istream& stream)
+{
+  vtkTypeUInt64 numberOfPoints = 0;
+  vtkTypeUInt64 wordsPerPoint = 0;
+  if (!bender::BinaryIO::ReadVector(stream, this->Labels) ||
+      !bender::BinaryIO::ReadValue(stream, numberOfPoints) ||
+      !bender::BinaryIO::ReadValue(stream, wordsPerPoint) ||
+      !bender::BinaryIO::ReadVector(stream, this->Masks))
+    {
+    return false;
+    }
+  this->NumberOfPoints = static_cast<vtkIdType>(numberOfPoints);
+  this->WordsPerPoint = static_cast<size_t>(wordsPerPoint);
+  return this->Masks.size() == numberOfPoints * wordsPerPoint;
+}
+
+/// Material parameters of the cells.
+/// The parameters are either stored per cell in the "MaterialParameters"
+/// cell data array, or once per material in the field data: the
+/// "MaterialParameters" field array has a row per material, keyed by the
+/// "MaterialId" field array, and the cells are resolved by their
+/// "MaterialId" cell data.
+// ---------------------------------------------------------------------
+class CellMaterialParameters
+{
+public:
+  CellMaterialParameters(vtkPolyData* polyMesh);
+
+  bool IsValid() const;
+  // Return the Young modulus of the cell, 0 if its material is unknown.
+  double GetYoungModulus(vtkIdType cellId) const;
+
+protected:
+  vtkDataArray* CellParameters;
+  vtkIntArray* CellMaterialIds;
+  // Sorted material ids of the table and their Young modulus
+  std::vector<int> TableIds;
+  std::vector<double> TableYoungModulus;
+};
+
+// ---------------------------------------------------------------------
+CellMaterialParameters::CellMaterialParameters(vtkPolyData* polyMesh)
+  : CellParameters(0), CellMaterialIds(0)
+{
+  this->CellParameters =
+    polyMesh->GetCellData()->GetArray("MaterialParameters");
+  if (this->CellParameters)
+    {
+    return;
+    }
+  vtkFieldData* fieldData = polyMesh->GetFieldData();
+  vtkDataArray* tableParameters = fieldData->GetArray("MaterialParameters");
+  vtkDataArray* tableIds = fieldData->GetArray("MaterialId");
+  this->CellMaterialIds = vtkIntArray::SafeDownCast(
+    polyMesh->GetCellData()->GetArray("MaterialId"));
+  if (!tableParameters || !tableIds || !this->CellMaterialIds ||
+      tableIds->GetNumberOfTuples() != tableParameters->GetNumberOfTuples())
+    {
+    this->CellMaterialIds = 0;
+    return;
+    }
+  std::vector<std::pair<int, double> > table;
+  for (vtkIdType row = 0; row < tableIds->GetNumberOfTuples(); ++row)
+    {
+    table.push_back(std::make_pair(
+      static_cast<int>(tableIds->GetComponent(row, 0)),
+      tableParameters->GetComponent(row, 0)));
+    }
+  std::sort(table.begin(), table.end());
+  for (size_t i = 0; i < table.size(); ++i)
+    {
+    this->TableIds.push_back(table[i].first);
+    this->TableYoungModulus.push_back(table[i].second);
+    }
+}
+
+// ---------------------------------------------------------------------
+bool CellMaterialParameters::IsValid() const
+{
+  return this->CellParameters != 0 || this->CellMaterialIds != 0;
+}
+
+// ---------------------------------------------------------------------
+double CellMaterialParameters::GetYoungModulus(vtkIdType cellId) const
+{
+  if (this->CellParameters)
+    {
+    return this->CellParameters->GetComponent(cellId, 0);
+    }
+  if (!this->CellMaterialIds)
+    {
+    return 0.;
+    }
+  const int id = this->CellMaterialIds->GetValue(cellId);
+  std::vector<int>::const_iterator it =
+    std::lower_bound(this->TableIds.begin(), this->TableIds.end(), id);
+  if (it == this->TableIds.end() || *it != id)
+    {
+    return 0.;
+    }
+  return this->TableYoungModulus[it - this->TableIds.begin()];
+}
 
 // Copy point positions from vtk to a mechanical object
 // ---------------------------------------------------------------------
 std::map<vtkIdType, vtkIdType> copyVertices( vtkPoints* points,
                                              MechanicalObject<Vec3Types>* mechanicalMesh,
                                              int filter = 0, int label = 0,
-                                             vtkPolyData* polyMesh = 0)
+                                             const PointMaterials* materials = 0)
 {
   std::map<vtkIdType,vtkIdType> m;
   vtkIdType numberOfPoints = points->GetNumberOfPoints();
-  if (filter > 0 && polyMesh != 0)
+  if (filter > 0 && materials != 0)
     {
     vtkIdType numberOfPointWithLabel =
-      countNumberOfPointsInLabel(polyMesh, label);
+      materials->CountNumberOfPointsInLabel(label);
     numberOfPoints = (filter == 2) ? numberOfPoints - numberOfPointWithLabel :
       numberOfPointWithLabel;
     }
@@ -228,8 +437,9 @@ std::map<vtkIdType, vtkIdType> copyVertices( vtkPoints* points,
 
   for(vtkIdType i = 0, end = points->GetNumberOfPoints(); i < end; ++i)
     {
-    if ((filter == 1 && !isPointInLabel(polyMesh, label, i)) ||
-        (filter == 2 && isPointInLabel(polyMesh, label, i)) )
+    if (materials &&
+        ((filter == 1 && !materials->IsPointInLabel(i, label)) ||
+         (filter == 2 && materials->IsPointInLabel(i, label))) )
       {
       continue;
       }
@@ -386,8 +596,13 @@ void addCollisionModels(Node::SPtr                      collisionNode,
 }
 
 // Create collision pipeline
+// The broad phase detection can be "BruteForce" (all the pairs of bounding
+// boxes are tested), "DirectSAP" or "IncrSAP" (sweep and prune, only the
+// boxes that overlap along the sorted axes are tested).
 //--------------------------------------------------------------------------
-Node::SPtr createRootWithCollisionPipeline(const std::string& responseType = std::string(
+Node::SPtr createRootWithCollisionPipeline(const std::string& broadPhase = std::string(
+                                             "BruteForce"),
+                                           const std::string& responseType = std::string(
                                              "default"))
 {
   //   typedef LocalMinDistance ProximityIntersectionType;
@@ -400,7 +615,23 @@ Node::SPtr createRootWithCollisionPipeline(const std::string& responseType = std
     addNew<DefaultPipeline>(root, "Collision Pipeline");
 
   //--> adding collision detection system
-  addNew<BruteForceDetection>(root,"Detection");
+  if (broadPhase == "DirectSAP")
+    {
+    addNew<DirectSAP>(root,"Detection");
+    }
+  else if (broadPhase == "IncrSAP")
+    {
+    addNew<IncrSAP>(root,"Detection");
+    }
+  else
+    {
+    if (broadPhase != "BruteForce")
+      {
+      std::cerr << "Error: " << broadPhase
+                << " broad phase not recognized, use BruteForce." << std::endl;
+      }
+    addNew<BruteForceDetection>(root,"Detection");
+    }
 
   //--> adding contact manager
   addNew<DefaultContactManager>(root,"Contact Manager");
@@ -418,6 +649,7 @@ Node::SPtr createRootWithCollisionPipeline(const std::string& responseType = std
 }
 
 
+#ifndef SIMULATEPOSE_HEADLESS
 /// Visualization node (for debug purposes only)
 // ---------------------------------------------------------------------
 Node::SPtr createVisualNode(Node *                        parentNode,
@@ -473,6 +705,7 @@ Node::SPtr createVisualNode(Node *                        parentNode,
 
   return visualNode;
 }
+#endif
 
 // Fill armature joints - rest and final positions
 // ---------------------------------------------------------------------
@@ -802,20 +1035,52 @@ bool WIComp(const std::pair<double, int>& left, const std::pair<double, int>& ri
 }
 
 //-------------------------------------------------------------------------------
-vtkPoints* poseMesh(vtkPolyData* mesh, vtkPolyData* armature,
-                    bool invertXY = true, double coef = 1.,
-                    bool verbose = true)
+/// Skinning of a mesh by an armature, computed once and reused for each
+/// armature step.
+/// The transform of each point is the blend of the dual quaternions of its
+/// MaximumNumberOfInterpolatedBones most weighted bones. A pose at coef is
+/// obtained by scaling that transform by coef, which scales the displacement
+/// of the point by coef^2. Only the rest positions and the displacements at
+/// coef 1 are kept, posing is then proportional to the number of points.
+class MeshSkinning
+{
+public:
+  MeshSkinning();
+  MeshSkinning(vtkPolyData* mesh, vtkPolyData* armature,
+               bool invertXY = true, bool verbose = true);
+
+  size_t GetNumberOfPoints() const;
+
+  void Pose(double coef,
+            MechanicalObject<Vec3Types>::VecCoord& positions) const;
+  void Pose(double coef, vtkPoints* points) const;
+
+  // Binary serialization for the setup cache
+  void Write(std::ostream& stream) const;
+  bool Read(std::istream& stream);
+
+protected:
+  inline Vector3 PosePoint(size_t pointId, double coef) const;
+
+  std::vector<Vector3> RestPositions;
+  std::vector<Vector3> Displacements;
+};
+
+//-------------------------------------------------------------------------------
+MeshSkinning::MeshSkinning()
+{
+}
+
+//-------------------------------------------------------------------------------
+MeshSkinning::MeshSkinning(vtkPolyData* mesh, vtkPolyData* armature,
+                           bool invertXY, bool verbose)
 {
   const size_t MaximumNumberOfInterpolatedBones = 4;
-  coef = std::min (1., std::max(0., coef));
   if (verbose)
     {
-    std::cout << "Pose mesh for frame: " << coef << std::endl;
+    std::cout << "Skin mesh" << std::endl;
     std::cout << "  Number of mesh points: " << mesh->GetNumberOfPoints() << std::endl;
     }
-  vtkPoints* outPoints = vtkPoints::New();
-  outPoints->Allocate(mesh->GetNumberOfPoints());
-  outPoints->SetNumberOfPoints(mesh->GetNumberOfPoints());
 
   //----------------------------
   // Read armature
@@ -841,11 +1106,9 @@ vtkPoints* poseMesh(vtkPolyData* mesh, vtkPolyData* armature,
   while(armatureSegments->GetNextCell(cell.GetPointer()))
     {
     vtkIdType a = cell->GetId(0);
-    vtkIdType b = cell->GetId(1);
 
-    double ax[3], bx[3];
+    double ax[3];
     armature->GetPoints()->GetPoint(a, ax);
-    armature->GetPoints()->GetPoint(b, bx);
 
     RigidTransform transform;
     GetArmatureTransform(armature, edgeId, "Transforms", ax, transform, invertXY);
@@ -882,7 +1145,7 @@ vtkPoints* poseMesh(vtkPolyData* mesh, vtkPolyData* armature,
   vtkPoints* inputPoints = mesh->GetPoints();
   int numPoints = mesh->GetNumberOfPoints();
 
-  std::vector<vtkFloatArray*> surfaceVertexWeights;
+  std::vector<float*> surfaceVertexWeights;
   if (verbose)
     {
     std::cout<<"Trying to use the " << numSites
@@ -897,7 +1160,6 @@ vtkPoints* poseMesh(vtkPolyData* mesh, vtkPolyData* armature,
 
     if (!weightArray || weightArray->GetNumberOfTuples() != numPoints)
       {
-      //surfaceVertexWeights.clear();
       numWeights = i;
 
       std::cerr<<"Could not find field array for weight " << i << std::endl;
@@ -905,178 +1167,173 @@ vtkPoints* poseMesh(vtkPolyData* mesh, vtkPolyData* armature,
       }
     else
       {
-      surfaceVertexWeights.push_back(weightArray);
+      surfaceVertexWeights.push_back(weightArray->GetPointer(0));
       }
     }
 
-  const size_t maximumNumberOfInterpolatedBones =
-    std::min(MaximumNumberOfInterpolatedBones, numWeights - 1);
+  const size_t maximumNumberOfInterpolatedBones = numWeights > 0 ?
+    std::min(MaximumNumberOfInterpolatedBones, numWeights - 1) : 0;
   // This property controls whether to interpolate with ScLerp
   // (Screw Linear interpolation) or DLB (Dual Quaternion Linear
   // Blending).
   // Note that DLB (faster) is not tweaked to give proper results.
   const bool UseScLerp = true;
 
-  if (verbose)
-    {
-    std::cout << "  Pose " << numPoints << "points" << std::endl;
-    }
-
   //----------------------------
-  // Pose
+  // Skin
   //----------------------------
+  this->RestPositions.resize(numPoints);
+  this->Displacements.resize(numPoints, Vector3(0., 0., 0.));
+  std::vector<std::pair<double, int> > ws(numWeights);
   for (vtkIdType pi = 0; pi < numPoints; ++pi)
     {
-
     double xraw[3];
     inputPoints->GetPoint(pi,xraw);
+    this->RestPositions[pi] = Vector3(xraw[0], xraw[1], xraw[2]);
 
     double wSum = 0.0;
     for (size_t i = 0; i < numWeights; ++i)
       {
-      wSum += surfaceVertexWeights[i]->GetValue(pi);
+      wSum += surfaceVertexWeights[i][pi];
       }
 
-    Vec3 y(0.0);
-    if (wSum <= 0.0) // shortcut
+    if (wSum <= 0.0 || maximumNumberOfInterpolatedBones == 0) // shortcut
       {
-      y = xraw;
+      continue;
       }
-    else
+
+    for (size_t i=0; i < numWeights; ++i)
       {
-      bool LinearBlend = false;
-      if (LinearBlend)
+      ws[i] = std::make_pair(surfaceVertexWeights[i][pi] / wSum,
+                             static_cast<int>(i));
+      }
+    // To limit computation errors, it is important to start interpolating with the
+    // highest w first.
+    std::partial_sort(ws.begin(),
+                      ws.begin() + maximumNumberOfInterpolatedBones,
+                      ws.end(),
+                      WIComp);
+    vtkDualQuaternion<double> transform = dqs[ws[0].second];
+    double w = ws[0].first;
+    // Warning, Sclerp is only meant to blend 2 DualQuaternions, I'm not
+    // sure it works with more than 2.
+    for (size_t i=1; i < maximumNumberOfInterpolatedBones; ++i)
+      {
+      double w2 = ws[i].first;
+      int i2 = ws[i].second;
+      if (UseScLerp)
         {
-        for (size_t i = 0; i < numWeights; ++i)
-          {
-          double w = surfaceVertexWeights[i]->GetValue(pi) / wSum;
-          double yi[3];
-          const vtkDualQuaternion<double>& transform(dqs[i]);
-          transform.TransformPoint(xraw, yi);
-          vtkDualQuaternion<double> t = transform * coef;
-          t.TransformPoint(xraw, yi);
-          y += w*Vec3(yi);
-          }
+        transform = transform.ScLerp2(w2 / (w + w2), dqs[i2]);
         }
       else
         {
-        std::vector<std::pair<double, int> > ws;
-        for (size_t i=0; i < numWeights; ++i)
-          {
-          double w = surfaceVertexWeights[i]->GetValue(pi) / wSum;
-          ws.push_back(std::make_pair(w, i));
-          }
-        // To limit computation errors, it is important to start interpolating with the
-        // highest w first.
-        std::partial_sort(ws.begin(),
-                          ws.begin() + maximumNumberOfInterpolatedBones,
-                          ws.end(),
-                          WIComp);
-        vtkDualQuaternion<double> transform = dqs[ws[0].second];
-        double w = ws[0].first;
-        // Warning, Sclerp is only meant to blend 2 DualQuaternions, I'm not
-        // sure it works with more than 2.
-        for (size_t i=1; i < maximumNumberOfInterpolatedBones; ++i)
-          {
-          double w2 = ws[i].first;
-          int i2 = ws[i].second;
-          vtkDualQuaternion<double> dq;
-          if (UseScLerp)
-            {
-            dq = transform.ScLerp2(w2 / (w + w2), dqs[i2]);
-            // vtkDualQuaternion<double> dq2 = dqs[i2].ScLerp2(w/ (w + w2), dq);
-            // vtkDualQuaternion<double> dq3 = dq.ScLerp(w2/ (w + w2), dqs[i2]);
-            // vtkDualQuaternion<double> dq4 = dqs[i2].ScLerp(w/ (w + w2), dq);
-            }
-          else
-            {
-            dq = transform.Lerp(w2 / (w + w2), dqs[i2]);
-            }
-          transform = dq;
-          w += w2;
-          }
-        transform = transform * coef;
-        transform.TransformPoint(xraw, &y[0]);
+        transform = transform.Lerp(w2 / (w + w2), dqs[i2]);
         }
+      w += w2;
       }
+    double y[3];
+    transform.TransformPoint(xraw, y);
+    this->Displacements[pi] = Vector3(y[0], y[1], y[2]) - this->RestPositions[pi];
+    }
+}
 
-    //bool IsSurfaceInRAS = invertXY;
-    //if (!IsSurfaceInRAS)
-    //  {
-      //InvertXY(y);
-    //  }
-    outPoints->SetPoint(pi,y[0],y[1],y[2]);
+//-------------------------------------------------------------------------------
+size_t MeshSkinning::GetNumberOfPoints() const
+{
+  return this->RestPositions.size();
+}
+
+//-------------------------------------------------------------------------------
+Vector3 MeshSkinning::PosePoint(size_t pointId, double coef) const
+{
+  // Dual quaternion scaled by coef: both the rotation and translation terms
+  // of the displacement are scaled by coef^2.
+  return this->RestPositions[pointId] + this->Displacements[pointId] * (coef * coef);
+}
+
+//-------------------------------------------------------------------------------
+void MeshSkinning::Pose(double coef,
+                        MechanicalObject<Vec3Types>::VecCoord& positions) const
+{
+  coef = std::min (1., std::max(0., coef));
+  const long numberOfPoints = static_cast<long>(
+    std::min(this->GetNumberOfPoints(), static_cast<size_t>(positions.size())));
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (long i = 0; i < numberOfPoints; ++i)
+    {
+    positions[i] = this->PosePoint(i, coef);
     }
-  if (verbose)
+}
+
+//-------------------------------------------------------------------------------
+void MeshSkinning::Pose(double coef, vtkPoints* points) const
+{
+  coef = std::min (1., std::max(0., coef));
+  const size_t numberOfPoints = this->GetNumberOfPoints();
+  points->SetNumberOfPoints(numberOfPoints);
+  for (size_t i = 0; i < numberOfPoints; ++i)
     {
-    std::cout << "  outPoints: " << outPoints << " -> "
-              << outPoints->GetNumberOfPoints() << std::endl;
+    Vector3 y = this->PosePoint(i, coef);
+    points->SetPoint(i, y[0], y[1], y[2]);
     }
-  return outPoints;
+}
+
+//-------------------------------------------------------------------------------
+void MeshSkinning::Write(std::ostream& stream) const
+{
+  bender::BinaryIO::WriteVector(stream, this->RestPositions);
+  bender::BinaryIO::WriteVector(stream, this->Displacements);
+}
+
+//-------------------------------------------------------------------------------
+bool MeshSkinning::Read(std::istream& stream)
+{
+  return bender::BinaryIO::ReadVector(stream, this->RestPositions) &&
+    bender::BinaryIO::ReadVector(stream, this->Displacements) &&
+    this->RestPositions.size() == this->Displacements.size();
 }
 
 //------------------------------------------------------------------------------
 void poseMechanicalObject(
   MechanicalObject<Vec3Types>::SPtr mechanicalObject,
-  vtkPolyData* mesh,
-  vtkPolyData* armature, bool invertArmatureXY,
+  const MeshSkinning& skinning,
   double coef = 1.0)
 {
-  vtkPoints* posedPoints = poseMesh(mesh, armature, invertArmatureXY,
-                                    coef, /*verbose= */false);
-
-  size_t numberOfPoints = posedPoints->GetNumberOfPoints();
   Data<MechanicalObject<Vec3Types>::VecCoord> *x =
     mechanicalObject->write(VecCoordId::position());
 
   MechanicalObject<Vec3Types>::VecCoord &vertices = *x->beginEdit();
-
-  for(size_t i = 0; i < numberOfPoints; ++i)
-    {
-    Vector3 point;
-    posedPoints->GetPoint(i, point.ptr());
-    vertices[i] = point;
-    }
+  skinning.Pose(coef, vertices);
   x->endEdit();
-  posedPoints->Delete();
 }
 
 // ---------------------------------------------------------------------
 MechanicalObject<Vec3Types>::SPtr createGhostMesh(
   Node *       parentNode,
-  vtkPolyData *armature,
-  vtkPolyData* mesh,
+  const MeshSkinning& skinning,
   Vector6 &box,
-  bool         invertXY = true,
   double frame = 1.
   )
 {
-
-  vtkPoints* posedPoints = poseMesh(mesh, armature, invertXY, frame);
+  std::cout << "Pose mesh for frame: " << frame << std::endl;
   MechanicalObject<Vec3Types>::SPtr ghostMesh =
     addNew<MechanicalObject<Vec3Types> >(parentNode, "ghostMesh");
 
   // Get bone positions
 
-  size_t numberOfPoints = posedPoints->GetNumberOfPoints();
+  size_t numberOfPoints = skinning.GetNumberOfPoints();
   std::cout << "Number of points: " << numberOfPoints << std::endl;
 
   ghostMesh->resize(numberOfPoints);
-  Data<MechanicalObject<Vec3Types>::VecCoord> *x =
-    ghostMesh->write(VecCoordId::position());
-
-  MechanicalObject<Vec3Types>::VecCoord &vertices = *x->beginEdit();
-  for(size_t i = 0; i < numberOfPoints; ++i)
-    {
-    Vector3 point;
-    posedPoints->GetPoint(i, point.ptr());
-    vertices[i] = point;
-    }
-  x->endEdit();
+  poseMechanicalObject(ghostMesh, skinning, frame);
 
   UniformMass3::SPtr frameMass = addNew<UniformMass3>(parentNode,"FrameMass");
   frameMass->setTotalMass(1);
 
+  vtkNew<vtkPoints> posedPoints;
+  skinning.Pose(frame, posedPoints.GetPointer());
   posedPoints->ComputeBounds();
   double bounds[6];
   posedPoints->GetBounds(bounds);
@@ -1088,7 +1345,6 @@ MechanicalObject<Vec3Types>::SPtr createGhostMesh(
   box[4] = bounds[3];
   box[5] = bounds[5];
 
-  posedPoints->Delete();
   return ghostMesh;
 }
 
@@ -1154,6 +1410,7 @@ void createFiniteElementModel(Node* parentNode, bool linearFEM,
 // ---------------------------------------------------------------------
 MechanicalObject<Vec3Types>::SPtr loadBoneMesh(Node*               parentNode,
                                                vtkPolyData *       polyMesh,
+                                               const PointMaterials& materials,
                                                int                 boneLabel = 209)
 {
   // load mesh
@@ -1173,7 +1430,7 @@ MechanicalObject<Vec3Types>::SPtr loadBoneMesh(Node*               parentNode,
     addNew<MechanicalObject<Vec3Types> >(parentNode,meshName.str());
 
   std::map<vtkIdType, vtkIdType> m =
-    copyVertices(points.GetPointer(),mechanicalMesh.get(), /*filter =*/1, boneLabel, polyMesh);
+    copyVertices(points.GetPointer(),mechanicalMesh.get(), /*filter =*/1, boneLabel, &materials);
 
   // Create the MeshTopology
   MeshTopology::SPtr meshTopology = addNew<MeshTopology>(parentNode,"BoneTopology");
@@ -1223,17 +1480,16 @@ MechanicalObject<Vec3Types>::SPtr loadBoneMesh(Node*               parentNode,
 MechanicalObject<Vec3Types>::SPtr loadMesh(Node*               parentNode,
                                            vtkPolyData *       polyMesh,
                                            Vec3Types::VecReal &youngModulus,
-                                           int                 boneLabel = -1
+                                           int                 boneLabel = -1,
+                                           const PointMaterials* materials = 0
                                            )
 {
   // load mesh
   vtkSmartPointer<vtkPoints>    points;
   vtkSmartPointer<vtkCellArray> tetras;
-  vtkSmartPointer<vtkCellData>  data;
 
   points = polyMesh->GetPoints();
   tetras = polyMesh->GetPolys();
-  data   = polyMesh->GetCellData();
 
   std::stringstream meshName;
   meshName << "Mesh";
@@ -1244,7 +1500,7 @@ MechanicalObject<Vec3Types>::SPtr loadMesh(Node*               parentNode,
 
   std::map<vtkIdType, vtkIdType> skinMap =
     copyVertices(points.GetPointer(),mechanicalMesh.get(),
-                 /*filter=*/ boneLabel >= 0 ? 2 : 0, boneLabel, polyMesh);
+                 /*filter=*/ boneLabel >= 0 ? 2 : 0, boneLabel, materials);
 
   // Create the MeshTopology
   MeshTopology::SPtr meshTopology = addNew<MeshTopology>(parentNode, "Topology");
@@ -1261,8 +1517,8 @@ MechanicalObject<Vec3Types>::SPtr loadMesh(Node*               parentNode,
 
   tetras->InitTraversal();
 
-  vtkDataArray* materialParameters = data->GetArray("MaterialParameters");
-  if (!materialParameters)
+  CellMaterialParameters materialParameters(polyMesh);
+  if (!materialParameters.IsValid())
     {
     std::cerr << "Error: No material parameters data array in mesh" << std::endl;
     }
@@ -1277,14 +1533,197 @@ MechanicalObject<Vec3Types>::SPtr loadMesh(Node*               parentNode,
       }
 
     tetrahedra.push_back(MeshTopology::Tetra(element->GetId(0), element->GetId(1), element->GetId(2), element->GetId(3)));
-    if (materialParameters)
+    if (materialParameters.IsValid())
+      {
+      youngModulus.push_back(materialParameters.GetYoungModulus(cellId));
+      }
+    }
+  meshTopology->seqTetrahedra.endEdit();
+  return mechanicalMesh;
+}
+
+/// Return the id of the proxy grid cell that contains the point.
+// ---------------------------------------------------------------------
+vtkIdType getProxyCellId(const double point[3], const double origin[3],
+                         double cellSize, const int dimensions[3])
+{
+  int index[3];
+  for (int i = 0; i < 3; ++i)
+    {
+    index[i] = static_cast<int>((point[i] - origin[i]) / cellSize);
+    index[i] = std::max(0, std::min(dimensions[i] - 1, index[i]));
+    }
+  return (static_cast<vtkIdType>(index[2]) * dimensions[1] + index[1])
+    * dimensions[0] + index[0];
+}
+
+/// Create a coarse tetrahedral mesh (proxy) that embeds the points of the
+/// tetrahedral polymesh. The bounds of the mesh are split into a grid of
+/// cubic cells, resolution cells along the largest side, and each cell
+/// that contains points is split into 6 tetrahedra. The Young modulus of a
+/// tetrahedron is the mean Young modulus of the polymesh tetrahedra centered
+/// in its cell.
+// ---------------------------------------------------------------------
+MechanicalObject<Vec3Types>::SPtr createProxyMesh(Node*               parentNode,
+                                                  vtkPolyData *       polyMesh,
+                                                  int                 resolution,
+                                                  Vec3Types::VecReal &youngModulus)
+{
+  vtkPoints* points = polyMesh->GetPoints();
+  points->ComputeBounds();
+  double bounds[6];
+  points->GetBounds(bounds);
+
+  double origin[3];
+  double largestSide = 0.;
+  for (int i = 0; i < 3; ++i)
+    {
+    origin[i] = bounds[2*i];
+    largestSide = std::max(largestSide, bounds[2*i+1] - bounds[2*i]);
+    }
+  resolution = std::max(1, resolution);
+  const double cellSize = largestSide > 0. ? largestSide / resolution : 1.;
+  int dimensions[3];
+  for (int i = 0; i < 3; ++i)
+    {
+    dimensions[i] = std::max(1, static_cast<int>(
+      ceil((bounds[2*i+1] - bounds[2*i]) / cellSize)));
+    }
+  const vtkIdType numberOfCells =
+    static_cast<vtkIdType>(dimensions[0]) * dimensions[1] * dimensions[2];
+
+  // Cells that contain points are part of the proxy
+  std::vector<bool> isCellUsed(numberOfCells, false);
+  const vtkIdType numberOfPoints = points->GetNumberOfPoints();
+  for (vtkIdType pointId = 0; pointId < numberOfPoints; ++pointId)
+    {
+    double point[3];
+    points->GetPoint(pointId, point);
+    isCellUsed[getProxyCellId(point, origin, cellSize, dimensions)] = true;
+    }
+
+  // Accumulate the Young modulus of the tetrahedra in each cell
+  std::vector<double> modulusSums(numberOfCells, 0.);
+  std::vector<int> modulusCounts(numberOfCells, 0);
+  double totalModulus = 0.;
+  vtkIdType totalCount = 0;
+  CellMaterialParameters materialParameters(polyMesh);
+  if (!materialParameters.IsValid())
+    {
+    std::cerr << "Error: No material parameters data array in mesh" << std::endl;
+    }
+  vtkCellArray* tetras = polyMesh->GetPolys();
+  tetras->InitTraversal();
+  vtkIdType npts = 0;
+  vtkIdType* pts = 0;
+  for (vtkIdType cellId = 0; materialParameters.IsValid() &&
+       tetras->GetNextCell(npts, pts); ++cellId)
+    {
+    if (npts != 4)
       {
-      double parameters[2] = {0};
-      materialParameters->GetTuple(cellId, parameters);
-      youngModulus.push_back(parameters[0]);
+      continue;
+      }
+    double center[3] = {0., 0., 0.};
+    for (int i = 0; i < 4; ++i)
+      {
+      double point[3];
+      points->GetPoint(pts[i], point);
+      vtkMath::Add(center, point, center);
+      }
+    vtkMath::MultiplyScalar(center, 0.25);
+    const double modulus = materialParameters.GetYoungModulus(cellId);
+    const vtkIdType proxyCellId =
+      getProxyCellId(center, origin, cellSize, dimensions);
+    modulusSums[proxyCellId] += modulus;
+    ++modulusCounts[proxyCellId];
+    totalModulus += modulus;
+    ++totalCount;
+    }
+  const double meanModulus = totalCount ? totalModulus / totalCount : 0.;
+
+  // Create the vertices of the used cells, shared between the cells
+  MechanicalObject<Vec3Types>::SPtr mechanicalMesh =
+    addNew<MechanicalObject<Vec3Types> >(parentNode, "ProxyMesh");
+  MeshTopology::SPtr meshTopology =
+    addNew<MeshTopology>(parentNode, "ProxyTopology");
+  meshTopology->seqPoints.setParent(&mechanicalMesh->x);
+
+  const int nodeDimensions[3] =
+    {dimensions[0] + 1, dimensions[1] + 1, dimensions[2] + 1};
+  std::vector<vtkIdType> nodeIds(static_cast<size_t>(nodeDimensions[0]) *
+                                 nodeDimensions[1] * nodeDimensions[2], -1);
+  MechanicalObject<Vec3Types>::VecCoord vertices;
+  MeshTopology::SeqTetrahedra& tetrahedra =
+    *meshTopology->seqTetrahedra.beginEdit();
+
+  // Kuhn subdivision: the 6 tetrahedra share the diagonal from corner 0 to
+  // corner 7 and go through the corners along the axes in each order.
+  // Corners are indexed by (x | y << 1 | z << 2).
+  const int axisOrders[6][3] =
+    {{0, 1, 2}, {1, 2, 0}, {2, 0, 1}, {0, 2, 1}, {2, 1, 0}, {1, 0, 2}};
+  for (int k = 0; k < dimensions[2]; ++k)
+    {
+    for (int j = 0; j < dimensions[1]; ++j)
+      {
+      for (int i = 0; i < dimensions[0]; ++i)
+        {
+        const vtkIdType cellId =
+          (static_cast<vtkIdType>(k) * dimensions[1] + j) * dimensions[0] + i;
+        if (!isCellUsed[cellId])
+          {
+          continue;
+          }
+        vtkIdType corners[8];
+        for (int corner = 0; corner < 8; ++corner)
+          {
+          const int ci = i + (corner & 1);
+          const int cj = j + ((corner >> 1) & 1);
+          const int ck = k + ((corner >> 2) & 1);
+          vtkIdType& nodeId = nodeIds[
+            (static_cast<size_t>(ck) * nodeDimensions[1] + cj)
+            * nodeDimensions[0] + ci];
+          if (nodeId < 0)
+            {
+            nodeId = static_cast<vtkIdType>(vertices.size());
+            vertices.push_back(Vector3(origin[0] + ci * cellSize,
+                                       origin[1] + cj * cellSize,
+                                       origin[2] + ck * cellSize));
+            }
+          corners[corner] = nodeId;
+          }
+        const double modulus = modulusCounts[cellId] ?
+          modulusSums[cellId] / modulusCounts[cellId] : meanModulus;
+        for (int t = 0; t < 6; ++t)
+          {
+          const int first = 1 << axisOrders[t][0];
+          const int second = first | (1 << axisOrders[t][1]);
+          // Odd permutations are swapped to keep a positive orientation
+          if (t < 3)
+            {
+            tetrahedra.push_back(MeshTopology::Tetra(
+              corners[0], corners[first], corners[second], corners[7]));
+            }
+          else
+            {
+            tetrahedra.push_back(MeshTopology::Tetra(
+              corners[0], corners[second], corners[first], corners[7]));
+            }
+          youngModulus.push_back(modulus);
+          }
+        }
       }
     }
   meshTopology->seqTetrahedra.endEdit();
+
+  mechanicalMesh->resize(vertices.size());
+  Data<MechanicalObject<Vec3Types>::VecCoord>* x =
+    mechanicalMesh->write(VecCoordId::position());
+  *x->beginEdit() = vertices;
+  x->endEdit();
+
+  std::cout << "Proxy mesh: " << vertices.size() << " points, "
+            << tetrahedra.size() << " tetrahedra (cell size: " << cellSize
+            << ")" << std::endl;
   return mechanicalMesh;
 }
 
@@ -1294,6 +1733,7 @@ void skinBoneMesh(Node *                              parentNode,
                   MechanicalObject<Vec3Types>::SPtr   mechanicalObject,
                   vtkPolyData *                       armature,
                   vtkPolyData *                       polyMesh,
+                  const PointMaterials&               materials,
                   int                                 boneLabel = 203
 )
 {
@@ -1321,18 +1761,12 @@ void skinBoneMesh(Node *                              parentNode,
   sofa::helper::vector<float>                                 weightSum;
 
   vtkIdType numberOfPoints = points->GetNumberOfPoints();
-  vtkIdType numberOfBonePoints = countNumberOfPointsInLabel(polyMesh, boneLabel);
+  vtkIdType numberOfBonePoints = materials.CountNumberOfPointsInLabel(boneLabel);
   indices.resize(numberOfBonePoints);
   weights.resize(numberOfBonePoints);
   nbIds.resize(numberOfBonePoints,0);
   weightSum.resize(numberOfBonePoints, 0.);
 
-  vtkIntArray* materialIds = vtkIntArray::SafeDownCast(
-    polyMesh->GetCellData()->GetArray("MaterialId"));
-  std::cout << "Material IDS: " << materialIds << std::endl;
-
-  vtkSmartPointer<vtkIdList> cellIdList =
-    vtkSmartPointer<vtkIdList>::New();
   for(vtkIdType boneId = 0; boneId < numberOfBones; ++boneId)
     {
     vtkFloatArray *weightArray = vtkFloatArray::SafeDownCast(pointData->GetArray(boneId));
@@ -1345,8 +1779,7 @@ void skinBoneMesh(Node *                              parentNode,
     vtkIdType meshPointId = 0;
     for (vtkIdType pointId = 0; pointId < numberOfPoints; ++pointId)
       {
-      polyMesh->GetPointCells(pointId, cellIdList);
-      if (!isPointInLabel(cellIdList, materialIds, boneLabel))
+      if (!materials.IsPointInLabel(pointId, boneLabel))
         {
         continue;
         }
@@ -1715,8 +2148,29 @@ void initMesh(vtkPolyData* outputPolyData, vtkPolyData* inputPolyData,
 }
 
 //------------------------------------------------------------------------------
+/// Copy the positions of the mechanical object into a flat array of
+/// coordinates.
+void copyPositions(MechanicalObject<Vec3Types>::SPtr mesh,
+                   std::vector<float>& positions)
+{
+  const MechanicalObject<Vec3Types>::VecCoord& vertices =
+    mesh->read(VecCoordId::position())->getValue();
+  positions.resize(3 * vertices.size());
+  for (size_t i = 0; i < vertices.size(); ++i)
+    {
+    positions[3 * i] = static_cast<float>(vertices[i][0]);
+    positions[3 * i + 1] = static_cast<float>(vertices[i][1]);
+    positions[3 * i + 2] = static_cast<float>(vertices[i][2]);
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Mean square distance between the vertices of the two meshes.
+/// If maximumNumberOfSamples is not 0, the error is estimated on a regular
+/// subsampling of the vertices.
 double meanSquareError(MechanicalObject<Vec3Types>::SPtr mesh1,
-                       MechanicalObject<Vec3Types>::SPtr mesh2)
+                       MechanicalObject<Vec3Types>::SPtr mesh2,
+                       size_t maximumNumberOfSamples = 0)
 {
   const Data<MechanicalObject<Vec3Types>::VecCoord>* position1 =
     mesh1->read(VecCoordId::position());
@@ -1740,17 +2194,245 @@ double meanSquareError(MechanicalObject<Vec3Types>::SPtr mesh1,
     return -1.;
     }
 
+  size_t stride = 1;
+  if (maximumNumberOfSamples > 0 && numberOfPoints > maximumNumberOfSamples)
+    {
+    stride = (numberOfPoints + maximumNumberOfSamples - 1) / maximumNumberOfSamples;
+    }
+  const long numberOfSamples =
+    static_cast<long>((numberOfPoints + stride - 1) / stride);
   double error = 0.;
-  MechanicalObject<Vec3Types>::VecCoord::const_iterator it1;
-  MechanicalObject<Vec3Types>::VecCoord::const_iterator it2;
-  for(it1 = vertices1.begin(), it2 = vertices2.begin();
-      it1 != vertices1.end();
-      ++it1, ++it2)
+#ifdef _OPENMP
+#pragma omp parallel for reduction(+:error)
+#endif
+  for (long sample = 0; sample < numberOfSamples; ++sample)
+    {
+    const size_t i = sample * stride;
+    Vector3 distance = vertices1[i] - vertices2[i];
+    error += distance.norm2();
+    }
+  return numberOfSamples ? error / numberOfSamples : 0.;
+}
+
+//------------------------------------------------------------------------------
+/// Compute the kinetic energy and the maximum vertex velocity of the mesh.
+/// The mass is uniformly distributed between the vertices.
+void computeKineticState(MechanicalObject<Vec3Types>::SPtr mesh,
+                         double totalMass,
+                         double& kineticEnergy, double& maximumVelocity)
+{
+  kineticEnergy = 0.;
+  maximumVelocity = 0.;
+  const Data<MechanicalObject<Vec3Types>::VecDeriv>* velocity =
+    mesh->read(VecDerivId::velocity());
+  if (!velocity)
+    {
+    return;
+    }
+  const MechanicalObject<Vec3Types>::VecDeriv& velocities = velocity->getValue();
+  if (velocities.empty())
+    {
+    return;
+    }
+  const long numberOfPoints = static_cast<long>(velocities.size());
+  double energy = 0.;
+  double maximumNorm2 = 0.;
+  // No max reduction in OpenMP 2.0, each thread keeps its own maximum.
+#ifdef _OPENMP
+#pragma omp parallel reduction(+:energy)
+#endif
+  {
+  double threadMaximumNorm2 = 0.;
+#ifdef _OPENMP
+#pragma omp for
+#endif
+  for (long i = 0; i < numberOfPoints; ++i)
+    {
+    const double norm2 = velocities[i].norm2();
+    energy += norm2;
+    threadMaximumNorm2 = std::max(threadMaximumNorm2, norm2);
+    }
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+  maximumNorm2 = std::max(maximumNorm2, threadMaximumNorm2);
+  }
+  kineticEnergy = energy * 0.5 * totalMass / numberOfPoints;
+  maximumVelocity = sqrt(maximumNorm2);
+}
+
+//------------------------------------------------------------------------------
+double standardDeviation(const std::deque<double>& values)
+{
+  if (values.empty())
+    {
+    return 0.;
+    }
+  double mean = 0.;
+  for (size_t i = 0; i < values.size(); ++i)
+    {
+    mean += values[i] / values.size();
+    }
+  double variance = 0.;
+  for (size_t i = 0; i < values.size(); ++i)
+    {
+    variance += (values[i] - mean) * (values[i] - mean) / values.size();
+    }
+  return sqrt(variance);
+}
+
+//------------------------------------------------------------------------------
+/// Describe the inputs of the setup: a cached setup computed with a
+/// different signature is not used.
+std::string computeSetupSignature(const std::string& tetMeshFileName,
+                                  const std::string& armatureFileName,
+                                  bool isMeshInRAS, bool isArmatureInRAS)
+{
+  std::stringstream signature;
+  signature << "mesh: " << tetMeshFileName << " "
+            << itksys::SystemTools::FileLength(tetMeshFileName.c_str()) << " "
+            << itksys::SystemTools::ModifiedTime(tetMeshFileName.c_str())
+            << " armature: " << armatureFileName << " "
+            << itksys::SystemTools::FileLength(armatureFileName.c_str()) << " "
+            << itksys::SystemTools::ModifiedTime(armatureFileName.c_str())
+            << " meshInRAS: " << isMeshInRAS
+            << " armatureInRAS: " << isArmatureInRAS;
+  return signature.str();
+}
+
+//------------------------------------------------------------------------------
+/// The setup cache directory contains the tetrahedral mesh in the simulation
+/// coordinates (binary) and the point materials and skinning of the mesh.
+/// Return false if the cache doesn't exist or doesn't match the signature.
+bool readSetupCache(const std::string& directory, const std::string& signature,
+                    vtkSmartPointer<vtkPolyData>& tetMesh,
+                    PointMaterials& materials, MeshSkinning& skinning)
+{
+  const std::string setupFileName = directory + "/Setup.bin";
+  const std::string meshFileName = directory + "/Mesh.vtk";
+  std::ifstream stream(setupFileName.c_str(), std::ios::binary);
+  std::string cachedSignature;
+  if (!stream ||
+      !bender::BinaryIO::ReadHeader(stream, "BenderSimulationSetup", 1) ||
+      !bender::BinaryIO::ReadString(stream, cachedSignature) ||
+      cachedSignature != signature ||
+      !itksys::SystemTools::FileExists(meshFileName.c_str(), true))
+    {
+    return false;
+    }
+  if (!materials.Read(stream) || !skinning.Read(stream))
+    {
+    std::cerr << "Setup cache " << setupFileName << " is corrupted" << std::endl;
+    return false;
+    }
+  tetMesh.TakeReference(bender::IOUtils::ReadPolyData(meshFileName, false));
+  return tetMesh && tetMesh->GetNumberOfPoints() ==
+    static_cast<vtkIdType>(skinning.GetNumberOfPoints());
+}
+
+//------------------------------------------------------------------------------
+bool writeSetupCache(const std::string& directory, const std::string& signature,
+                     vtkPolyData* tetMesh,
+                     const PointMaterials& materials,
+                     const MeshSkinning& skinning)
+{
+  if (!itksys::SystemTools::MakeDirectory(directory.c_str()))
+    {
+    std::cerr << "Can't create setup cache " << directory << std::endl;
+    return false;
+    }
+  const std::string setupFileName = directory + "/Setup.bin";
+  // Invalidate the previous cache until the new one is complete.
+  itksys::SystemTools::RemoveFile(setupFileName.c_str());
+  if (!bender::IOUtils::WritePolyData(tetMesh, directory + "/Mesh.vtk"))
+    {
+    return false;
+    }
+  std::ofstream stream(setupFileName.c_str(), std::ios::binary);
+  bender::BinaryIO::WriteHeader(stream, "BenderSimulationSetup", 1);
+  bender::BinaryIO::WriteString(stream, signature);
+  materials.Write(stream);
+  skinning.Write(stream);
+  stream.close();
+  return !stream.fail();
+}
+
+//------------------------------------------------------------------------------
+/// Save the state of the simulated mesh and of the springs.
+void saveCheckpointState(MechanicalObject<Vec3Types>::SPtr mesh,
+                         StiffSpringForceField<Vec3Types>::SPtr springs,
+                         SimulationCheckpoint& checkpoint)
+{
+  const MechanicalObject<Vec3Types>::VecCoord& positions =
+    mesh->read(VecCoordId::position())->getValue();
+  const MechanicalObject<Vec3Types>::VecDeriv& velocities =
+    mesh->read(VecDerivId::velocity())->getValue();
+  checkpoint.Positions.resize(3 * positions.size());
+  checkpoint.Velocities.resize(3 * velocities.size());
+  for (size_t i = 0; i < positions.size(); ++i)
+    {
+    for (int j = 0; j < 3; ++j)
+      {
+      checkpoint.Positions[3 * i + j] = positions[i][j];
+      checkpoint.Velocities[3 * i + j] =
+        i < velocities.size() ? velocities[i][j] : 0.;
+      }
+    }
+
+  const sofa::helper::vector<StiffSpringForceField<Vec3Types>::Spring>&
+    springList = springs->getSprings();
+  checkpoint.Springs.resize(springList.size());
+  for (size_t i = 0; i < springList.size(); ++i)
+    {
+    checkpoint.Springs[i].First = springList[i].m1;
+    checkpoint.Springs[i].Second = springList[i].m2;
+    checkpoint.Springs[i].Stiffness = springList[i].ks;
+    checkpoint.Springs[i].Damping = springList[i].kd;
+    checkpoint.Springs[i].RestLength = springList[i].initpos;
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Restore the state of the simulated mesh and of the springs.
+bool restoreCheckpointState(const SimulationCheckpoint& checkpoint,
+                            MechanicalObject<Vec3Types>::SPtr mesh,
+                            StiffSpringForceField<Vec3Types>::SPtr springs)
+{
+  const size_t numberOfPoints = checkpoint.Positions.size() / 3;
+  if (numberOfPoints != static_cast<size_t>(mesh->getSize()))
+    {
+    std::cerr << "The checkpoint has " << numberOfPoints
+              << " points instead of " << mesh->getSize() << std::endl;
+    return false;
+    }
+  Data<MechanicalObject<Vec3Types>::VecCoord>* x =
+    mesh->write(VecCoordId::position());
+  Data<MechanicalObject<Vec3Types>::VecDeriv>* v =
+    mesh->write(VecDerivId::velocity());
+  MechanicalObject<Vec3Types>::VecCoord& positions = *x->beginEdit();
+  MechanicalObject<Vec3Types>::VecDeriv& velocities = *v->beginEdit();
+  positions.resize(numberOfPoints);
+  velocities.resize(numberOfPoints);
+  for (size_t i = 0; i < numberOfPoints; ++i)
+    {
+    for (int j = 0; j < 3; ++j)
+      {
+      positions[i][j] = checkpoint.Positions[3 * i + j];
+      velocities[i][j] = checkpoint.Velocities[3 * i + j];
+      }
+    }
+  x->endEdit();
+  v->endEdit();
+
+  springs->clear(static_cast<int>(checkpoint.Springs.size()));
+  for (size_t i = 0; i < checkpoint.Springs.size(); ++i)
     {
-    Vector3 distance = *it1 - *it2;
-    error += distance.norm2() / numberOfPoints;
+    const SimulationCheckpoint::Spring& spring = checkpoint.Springs[i];
+    springs->addSpring(static_cast<int>(spring.First),
+                       static_cast<int>(spring.Second),
+                       spring.Stiffness, spring.Damping, spring.RestLength);
     }
-  return error;
+  return true;
 }
 
 //------------------------------------------------------------------------------
@@ -1760,18 +2442,40 @@ int main(int argc, char* argv[])
 
   const double dt = 0.0001;
 
+#ifdef SIMULATEPOSE_HEADLESS
+  // Built without OpenGL, the SOFA GUI and SofaCUDA.
+  Headless = true;
+#endif
+  if (Headless && GUI)
+    {
+    std::cerr << "The GUI can't be shown in headless mode." << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Threads used by the OpenMP loops of SimulatePose (and of SOFA when it
+  // is built with OpenMP)
+#ifdef _OPENMP
+  if (NumberOfThreads > 0)
+    {
+    omp_set_num_threads(NumberOfThreads);
+    }
+#endif
+
   sofa::simulation::setSimulation(new sofa::simulation::graph::DAGSimulation());
 
   // Create the scene graph root node
-  Node::SPtr root = createRootWithCollisionPipeline();
+  Node::SPtr root = createRootWithCollisionPipeline(BroadPhase);
   root->setGravity( Coord3(0,0,0) );
   root->setDt(dt);
 
-#ifdef SOFA_CUDA
-  // Load SofaCUDA plugin
-  sofa::component::misc::RequiredPlugin::SPtr cudaPlugin =
-    addNew<sofa::component::misc::RequiredPlugin>(root,"CUDA");
-  cudaPlugin->pluginName.setValue("SofaCUDA");
+#if defined(SOFA_CUDA) && !defined(SIMULATEPOSE_HEADLESS)
+  // Load SofaCUDA plugin, the CPU components are used in headless mode.
+  if (!Headless)
+    {
+    sofa::component::misc::RequiredPlugin::SPtr cudaPlugin =
+      addNew<sofa::component::misc::RequiredPlugin>(root,"CUDA");
+    cudaPlugin->pluginName.setValue("SofaCUDA");
+    }
 #endif
 
   if (!IsMeshInRAS)
@@ -1793,9 +2497,36 @@ int main(int argc, char* argv[])
   armature.TakeReference(
     bender::IOUtils::ReadPolyData(ArmaturePoly.c_str(),!IsArmatureInRAS));
 
+  // The setup (mesh, point materials and skinning) only depends on the
+  // inputs, it can be cached between runs.
+  const std::string setupSignature = computeSetupSignature(
+    InputTetMesh, ArmaturePoly, IsMeshInRAS, IsArmatureInRAS);
   vtkSmartPointer<vtkPolyData> tetMesh;
-  tetMesh.TakeReference(
-    bender::IOUtils::ReadPolyData(InputTetMesh.c_str(),!IsMeshInRAS));
+  PointMaterials tetMaterials;
+  MeshSkinning skinning;
+  const bool isSetupCached = !SetupCache.empty() &&
+    readSetupCache(SetupCache, setupSignature, tetMesh, tetMaterials, skinning);
+  if (isSetupCached)
+    {
+    if (Verbose)
+      {
+      std::cout << "Setup read from cache " << SetupCache << std::endl;
+      }
+    }
+  else
+    {
+    tetMesh.TakeReference(
+      bender::IOUtils::ReadPolyData(InputTetMesh.c_str(),!IsMeshInRAS));
+    // Materials of the points of the tetrahedral mesh
+    tetMaterials = PointMaterials(tetMesh);
+    skinning = MeshSkinning(tetMesh, armature, !IsArmatureInRAS, Verbose);
+    if (!SetupCache.empty() &&
+        !writeSetupCache(SetupCache, setupSignature, tetMesh,
+                         tetMaterials, skinning))
+      {
+      std::cerr << "Failed to write setup cache " << SetupCache << std::endl;
+      }
+    }
 
   vtkSmartPointer<vtkPolyData> surfaceMesh;
   if (EnableCollision)
@@ -1833,8 +2564,7 @@ int main(int argc, char* argv[])
   const double firstFrame = (GUI ? 1. : 1. / NumberOfArmatureSteps);
   Vector6 box;
   MechanicalObject<Vec3Types>::SPtr ghostMesh =
-    createGhostMesh(skeletalNode.get(), armature, tetMesh,box,
-                    !IsArmatureInRAS, firstFrame );
+    createGhostMesh(skeletalNode.get(), skinning, box, firstFrame);
 
   // Crete a fix contraint to fix the positions of the posed ghost frame
   BoxROI<Vec3Types>::SPtr boxRoi = addNew<BoxROI<Vec3Types> >(skeletalNode.get(),"BoxRoi");
@@ -1856,12 +2586,44 @@ int main(int argc, char* argv[])
   // Node for the mesh
   Node::SPtr anatomicalNode = sceneNode->createChild("AnatomicalMesh");
 
-  // Create mesh dof
+  // Create mesh dof. With a proxy, the finite element model and the
+  // collisions are computed on the coarse proxy mesh and the input mesh
+  // (target) follows it through a barycentric mapping.
   Vec3Types::VecReal                youngModulus;
-  MechanicalObject<Vec3Types>::SPtr posedMesh = loadMesh(
-    anatomicalNode.get(), tetMesh, youngModulus);
+  MechanicalObject<Vec3Types>::SPtr simulatedMesh;
+  MechanicalObject<Vec3Types>::SPtr posedMesh;
+  Node::SPtr targetNode = anatomicalNode;
+  const bool useProxy = !ProxyTetMesh.empty() || ProxyResolution > 0;
+  if (useProxy)
+    {
+    if (!ProxyTetMesh.empty())
+      {
+      vtkSmartPointer<vtkPolyData> proxyMesh;
+      proxyMesh.TakeReference(
+        bender::IOUtils::ReadPolyData(ProxyTetMesh.c_str(),!IsMeshInRAS));
+      simulatedMesh = loadMesh(anatomicalNode.get(), proxyMesh, youngModulus);
+      }
+    else
+      {
+      simulatedMesh = createProxyMesh(anatomicalNode.get(), tetMesh,
+                                      ProxyResolution, youngModulus);
+      }
+
+    targetNode = anatomicalNode->createChild("TargetMesh");
+    Vec3Types::VecReal targetYoungModulus;
+    posedMesh = loadMesh(targetNode.get(), tetMesh, targetYoungModulus);
+    BarycentricMapping3_to_3::SPtr targetMapping =
+      addNew<BarycentricMapping3_to_3>(targetNode, "targetMapping");
+    targetMapping->setModels(simulatedMesh.get(), posedMesh.get());
+    }
+  else
+    {
+    posedMesh = loadMesh(anatomicalNode.get(), tetMesh, youngModulus);
+    simulatedMesh = posedMesh;
+    }
   UniformMass3::SPtr anatomicalMass = addNew<UniformMass3>(anatomicalNode.get(),"Mass");
-  anatomicalMass->setTotalMass(100);
+  const double anatomicalTotalMass = 100.;
+  anatomicalMass->setTotalMass(anatomicalTotalMass);
 
   if (Verbose)
     {
@@ -1884,7 +2646,7 @@ int main(int argc, char* argv[])
       }
     Node::SPtr collisionNode;
     collisionNode = createCollisionNode(anatomicalNode.get(),
-                                        surfaceMesh,posedMesh.get());
+                                        surfaceMesh,simulatedMesh.get());
     }
 
   if (Verbose)
@@ -1893,12 +2655,11 @@ int main(int argc, char* argv[])
               << std::endl;
     std::cout << "Create spring forces..." << std::endl;
     }
-  using sofa::component::interactionforcefield::StiffSpringForceField;
 
   StiffSpringForceField<Vec3Types>::SPtr stiffspringforcefield =
     sofa::core::objectmodel::New<StiffSpringForceField<Vec3Types> >(ghostMesh.get(),posedMesh.get());
   stiffspringforcefield->setName("Spring-Contact");
-  anatomicalNode->addObject(stiffspringforcefield);
+  targetNode->addObject(stiffspringforcefield);
 
   double stiffness = 10000.;
   double distance = 1.;
@@ -1906,7 +2667,7 @@ int main(int argc, char* argv[])
   size_t sample = 0;
   for (vtkIdType pointId = 0; pointId < numberOfPoints; ++pointId)
     {
-    if (isPointInLabel(tetMesh, BoneLabel, pointId) && !(sample++ % 1))
+    if (tetMaterials.IsPointInLabel(pointId, BoneLabel) && !(sample++ % 1))
       {
       stiffspringforcefield->addSpring(pointId, pointId, stiffness, 0.0, distance);
       }
@@ -1935,14 +2696,15 @@ int main(int argc, char* argv[])
     }
   sofa::simulation::getSimulation()->init(root.get());
 
-  int gluArgc  = 1;
-  char** gluArgv = new char *;
-  gluArgv[0] = new char[strlen(argv[0])+1];
-  memcpy(gluArgv[0], argv[0], strlen(argv[0])+1);
-  glutInit(&gluArgc, gluArgv);
-
+#ifndef SIMULATEPOSE_HEADLESS
   if (GUI)
     {
+    int gluArgc  = 1;
+    char** gluArgv = new char *;
+    gluArgv[0] = new char[strlen(argv[0])+1];
+    memcpy(gluArgv[0], argv[0], strlen(argv[0])+1);
+    glutInit(&gluArgc, gluArgv);
+
     std::cout << "Open GUI..." << std::endl;
     //
     sofa::gui::initMain();
@@ -1956,13 +2718,25 @@ int main(int argc, char* argv[])
       }
     }
   else
+#endif
     {
-    if (Verbose)
+#ifndef SIMULATEPOSE_HEADLESS
+    // No OpenGL context is needed without CUDA
+    if (!Headless)
       {
-      std::cout << "Create OpenGL context..." << std::endl;
+      if (Verbose)
+        {
+        std::cout << "Create OpenGL context..." << std::endl;
+        }
+      int gluArgc  = 1;
+      char** gluArgv = new char *;
+      gluArgv[0] = new char[strlen(argv[0])+1];
+      memcpy(gluArgv[0], argv[0], strlen(argv[0])+1);
+      glutInit(&gluArgc, gluArgv);
+      glutCreateWindow(argv[0]);
+    //glewExperimental=true;
       }
-    glutCreateWindow(argv[0]);
-  //glewExperimental=true;
+#endif
 
     root->setAnimate(true);
 
@@ -1971,42 +2745,196 @@ int main(int argc, char* argv[])
       std::cout << "Animate..." << std::endl;
       }
 
-    // Forces take time to start moving the mesh
-    const size_t minimumNumberOfSteps = 30;
-
-    double lastError = 1.;
+    // We can't use the distance error directly because the simulation might
+    // oscillate. The simulation has converged once the armature is posed and
+    // the error is stable over the last steps, or the mesh is at rest.
+    const size_t convergenceWindow =
+      static_cast<size_t>(std::max(2, ConvergenceWindow));
+    std::deque<double> lastErrors;
+    double error = 0.;
     double stdDeviation = 0.;
+    double kineticEnergy = 0.;
+    double maximumVelocity = 0.;
+    bool converged = false;
+
+    // Adaptive time step: the time step is adjusted so the fastest vertex
+    // moves by about MaximumDisplacement per step.
+    double stepDt = dt;
+    const double minimumDt = 0.01 * dt;
+    const double maximumDt = 100. * dt;
+
+    itk::TimeProbe animateProbe;
+
+    // Frames of the posed mesh are written by a background thread every
+    // FramePeriod steps.
+    SimulationFrameWriter frameWriter;
+    const bool exportFrames = !OutputFrames.empty() && FramePeriod > 0;
+    if (exportFrames)
+      {
+      frameWriter.SetMesh(tetMesh);
+      frameWriter.SetFileName(OutputFrames);
+      frameWriter.SetInvertXY(!IsMeshInRAS);
+      if (!frameWriter.Start())
+        {
+        std::cerr << "Failed to start writing the frames." << std::endl;
+        return EXIT_FAILURE;
+        }
+      }
+    std::vector<float> framePositions;
+    double simulationTime = 0.;
+    const size_t framePeriod = static_cast<size_t>(std::max(1, FramePeriod));
+
+    // Resume from the last checkpoint
+    size_t step = 0;
+    double armatureCoefficient = firstFrame;
+    const size_t checkpointPeriod =
+      static_cast<size_t>(std::max(1, CheckpointPeriod));
+    if (Restart && !CheckpointFile.empty() &&
+        itksys::SystemTools::FileExists(CheckpointFile.c_str(), true))
+      {
+      SimulationCheckpoint checkpoint;
+      if (!checkpoint.Read(CheckpointFile) ||
+          !restoreCheckpointState(checkpoint, simulatedMesh,
+                                  stiffspringforcefield))
+        {
+        std::cerr << "Failed to restart from " << CheckpointFile << std::endl;
+        return EXIT_FAILURE;
+        }
+      step = static_cast<size_t>(checkpoint.Step) + 1;
+      simulationTime = checkpoint.Time;
+      // The adapted time step is resumed, otherwise the configured one is
+      // kept.
+      if (AdaptiveTimeStep && checkpoint.TimeStep > 0.)
+        {
+        stepDt = checkpoint.TimeStep;
+        root->setDt(stepDt);
+        }
+      armatureCoefficient = checkpoint.ArmatureCoefficient;
+      poseMechanicalObject(ghostMesh, skinning, armatureCoefficient);
+      lastErrors.assign(checkpoint.Errors.begin(), checkpoint.Errors.end());
+      if (Verbose)
+        {
+        std::cout << "Restart at iteration #" << step << " from "
+                  << CheckpointFile << std::endl;
+        }
+      }
+    else if (Restart)
+      {
+      std::cout << "No checkpoint to restart from, start from the beginning."
+                << std::endl;
+      }
 
-    // We can't use the distance error directly because the simulation might
-    // oscillate.
-    for (size_t step = 0;
-         (step < minimumNumberOfSteps || stdDeviation > MinimumStandardDeviation) &&
+    for (; !converged &&
          (step < static_cast<size_t>(MaximumNumberOfSimulationSteps)) ; ++step)
       {
-      sofa::simulation::getSimulation()->animate(root.get(), dt);
-      //sofa::simulation::getSimulation()->animate(root.get());
+      animateProbe.Start();
+      sofa::simulation::getSimulation()->animate(root.get(), stepDt);
+      animateProbe.Stop();
+      simulationTime += stepDt;
+
+      if (exportFrames && step % framePeriod == 0)
+        {
+        copyPositions(posedMesh, framePositions);
+        frameWriter.AddFrame(static_cast<int>(step), simulationTime,
+                            framePositions);
+        }
 
       if (step < NumberOfArmatureSteps)
         {
-        poseMechanicalObject(ghostMesh, tetMesh, armature, !IsArmatureInRAS,
-                             static_cast<double>(step + 2 )/ NumberOfArmatureSteps);
+        armatureCoefficient =
+          static_cast<double>(step + 2 )/ NumberOfArmatureSteps;
+        poseMechanicalObject(ghostMesh, skinning, armatureCoefficient);
         }
+      // The last armature step is applied at step NumberOfArmatureSteps - 2
+      const bool isPosed = step + 2 >= static_cast<size_t>(NumberOfArmatureSteps);
 
-      const double error = meanSquareError(ghostMesh, posedMesh);
-      double mean = (lastError + error) / 2.;
-      stdDeviation = sqrt((pow(lastError - mean, 2) + pow(error - mean, 2)) / 2.);
-      //errorChange =  fabs(lastError-error) / lastError;
-      lastError = error;
+      error = meanSquareError(ghostMesh, posedMesh, ErrorSamples);
+      lastErrors.push_back(error);
+      if (lastErrors.size() > convergenceWindow)
+        {
+        lastErrors.pop_front();
+        }
+      stdDeviation = standardDeviation(lastErrors);
+      // Walking the velocities is only needed by the adaptive time step and
+      // the kinetic energy convergence criterion.
+      const bool computeKinetics =
+        AdaptiveTimeStep || MinimumKineticEnergy > 0.;
+      if (computeKinetics)
+        {
+        computeKineticState(simulatedMesh, anatomicalTotalMass,
+                            kineticEnergy, maximumVelocity);
+        }
+
+      converged = isPosed && lastErrors.size() == convergenceWindow &&
+        (stdDeviation <= MinimumStandardDeviation ||
+         kineticEnergy < MinimumKineticEnergy);
 
       if (Verbose)
         {
-        std::cout << " Iteration #" << step << " (distance: " << lastError
-                    << " std: " << stdDeviation << std::endl;
+        std::cout << " Iteration #" << step << " (distance: " << error
+                  << " std: " << stdDeviation;
+        if (computeKinetics)
+          {
+          std::cout << " kinetic energy: " << kineticEnergy
+                    << " max velocity: " << maximumVelocity;
+          }
+        std::cout << " dt: " << stepDt << ")" << std::endl;
+        }
+
+      if (AdaptiveTimeStep)
+        {
+        const double displacement = maximumVelocity * stepDt;
+        if (displacement > MaximumDisplacement)
+          {
+          stepDt = std::max(minimumDt, stepDt * 0.5);
+          }
+        else if (displacement < 0.25 * MaximumDisplacement)
+          {
+          stepDt = std::min(maximumDt, stepDt * 1.5);
+          }
+        root->setDt(stepDt);
         }
+
+      if (!CheckpointFile.empty() && !converged &&
+          (step + 1) % checkpointPeriod == 0)
+        {
+        SimulationCheckpoint checkpoint;
+        checkpoint.Step = step;
+        checkpoint.Time = simulationTime;
+        checkpoint.TimeStep = stepDt;
+        checkpoint.ArmatureCoefficient = armatureCoefficient;
+        checkpoint.Errors.assign(lastErrors.begin(), lastErrors.end());
+        saveCheckpointState(simulatedMesh, stiffspringforcefield, checkpoint);
+        if (!checkpoint.Write(CheckpointFile))
+          {
+          std::cerr << "Failed to write checkpoint " << CheckpointFile
+                    << std::endl;
+          }
+        }
+      }
+    // Always export the last step
+    if (exportFrames && step > 0 && (step - 1) % framePeriod != 0)
+      {
+      copyPositions(posedMesh, framePositions);
+      frameWriter.AddFrame(static_cast<int>(step - 1), simulationTime,
+                          framePositions);
+      }
+    frameWriter.Stop();
+    if (exportFrames && Verbose)
+      {
+      std::cout << frameWriter.GetNumberOfWrittenFrames()
+                << " frames written in " << OutputFrames << std::endl;
+      }
+    if (Verbose)
+      {
+      std::cout << "Animate: " << animateProbe.GetNumberOfStops()
+                << " steps in " << animateProbe.GetTotal() << "s ("
+                << animateProbe.GetMean() << "s per step, "
+                << BroadPhase << " broad phase)" << std::endl;
       }
     }
   vtkNew<vtkPolyData> posedSurface;
-  initMesh(posedSurface.GetPointer(), tetMesh, anatomicalNode);
+  initMesh(posedSurface.GetPointer(), tetMesh, targetNode);
   if (!IsMeshInRAS)
     {
     vtkNew<vtkTransform> transform;
@@ -0,0 +1,105 @@
+/*=========================================================================
+
+  Program: Bender
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+#include "SimulationCheckpoint.h"
+
+// Bender includes
+#include "benderBinaryIO.h"
+
+// ITK includes
+#include <itksys/SystemTools.hxx>
+
+// STD includes
+#include <cstdio>
+#include <fstream>
+
+namespace
+{
+const char* CheckpointType = "BenderSimulationCheckpoint";
+const vtkTypeUInt32 CheckpointVersion = 1;
+} // end namespace
+
+//-----------------------------------------------------------------------------
+SimulationCheckpoint::SimulationCheckpoint()
+{
+  this->Step = 0;
+  this->Time = 0.;
+  this->TimeStep = 0.;
+  this->ArmatureCoefficient = 0.;
+}
+
+//-----------------------------------------------------------------------------
+bool SimulationCheckpoint::Write(const std::string& fileName) const
+{
+  std::string partialFileName = fileName + ".tmp";
+  std::ofstream stream(partialFileName.c_str(), std::ios::binary);
+  if (!stream)
+    {
+    std::cerr << "Can't write checkpoint " << partialFileName << std::endl;
+    return false;
+    }
+  bender::BinaryIO::WriteHeader(stream, CheckpointType, CheckpointVersion);
+  bender::BinaryIO::WriteValue(stream, this->Step);
+  bender::BinaryIO::WriteValue(stream, this->Time);
+  bender::BinaryIO::WriteValue(stream, this->TimeStep);
+  bender::BinaryIO::WriteValue(stream, this->ArmatureCoefficient);
+  bender::BinaryIO::WriteVector(stream, this->Errors);
+  bender::BinaryIO::WriteVector(stream, this->Positions);
+  bender::BinaryIO::WriteVector(stream, this->Velocities);
+  bender::BinaryIO::WriteVector(stream, this->Springs);
+  stream.close();
+  if (stream.fail())
+    {
+    std::cerr << "Failed to write checkpoint " << partialFileName << std::endl;
+    return false;
+    }
+  itksys::SystemTools::RemoveFile(fileName.c_str());
+  return rename(partialFileName.c_str(), fileName.c_str()) == 0;
+}
+
+//-----------------------------------------------------------------------------
+bool SimulationCheckpoint::Read(const std::string& fileName)
+{
+  std::ifstream stream(fileName.c_str(), std::ios::binary);
+  if (!stream)
+    {
+    std::cerr << "Can't read checkpoint " << fileName << std::endl;
+    return false;
+    }
+  if (!bender::BinaryIO::ReadHeader(stream, CheckpointType, CheckpointVersion))
+    {
+    std::cerr << fileName << " is not a valid checkpoint" << std::endl;
+    return false;
+    }
+  bool res = bender::BinaryIO::ReadValue(stream, this->Step)
+    && bender::BinaryIO::ReadValue(stream, this->Time)
+    && bender::BinaryIO::ReadValue(stream, this->TimeStep)
+    && bender::BinaryIO::ReadValue(stream, this->ArmatureCoefficient)
+    && bender::BinaryIO::ReadVector(stream, this->Errors)
+    && bender::BinaryIO::ReadVector(stream, this->Positions)
+    && bender::BinaryIO::ReadVector(stream, this->Velocities)
+    && bender::BinaryIO::ReadVector(stream, this->Springs);
+  if (!res || this->Positions.size() != this->Velocities.size())
+    {
+    std::cerr << "Checkpoint " << fileName << " is corrupted" << std::endl;
+    return false;
+    }
+  return true;
+}
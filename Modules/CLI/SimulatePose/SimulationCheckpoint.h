@@ -0,0 +1,73 @@
+/*=========================================================================
+
+  Program: Bender
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+#ifndef __SimulationCheckpoint_h
+#define __SimulationCheckpoint_h
+
+// .NAME SimulationCheckpoint - State of a simulation saved to resume it
+// .SECTION General Description
+// Holds the state of the simulation at a given step: the positions and
+// velocities of the simulated mesh, the armature coefficient of the ghost
+// mesh, the springs between both meshes and the last errors used to test the
+// convergence. The state is written in a compact binary file (native byte
+// order) that starts with a type tag and a version number.
+
+// VTK includes
+#include <vtkType.h>
+
+// STD includes
+#include <string>
+#include <vector>
+
+//-------------------------------------------------------------------------------
+class SimulationCheckpoint
+{
+public:
+  SimulationCheckpoint();
+
+  struct Spring
+    {
+    vtkTypeUInt64 First;
+    vtkTypeUInt64 Second;
+    double Stiffness;
+    double Damping;
+    double RestLength;
+    };
+
+  // Last simulated step
+  vtkTypeUInt64 Step;
+  double Time;
+  double TimeStep;
+  // Coefficient of the armature pose applied to the ghost mesh
+  double ArmatureCoefficient;
+  // Errors of the convergence window
+  std::vector<double> Errors;
+  // Coordinates (x, y, z) of the points of the simulated mesh
+  std::vector<double> Positions;
+  std::vector<double> Velocities;
+  std::vector<Spring> Springs;
+
+  // The file is written aside and renamed when complete, an interrupted
+  // write leaves the previous checkpoint untouched.
+  bool Write(const std::string& fileName) const;
+  bool Read(const std::string& fileName);
+};
+
+#endif
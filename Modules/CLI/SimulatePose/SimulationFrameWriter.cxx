@@ -0,0 +1,300 @@
+/*=========================================================================
+
+  Program: Bender
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+#include "SimulationFrameWriter.h"
+
+// ITK includes
+#include <itksys/SystemTools.hxx>
+
+// VTK includes
+#include <vtkCellArray.h>
+#include <vtkCellData.h>
+#include <vtkCellType.h>
+#include <vtkIdTypeArray.h>
+#include <vtkNew.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkUnsignedCharArray.h>
+#include <vtkUnstructuredGrid.h>
+#include <vtkXMLUnstructuredGridWriter.h>
+
+// STD includes
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+//-----------------------------------------------------------------------------
+SimulationFrameWriter::SimulationFrameWriter()
+{
+  this->InvertXY = false;
+  this->MaximumQueueSize = 4;
+  this->Stopping = false;
+  this->FrameQueued = itk::ConditionVariable::New();
+  this->FrameDequeued = itk::ConditionVariable::New();
+  this->NumberOfWrittenFrames = 0;
+  this->Threader = itk::MultiThreader::New();
+  this->WriterThreadId = -1;
+}
+
+//-----------------------------------------------------------------------------
+SimulationFrameWriter::~SimulationFrameWriter()
+{
+  this->Stop();
+}
+
+//-----------------------------------------------------------------------------
+void SimulationFrameWriter::SetMesh(vtkPolyData* mesh)
+{
+  // The tetrahedra are written as VTK_TETRA cells, the points are replaced
+  // by the positions of each frame.
+  this->Mesh = vtkSmartPointer<vtkUnstructuredGrid>::New();
+  vtkNew<vtkPoints> points;
+  points->SetDataTypeToFloat();
+  points->SetNumberOfPoints(mesh->GetNumberOfPoints());
+  this->Mesh->SetPoints(points.GetPointer());
+
+  vtkCellArray* tetras = mesh->GetPolys();
+  vtkNew<vtkUnsignedCharArray> cellTypes;
+  cellTypes->SetNumberOfTuples(tetras->GetNumberOfCells());
+  for (vtkIdType cellId = 0; cellId < tetras->GetNumberOfCells(); ++cellId)
+    {
+    cellTypes->SetValue(cellId, VTK_TETRA);
+    }
+  vtkNew<vtkIdTypeArray> locations;
+  locations->SetNumberOfTuples(tetras->GetNumberOfCells());
+  tetras->InitTraversal();
+  vtkIdType npts = 0;
+  vtkIdType* pts = 0;
+  vtkIdType location = 0;
+  for (vtkIdType cellId = 0; tetras->GetNextCell(npts, pts); ++cellId)
+    {
+    locations->SetValue(cellId, location);
+    location += npts + 1;
+    }
+  this->Mesh->SetCells(cellTypes.GetPointer(), locations.GetPointer(), tetras);
+  this->Mesh->GetCellData()->ShallowCopy(mesh->GetCellData());
+}
+
+//-----------------------------------------------------------------------------
+void SimulationFrameWriter::SetFileName(const std::string& fileName)
+{
+  this->FileName = fileName;
+}
+
+//-----------------------------------------------------------------------------
+std::string SimulationFrameWriter::GetFileName() const
+{
+  return this->FileName;
+}
+
+//-----------------------------------------------------------------------------
+void SimulationFrameWriter::SetInvertXY(bool invert)
+{
+  this->InvertXY = invert;
+}
+
+//-----------------------------------------------------------------------------
+void SimulationFrameWriter::SetMaximumQueueSize(size_t size)
+{
+  this->MaximumQueueSize = std::max(size, static_cast<size_t>(1));
+}
+
+//-----------------------------------------------------------------------------
+bool SimulationFrameWriter::Start()
+{
+  if (this->WriterThreadId >= 0)
+    {
+    return true;
+    }
+  if (!this->Mesh || this->FileName.empty())
+    {
+    std::cerr << "No mesh or file name to write the frames." << std::endl;
+    return false;
+    }
+  this->Stopping = false;
+  this->WrittenFrames.clear();
+  this->NumberOfWrittenFrames = 0;
+  this->WriterThreadId = this->Threader->SpawnThread(
+    &SimulationFrameWriter::WriteFrames, this);
+  return this->WriterThreadId >= 0;
+}
+
+//-----------------------------------------------------------------------------
+void SimulationFrameWriter::Stop()
+{
+  if (this->WriterThreadId < 0)
+    {
+    return;
+    }
+  this->Mutex.Lock();
+  this->Stopping = true;
+  this->FrameQueued->Broadcast();
+  this->Mutex.Unlock();
+  // Wait for the writer thread to write the queued frames and exit.
+  this->Threader->TerminateThread(this->WriterThreadId);
+  this->WriterThreadId = -1;
+}
+
+//-----------------------------------------------------------------------------
+void SimulationFrameWriter::AddFrame(int step, double time,
+                                     std::vector<float>& positions)
+{
+  if (this->WriterThreadId < 0)
+    {
+    return;
+    }
+  this->Mutex.Lock();
+  while (this->Queue.size() >= this->MaximumQueueSize)
+    {
+    this->FrameDequeued->Wait(&this->Mutex);
+    }
+  this->Queue.push_back(Frame());
+  Frame& frame = this->Queue.back();
+  frame.Step = step;
+  frame.Time = time;
+  frame.Positions.swap(positions);
+  this->FrameQueued->Signal();
+  this->Mutex.Unlock();
+}
+
+//-----------------------------------------------------------------------------
+size_t SimulationFrameWriter::GetNumberOfWrittenFrames()
+{
+  this->Mutex.Lock();
+  size_t numberOfWrittenFrames = this->NumberOfWrittenFrames;
+  this->Mutex.Unlock();
+  return numberOfWrittenFrames;
+}
+
+//-----------------------------------------------------------------------------
+bool SimulationFrameWriter::WriteFrame(const Frame& frame)
+{
+  vtkPoints* points = this->Mesh->GetPoints();
+  const vtkIdType numberOfPoints = points->GetNumberOfPoints();
+  if (frame.Positions.size() != static_cast<size_t>(3 * numberOfPoints))
+    {
+    std::cerr << "Frame " << frame.Step << " has " << frame.Positions.size() / 3
+              << " points instead of " << numberOfPoints << std::endl;
+    return false;
+    }
+  const float sign = this->InvertXY ? -1.f : 1.f;
+  for (vtkIdType pointId = 0; pointId < numberOfPoints; ++pointId)
+    {
+    const float* position = &frame.Positions[3 * pointId];
+    points->SetPoint(pointId, sign * position[0], sign * position[1],
+                     position[2]);
+    }
+  points->Modified();
+
+  std::stringstream frameFileName;
+  frameFileName << itksys::SystemTools::GetFilenameWithoutLastExtension(
+                     this->FileName)
+                << "_" << std::setw(6) << std::setfill('0') << frame.Step
+                << ".vtu";
+  std::string path =
+    itksys::SystemTools::GetFilenamePath(this->FileName);
+  std::string frameFilePath = path.empty() ?
+    frameFileName.str() : path + "/" + frameFileName.str();
+
+  vtkNew<vtkXMLUnstructuredGridWriter> writer;
+  writer->SetInput(this->Mesh);
+  writer->SetFileName(frameFilePath.c_str());
+  writer->SetDataModeToBinary();
+  if (!writer->Write())
+    {
+    std::cerr << "Failed to write frame " << frameFilePath << std::endl;
+    return false;
+    }
+  this->WrittenFrames.push_back(
+    std::make_pair(frameFileName.str(), frame.Time));
+  return this->WriteIndex();
+}
+
+//-----------------------------------------------------------------------------
+bool SimulationFrameWriter::WriteIndex() const
+{
+  // Write aside and rename so the index is never read half written.
+  std::string indexFileName = this->FileName + ".tmp";
+  std::ofstream index(indexFileName.c_str());
+  if (!index)
+    {
+    std::cerr << "Failed to write " << indexFileName << std::endl;
+    return false;
+    }
+  index << "<?xml version=\"1.0\"?>" << std::endl;
+  index << "<VTKFile type=\"Collection\" version=\"0.1\">" << std::endl;
+  index << "  <Collection>" << std::endl;
+  for (size_t i = 0; i < this->WrittenFrames.size(); ++i)
+    {
+    index << "    <DataSet timestep=\"" << this->WrittenFrames[i].second
+          << "\" part=\"0\" file=\"" << this->WrittenFrames[i].first
+          << "\"/>" << std::endl;
+    }
+  index << "  </Collection>" << std::endl;
+  index << "</VTKFile>" << std::endl;
+  index.close();
+  itksys::SystemTools::RemoveFile(this->FileName.c_str());
+  return rename(indexFileName.c_str(), this->FileName.c_str()) == 0;
+}
+
+//-----------------------------------------------------------------------------
+ITK_THREAD_RETURN_TYPE SimulationFrameWriter::WriteFrames(void* arg)
+{
+  typedef itk::MultiThreader::ThreadInfoStruct  ThreadInfoType;
+  ThreadInfoType* infoStruct = reinterpret_cast< ThreadInfoType* >( arg );
+  SimulationFrameWriter* self =
+    reinterpret_cast< SimulationFrameWriter* >( infoStruct->UserData );
+
+  while (true)
+    {
+    self->Mutex.Lock();
+    while (self->Queue.empty() && !self->Stopping)
+      {
+      self->FrameQueued->Wait(&self->Mutex);
+      }
+    if (self->Queue.empty())
+      {
+      // Stopping and nothing left to write.
+      self->Mutex.Unlock();
+      break;
+      }
+    Frame frame;
+    frame.Step = self->Queue.front().Step;
+    frame.Time = self->Queue.front().Time;
+    frame.Positions.swap(self->Queue.front().Positions);
+    self->Queue.pop_front();
+    self->FrameDequeued->Signal();
+    self->Mutex.Unlock();
+
+    // Write without holding the lock, the simulation keeps going.
+    const bool written = self->WriteFrame(frame);
+
+    if (written)
+      {
+      self->Mutex.Lock();
+      ++self->NumberOfWrittenFrames;
+      self->Mutex.Unlock();
+      }
+    }
+  return ITK_THREAD_RETURN_VALUE;
+}
@@ -0,0 +1,121 @@
+/*=========================================================================
+
+  Program: Bender
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+#ifndef __SimulationFrameWriter_h
+#define __SimulationFrameWriter_h
+
+// .NAME SimulationFrameWriter - Write simulation frames in a background thread
+// .SECTION General Description
+// Writes snapshots of the simulated mesh positions as a series of numbered
+// .vtu files with a .pvd index (ParaView collection) that lists them.
+// Frames are queued by AddFrame() and written by a writer thread so the disk
+// I/O overlaps with the simulation. The queue is bounded: AddFrame() blocks
+// while the queue is full, which limits the memory used by the snapshots.
+// The index is rewritten after each frame so the frames written so far can
+// be loaded while the simulation is running.
+
+// ITK includes
+#include <itkConditionVariable.h>
+#include <itkMultiThreader.h>
+#include <itkMutexLock.h>
+
+// VTK includes
+#include <vtkSmartPointer.h>
+class vtkPolyData;
+class vtkUnstructuredGrid;
+
+// STD includes
+#include <deque>
+#include <string>
+#include <vector>
+
+//-------------------------------------------------------------------------------
+class SimulationFrameWriter
+{
+public:
+  SimulationFrameWriter();
+  // Write the remaining frames and stop the writer thread.
+  ~SimulationFrameWriter();
+
+  // Tetrahedral mesh (tetrahedra stored as polys) whose cells and cell data
+  // are written with each frame. Must be set before Start().
+  void SetMesh(vtkPolyData* mesh);
+
+  // Name of the .pvd index. Frames are written next to it as
+  // <name>_<step>.vtu.
+  void SetFileName(const std::string& fileName);
+  std::string GetFileName() const;
+
+  // Whether the x and y coordinates are inverted when written (LPS/RAS).
+  void SetInvertXY(bool invert);
+
+  // Maximum number of frames waiting to be written. 4 by default.
+  void SetMaximumQueueSize(size_t size);
+
+  // Start the writer thread.
+  bool Start();
+  // Wait until all the queued frames are written and stop the writer thread.
+  void Stop();
+
+  // Queue the positions (x, y, z for each point) of the mesh at the given
+  // step. The positions are swapped with an empty vector, no copy is made.
+  // Block while the queue is full.
+  void AddFrame(int step, double time, std::vector<float>& positions);
+
+  // Number of frames written so far.
+  size_t GetNumberOfWrittenFrames();
+
+private:
+  SimulationFrameWriter(const SimulationFrameWriter&);  //Not implemented
+  void operator=(const SimulationFrameWriter&);  //Not implemented
+
+  struct Frame
+    {
+    int Step;
+    double Time;
+    std::vector<float> Positions;
+    };
+
+  bool WriteFrame(const Frame& frame);
+  bool WriteIndex() const;
+  static ITK_THREAD_RETURN_TYPE WriteFrames(void* arg);
+
+  vtkSmartPointer<vtkUnstructuredGrid> Mesh;
+  std::string FileName;
+  bool InvertXY;
+  size_t MaximumQueueSize;
+
+  // Frames waiting to be written, protected by the mutex.
+  std::deque<Frame> Queue;
+  bool Stopping;
+  itk::SimpleMutexLock Mutex;
+  itk::ConditionVariable::Pointer FrameQueued;
+  itk::ConditionVariable::Pointer FrameDequeued;
+
+  // Written frames: file name and time. Only used by the writer thread
+  // while it is running.
+  std::vector<std::pair<std::string, double> > WrittenFrames;
+  size_t NumberOfWrittenFrames;
+
+  itk::MultiThreader::Pointer Threader;
+  int WriterThreadId;
+};
+
+#endif
@@ -0,0 +1,302 @@
+/*=========================================================================
+
+  Program: Bender
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Create the inputs of SimulatePose for a limb bent into self contact:
+// a box shaped limb along the x axis, made of tetrahedra, with two bones
+// along its axis. The second bone is rotated around the elbow so that the
+// forearm folds onto the arm, the inner side of the elbow collides.
+
+// Bender includes
+#include "benderIOUtils.h"
+
+// VTK includes
+#include <vtkCellArray.h>
+#include <vtkCellData.h>
+#include <vtkDoubleArray.h>
+#include <vtkFloatArray.h>
+#include <vtkIntArray.h>
+#include <vtkMath.h>
+#include <vtkNew.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+
+namespace
+{
+
+const int BoneLabel = 2;
+const int TissueLabel = 3;
+
+//-----------------------------------------------------------------------------
+struct LimbGrid
+{
+  int Dimensions[3]; // number of cells along each axis
+  double CellSize;
+  double Length;
+
+  vtkIdType GetPointId(int i, int j, int k) const
+  {
+    return (static_cast<vtkIdType>(k) * (this->Dimensions[1] + 1) + j)
+      * (this->Dimensions[0] + 1) + i;
+  }
+  void GetPoint(int i, int j, int k, double x[3]) const
+  {
+    x[0] = i * this->CellSize;
+    x[1] = (j - this->Dimensions[1] / 2.) * this->CellSize;
+    x[2] = (k - this->Dimensions[2] / 2.) * this->CellSize;
+  }
+};
+
+//-----------------------------------------------------------------------------
+// Weight of the forearm, blended around the elbow.
+double GetForearmWeight(const LimbGrid& grid, double x)
+{
+  const double blend = 2. * grid.CellSize;
+  const double t = (x - grid.Length / 2. + blend) / (2. * blend);
+  return std::max(0., std::min(1., t));
+}
+
+//-----------------------------------------------------------------------------
+// Each cell of the grid is split into 6 tetrahedra around its diagonal
+// (Freudenthal decomposition), the tetrahedra of neighbor cells share
+// their faces.
+void CreateTetMesh(const LimbGrid& grid, vtkPolyData* mesh)
+{
+  vtkNew<vtkPoints> points;
+  vtkNew<vtkFloatArray> weights[2];
+  for (int bone = 0; bone < 2; ++bone)
+    {
+    std::stringstream name;
+    name << "weight_" << bone;
+    weights[bone]->SetName(name.str().c_str());
+    }
+  for (int k = 0; k <= grid.Dimensions[2]; ++k)
+    {
+    for (int j = 0; j <= grid.Dimensions[1]; ++j)
+      {
+      for (int i = 0; i <= grid.Dimensions[0]; ++i)
+        {
+        double x[3];
+        grid.GetPoint(i, j, k, x);
+        points->InsertNextPoint(x);
+        const double w = GetForearmWeight(grid, x[0]);
+        weights[0]->InsertNextValue(static_cast<float>(1. - w));
+        weights[1]->InsertNextValue(static_cast<float>(w));
+        }
+      }
+    }
+
+  // Permutations of the axes, odd permutations are flipped to keep the
+  // tetrahedra positively oriented.
+  const int permutations[6][3] = {
+    {0, 1, 2}, {1, 2, 0}, {2, 0, 1}, {0, 2, 1}, {2, 1, 0}, {1, 0, 2}};
+  vtkNew<vtkCellArray> tetras;
+  vtkNew<vtkIntArray> materialIds;
+  materialIds->SetName("MaterialId");
+  vtkNew<vtkDoubleArray> materialParameters;
+  materialParameters->SetName("MaterialParameters");
+  materialParameters->SetNumberOfComponents(2);
+  const double boneParameters[2] = {100000., 0.3};
+  const double tissueParameters[2] = {1000., 0.45};
+  for (int k = 0; k < grid.Dimensions[2]; ++k)
+    {
+    for (int j = 0; j < grid.Dimensions[1]; ++j)
+      {
+      for (int i = 0; i < grid.Dimensions[0]; ++i)
+        {
+        // The bones are the core of the limb, away from its ends and from
+        // the elbow.
+        const bool isBone =
+          std::abs(2 * j + 1 - grid.Dimensions[1]) <= 2 &&
+          std::abs(2 * k + 1 - grid.Dimensions[2]) <= 2 &&
+          i > 0 && i < grid.Dimensions[0] - 1 &&
+          std::abs(2 * i + 1 - grid.Dimensions[0]) > 2;
+        for (int p = 0; p < 6; ++p)
+          {
+          int index[3] = {i, j, k};
+          vtkIdType tetra[4];
+          tetra[0] = grid.GetPointId(index[0], index[1], index[2]);
+          for (int v = 1; v < 4; ++v)
+            {
+            ++index[permutations[p][v - 1]];
+            tetra[v] = grid.GetPointId(index[0], index[1], index[2]);
+            }
+          if (p >= 3)
+            {
+            std::swap(tetra[2], tetra[3]);
+            }
+          tetras->InsertNextCell(4, tetra);
+          materialIds->InsertNextValue(isBone ? BoneLabel : TissueLabel);
+          materialParameters->InsertNextTupleValue(
+            isBone ? boneParameters : tissueParameters);
+          }
+        }
+      }
+    }
+
+  mesh->SetPoints(points.GetPointer());
+  mesh->SetPolys(tetras.GetPointer());
+  mesh->GetCellData()->SetScalars(materialIds.GetPointer());
+  mesh->GetCellData()->AddArray(materialParameters.GetPointer());
+  mesh->GetPointData()->AddArray(weights[0].GetPointer());
+  mesh->GetPointData()->AddArray(weights[1].GetPointer());
+}
+
+//-----------------------------------------------------------------------------
+// Boundary of the grid, 2 triangles per cell face, with its own points.
+void CreateSurface(const LimbGrid& grid, vtkPolyData* surface)
+{
+  vtkNew<vtkPoints> points;
+  vtkNew<vtkCellArray> triangles;
+  std::map<vtkIdType, vtkIdType> surfacePointIds;
+
+  for (int axis = 0; axis < 3; ++axis)
+    {
+    const int u = (axis + 1) % 3;
+    const int v = (axis + 2) % 3;
+    for (int side = 0; side < 2; ++side)
+      {
+      for (int a = 0; a < grid.Dimensions[u]; ++a)
+        {
+        for (int b = 0; b < grid.Dimensions[v]; ++b)
+          {
+          vtkIdType quad[4];
+          for (int corner = 0; corner < 4; ++corner)
+            {
+            int index[3];
+            index[axis] = side * grid.Dimensions[axis];
+            index[u] = a + (corner == 1 || corner == 2);
+            index[v] = b + (corner >= 2);
+            const vtkIdType pointId =
+              grid.GetPointId(index[0], index[1], index[2]);
+            std::map<vtkIdType, vtkIdType>::const_iterator it =
+              surfacePointIds.find(pointId);
+            if (it == surfacePointIds.end())
+              {
+              double x[3];
+              grid.GetPoint(index[0], index[1], index[2], x);
+              it = surfacePointIds.insert(
+                std::make_pair(pointId, points->InsertNextPoint(x))).first;
+              }
+            quad[corner] = it->second;
+            }
+          // Outward normals
+          if (side == 0)
+            {
+            std::swap(quad[1], quad[3]);
+            }
+          vtkIdType triangle1[3] = {quad[0], quad[1], quad[2]};
+          vtkIdType triangle2[3] = {quad[0], quad[2], quad[3]};
+          triangles->InsertNextCell(3, triangle1);
+          triangles->InsertNextCell(3, triangle2);
+          }
+        }
+      }
+    }
+  surface->SetPoints(points.GetPointer());
+  surface->SetPolys(triangles.GetPointer());
+}
+
+//-----------------------------------------------------------------------------
+// Arm and forearm bones, the forearm is rotated around the z axis at the
+// elbow.
+void CreateArmature(const LimbGrid& grid, double angle, vtkPolyData* armature)
+{
+  vtkNew<vtkPoints> points;
+  points->InsertNextPoint(grid.CellSize, 0., 0.);
+  points->InsertNextPoint(grid.Length / 2., 0., 0.);
+  points->InsertNextPoint(grid.Length - grid.CellSize, 0., 0.);
+  vtkNew<vtkCellArray> bones;
+  vtkIdType arm[2] = {0, 1};
+  vtkIdType forearm[2] = {1, 2};
+  bones->InsertNextCell(2, arm);
+  bones->InsertNextCell(2, forearm);
+
+  // Rotation (column major) and translation of each bone around its head.
+  vtkNew<vtkDoubleArray> transforms;
+  transforms->SetName("Transforms");
+  transforms->SetNumberOfComponents(12);
+  const double identity[12] = {1., 0., 0., 0., 1., 0., 0., 0., 1., 0., 0., 0.};
+  const double c = cos(vtkMath::RadiansFromDegrees(angle));
+  const double s = sin(vtkMath::RadiansFromDegrees(angle));
+  const double rotation[12] = {c, s, 0., -s, c, 0., 0., 0., 1., 0., 0., 0.};
+  transforms->InsertNextTupleValue(identity);
+  transforms->InsertNextTupleValue(rotation);
+
+  armature->SetPoints(points.GetPointer());
+  armature->SetLines(bones.GetPointer());
+  armature->GetCellData()->AddArray(transforms.GetPointer());
+}
+
+} // end namespace
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+  if (argc < 2)
+    {
+    std::cerr << "Usage: " << argv[0]
+              << " <output directory> [cells across the limb] [elbow angle]"
+              << std::endl;
+    return EXIT_FAILURE;
+    }
+  const std::string directory(argv[1]);
+  const int cellsAcross = argc > 2 ? std::max(2, atoi(argv[2])) : 8;
+  const double angle = argc > 3 ? atof(argv[3]) : 150.;
+
+  // The limb is 5 times longer than thick.
+  LimbGrid grid;
+  grid.Dimensions[0] = 5 * cellsAcross;
+  grid.Dimensions[1] = cellsAcross;
+  grid.Dimensions[2] = cellsAcross;
+  grid.CellSize = 8. / cellsAcross;
+  grid.Length = grid.Dimensions[0] * grid.CellSize;
+
+  vtkNew<vtkPolyData> mesh;
+  CreateTetMesh(grid, mesh.GetPointer());
+  vtkNew<vtkPolyData> surface;
+  CreateSurface(grid, surface.GetPointer());
+  vtkNew<vtkPolyData> armature;
+  CreateArmature(grid, angle, armature.GetPointer());
+
+  if (!bender::IOUtils::WritePolyData(mesh.GetPointer(),
+                                      directory + "/BentLimb.vtk") ||
+      !bender::IOUtils::WritePolyData(surface.GetPointer(),
+                                      directory + "/BentLimbSurface.vtk") ||
+      !bender::IOUtils::WritePolyData(armature.GetPointer(),
+                                      directory + "/BentLimbArmature.vtk"))
+    {
+    std::cerr << "Can't write the bent limb in " << directory << std::endl;
+    return EXIT_FAILURE;
+    }
+  std::cout << mesh->GetNumberOfCells() << " tetrahedra, "
+            << surface->GetNumberOfCells() << " surface triangles"
+            << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -23,18 +23,144 @@
 #include "benderIOUtils.h"
 
 // ITK includes
+#include <itkMultiThreader.h>
 #include <itksys/SystemTools.hxx>
 
 // VTK includes
-#include <vtkCleanPolyData.h>
-#include <vtkGeometryFilter.h>
+#include <vtkCellArray.h>
+#include <vtkCellData.h>
+#include <vtkIdTypeArray.h>
 #include <vtkNew.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
 #include <vtkPolyData.h>
-#include <vtkCellData.h>
 #include <vtkSmartPointer.h>
-#include <vtkThreshold.h>
-#include <vtkUnstructuredGrid.h>
 
+// STD includes
+#include <algorithm>
+#include <sstream>
+#include <vector>
+
+namespace
+{
+
+//----------------------------------------------------------------------------
+// Cells of the input mesh to extract into an output mesh.
+struct MaterialMesh
+{
+  MaterialMesh() : Label(0) {}
+
+  int Label;
+  // Ids of the cells (in the input cell data) and location of their point
+  // ids in the input connectivity array.
+  std::vector<vtkIdType> CellIds;
+  std::vector<vtkIdType> CellLocations;
+  vtkSmartPointer<vtkPolyData> Output;
+};
+
+//----------------------------------------------------------------------------
+struct ExtractInfo
+{
+  vtkPolyData* Input;
+  const vtkIdType* Connectivity;
+  std::vector<MaterialMesh>* Meshes;
+};
+
+//----------------------------------------------------------------------------
+// Copy the cells of the material mesh and only the points they use, in the
+// order they are first referenced.
+void ExtractMaterialMesh(vtkPolyData* input, const vtkIdType* connectivity,
+                         MaterialMesh& mesh, std::vector<vtkIdType>& pointMap)
+{
+  vtkPoints* inputPoints = input->GetPoints();
+  vtkPointData* inputPointData = input->GetPointData();
+  vtkCellData* inputCellData = input->GetCellData();
+  vtkPolyData* output = mesh.Output;
+  vtkPointData* outputPointData = output->GetPointData();
+  vtkCellData* outputCellData = output->GetCellData();
+
+  std::vector<vtkIdType> usedPoints;
+  vtkNew<vtkIdTypeArray> cells;
+  cells->SetNumberOfValues(0);
+  for (size_t i = 0; i < mesh.CellIds.size(); ++i)
+    {
+    const vtkIdType* cell = connectivity + mesh.CellLocations[i];
+    const vtkIdType npts = cell[0];
+    cells->InsertNextValue(npts);
+    for (vtkIdType j = 1; j <= npts; ++j)
+      {
+      vtkIdType& pointId = pointMap[cell[j]];
+      if (pointId < 0)
+        {
+        pointId = static_cast<vtkIdType>(usedPoints.size());
+        usedPoints.push_back(cell[j]);
+        }
+      cells->InsertNextValue(pointId);
+      }
+    outputCellData->CopyData(inputCellData, mesh.CellIds[i], i);
+    }
+
+  vtkNew<vtkPoints> points;
+  points->SetDataType(inputPoints->GetDataType());
+  points->SetNumberOfPoints(usedPoints.size());
+  for (size_t i = 0; i < usedPoints.size(); ++i)
+    {
+    double point[3];
+    inputPoints->GetPoint(usedPoints[i], point);
+    points->SetPoint(i, point);
+    outputPointData->CopyData(inputPointData, usedPoints[i], i);
+    // Reset the map for the next mesh of the thread.
+    pointMap[usedPoints[i]] = -1;
+    }
+
+  vtkNew<vtkCellArray> polys;
+  polys->SetCells(mesh.CellIds.size(), cells.GetPointer());
+  output->SetPoints(points.GetPointer());
+  output->SetPolys(polys.GetPointer());
+}
+
+//----------------------------------------------------------------------------
+// Extract the material meshes, the meshes are split between the threads.
+ITK_THREAD_RETURN_TYPE ExtractThreaderCallback(void* arg)
+{
+  typedef itk::MultiThreader::ThreadInfoStruct ThreadInfoType;
+  ThreadInfoType* infoStruct = static_cast<ThreadInfoType*>(arg);
+  ExtractInfo* info = static_cast<ExtractInfo*>(infoStruct->UserData);
+
+  const size_t threadId = infoStruct->ThreadID;
+  const size_t numberOfThreads = infoStruct->NumberOfThreads;
+  std::vector<MaterialMesh>& meshes = *info->Meshes;
+  if (threadId >= meshes.size())
+    {
+    return ITK_THREAD_RETURN_VALUE;
+    }
+  std::vector<vtkIdType> pointMap(info->Input->GetNumberOfPoints(), -1);
+  for (size_t i = threadId; i < meshes.size(); i += numberOfThreads)
+    {
+    ExtractMaterialMesh(info->Input, info->Connectivity, meshes[i], pointMap);
+    }
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+//----------------------------------------------------------------------------
+std::string GetMaterialFileName(const std::string& fileName, int label)
+{
+  std::stringstream materialFileName;
+  const std::string path = itksys::SystemTools::GetFilenamePath(fileName);
+  if (!path.empty())
+    {
+    materialFileName << path << "/";
+    }
+  materialFileName
+    << itksys::SystemTools::GetFilenameWithoutLastExtension(fileName)
+    << "_" << label
+    << itksys::SystemTools::GetFilenameLastExtension(fileName);
+  return materialFileName.str();
+}
+
+} // end of anonymous namespace
+
+//----------------------------------------------------------------------------
 int main( int argc, char * argv[] )
 {
   PARSE_ARGS;
@@ -66,19 +192,98 @@ int main( int argc, char * argv[] )
     return EXIT_FAILURE;
     }
 
-  vtkNew<vtkThreshold> threshold;
-  threshold->SetInput(polyData);
+  // Sorted list of the materials to extract
+  std::vector<int> labels(MaterialLabels.begin(), MaterialLabels.end());
+  if (labels.empty())
+    {
+    labels.push_back(MaterialLabel);
+    }
+  std::sort(labels.begin(), labels.end());
+  labels.erase(std::unique(labels.begin(), labels.end()), labels.end());
 
-  threshold->ThresholdBetween(static_cast<double>(MaterialLabel), static_cast<double>(MaterialLabel));
+  // One mesh per material, and one for all the materials if there are many.
+  std::vector<MaterialMesh> meshes(labels.size());
+  for (size_t i = 0; i < labels.size(); ++i)
+    {
+    meshes[i].Label = labels[i];
+    }
+  MaterialMesh* allMaterialsMesh = 0;
+  if (labels.size() > 1)
+    {
+    meshes.push_back(MaterialMesh());
+    allMaterialsMesh = &meshes.back();
+    }
 
-  vtkNew<vtkGeometryFilter> polyMesh;
-  polyMesh->SetInput(threshold->GetOutput());
+  // Bucket the cells by material in a single pass. The tetrahedra are
+  // stored as polys.
+  const vtkIdType firstPolyId =
+    polyData->GetNumberOfVerts() + polyData->GetNumberOfLines();
+  vtkIdTypeArray* connectivity = polyData->GetPolys()->GetData();
+  const vtkIdType* cells = connectivity->GetPointer(0);
+  const vtkIdType connectivitySize = connectivity->GetNumberOfTuples();
+  const vtkIdType numberOfCells = scalars->GetNumberOfTuples();
+  double lastValue = 0.;
+  int lastMeshIndex = -1;
+  for (vtkIdType location = 0, cellId = firstPolyId;
+       location < connectivitySize && cellId < numberOfCells;
+       location += cells[location] + 1, ++cellId)
+    {
+    const double value = scalars->GetComponent(cellId, 0);
+    // Consecutive cells mostly share the same material
+    if (lastMeshIndex == -1 || value != lastValue)
+      {
+      std::vector<int>::const_iterator it = std::lower_bound(
+        labels.begin(), labels.end(), static_cast<int>(value));
+      lastMeshIndex = (it != labels.end() && *it == value) ?
+        static_cast<int>(it - labels.begin()) : -2;
+      lastValue = value;
+      }
+    if (lastMeshIndex < 0)
+      {
+      continue;
+      }
+    meshes[lastMeshIndex].CellIds.push_back(cellId);
+    meshes[lastMeshIndex].CellLocations.push_back(location);
+    if (allMaterialsMesh)
+      {
+      allMaterialsMesh->CellIds.push_back(cellId);
+      allMaterialsMesh->CellLocations.push_back(location);
+      }
+    }
+
+  // The attributes are allocated before the threads are started.
+  for (size_t i = 0; i < meshes.size(); ++i)
+    {
+    meshes[i].Output = vtkSmartPointer<vtkPolyData>::New();
+    meshes[i].Output->GetPointData()->CopyAllocate(polyData->GetPointData());
+    meshes[i].Output->GetCellData()->CopyAllocate(
+      cellData, meshes[i].CellIds.size());
+    }
 
-  vtkNew<vtkCleanPolyData> cleanFilter;
-  cleanFilter->SetInput(polyMesh->GetOutput());
+  ExtractInfo extractInfo;
+  extractInfo.Input = polyData;
+  extractInfo.Connectivity = cells;
+  extractInfo.Meshes = &meshes;
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  threader->SetSingleMethod(ExtractThreaderCallback, &extractInfo);
+  threader->SingleMethodExecute();
 
-  bender::IOUtils::WritePolyData(cleanFilter->GetOutput(), OutputTetMesh);
+  if (allMaterialsMesh == 0)
+    {
+    return bender::IOUtils::WritePolyData(meshes[0].Output, OutputTetMesh) ?
+      EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  bool success = true;
+  for (size_t i = 0; i < labels.size(); ++i)
+    {
+    std::cout << "Material " << labels[i] << ": "
+              << meshes[i].CellIds.size() << " cells" << std::endl;
+    success = bender::IOUtils::WritePolyData(
+      meshes[i].Output, GetMaterialFileName(OutputTetMesh, labels[i]))
+      && success;
+    }
+  success = bender::IOUtils::WritePolyData(
+    allMaterialsMesh->Output, OutputTetMesh) && success;
 
-  return EXIT_SUCCESS;
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
 }
-
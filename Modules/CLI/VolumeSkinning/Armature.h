@@ -99,14 +99,25 @@ public:
   PixelType GetBackgroundValue()const;
 
   // Label functions:
-  CharType GetEdgeLabel(EdgeType edgeId) const;
-  CharType GetMaxEdgeLabel() const;
+  // Edge labels are 16 bits (LabelType) to support large armatures.
+  LabelType GetEdgeLabel(EdgeType edgeId) const;
+  LabelType GetMaxEdgeLabel() const;
   size_t GetNumberOfEdges() const;
 
   // Set/Get dump debug information
   void SetDebug(bool);
   bool GetDebug()const;
 
+  // Set/Get the distance used to partition the body between the edges.
+  // If true, each body voxel gets the label of the closest edge voxel in
+  // Euclidean distance (exact, multi-threaded distance transform). Voxels
+  // that would be labeled across the background are labeled by propagation
+  // inside the body instead.
+  // Otherwise (default), the labels are propagated inside the body with
+  // the Manhattan distance.
+  void SetUseEuclideanVoronoi(bool);
+  bool GetUseEuclideanVoronoi()const;
+
   // Create the body partition from the armature.
   // Return success/failure.
   bool InitSkeleton(vtkPolyData* armaturePolyData);
@@ -128,6 +139,7 @@ protected:
   bool InitBones();
 
   bool Debug;
+  bool UseEuclideanVoronoi;
 };
 
 #include "Armature.txx"
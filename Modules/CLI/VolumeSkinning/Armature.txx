@@ -26,6 +26,7 @@
 
 // ITK includes
 #include <itkImage.h>
+#include <itkMultiThreader.h>
 #include <itkImageFileWriter.h>
 #include <itkStatisticsImageFilter.h>
 #include <itkImageRegionIteratorWithIndex.h>
@@ -178,12 +179,245 @@ void ComputeManhattanVoronoi(typename InputImageType::Pointer siteMap,
     }
 }
 
+//-------------------------------------------------------------------------------
+// Lines of the image processed by a pass of ComputeEuclideanVoronoi
+template<class PixelValue>
+struct EuclideanVoronoiPass
+{
+  PixelValue* Labels;
+  double* Distances; // squared distances to the closest site
+  size_t Size[3];
+  double Spacing[3];
+  unsigned int Axis;
+};
+
+//-------------------------------------------------------------------------------
+// Exact 1D squared distance transform of the sampled function f (lower
+// envelope of parabolas, Felzenszwalb & Huttenlocher), the label of the
+// parabola that is the closest is carried along.
+template<class PixelValue>
+void EuclideanVoronoi1D(size_t n, double spacing,
+                        double* f, PixelValue* labels,
+                        std::vector<size_t>& v, std::vector<double>& z,
+                        std::vector<double>& g, std::vector<PixelValue>& l)
+{
+  const double infinity = std::numeric_limits<double>::max();
+  int k = -1;
+  for (size_t q = 0; q < n; ++q)
+    {
+    if (f[q] == infinity)
+      {
+      continue;
+      }
+    double xq = q * spacing;
+    double s = -infinity;
+    while (k >= 0)
+      {
+      double xp = v[k] * spacing;
+      s = ((f[q] + xq * xq) - (f[v[k]] + xp * xp)) / (2. * (xq - xp));
+      if (s > z[k])
+        {
+        break;
+        }
+      --k;
+      }
+    ++k;
+    v[k] = q;
+    z[k] = k == 0 ? -infinity : s;
+    }
+  if (k < 0)
+    {
+    return; // no site on the line
+    }
+  z[k + 1] = infinity;
+
+  for (size_t q = 0; q < n; ++q)
+    {
+    g[q] = f[q];
+    l[q] = labels[q];
+    }
+  int j = 0;
+  for (size_t q = 0; q < n; ++q)
+    {
+    double xq = q * spacing;
+    while (z[j + 1] < xq)
+      {
+      ++j;
+      }
+    double d = xq - v[j] * spacing;
+    f[q] = d * d + g[v[j]];
+    labels[q] = l[v[j]];
+    }
+}
+
+//-------------------------------------------------------------------------------
+template<class PixelValue>
+ITK_THREAD_RETURN_TYPE EuclideanVoronoiThreaderCallback(void* arg)
+{
+  typedef itk::MultiThreader::ThreadInfoStruct ThreadInfoType;
+  ThreadInfoType* infoStruct = static_cast<ThreadInfoType*>(arg);
+  EuclideanVoronoiPass<PixelValue>* pass =
+    static_cast<EuclideanVoronoiPass<PixelValue>*>(infoStruct->UserData);
+
+  const size_t* size = pass->Size;
+  const unsigned int axis = pass->Axis;
+  const size_t n = size[axis];
+  const size_t numberOfLines = size[0] * size[1] * size[2] / n;
+  const size_t stride = axis == 0 ? 1 : (axis == 1 ? size[0] : size[0] * size[1]);
+
+  const size_t threadId = infoStruct->ThreadID;
+  const size_t numberOfThreads = infoStruct->NumberOfThreads;
+  const size_t firstLine = numberOfLines * threadId / numberOfThreads;
+  const size_t lastLine = numberOfLines * (threadId + 1) / numberOfThreads;
+
+  std::vector<double> f(n);
+  std::vector<PixelValue> labels(n);
+  std::vector<size_t> v(n);
+  std::vector<double> z(n + 1);
+  std::vector<double> g(n);
+  std::vector<PixelValue> l(n);
+  for (size_t line = firstLine; line < lastLine; ++line)
+    {
+    size_t start = 0;
+    switch (axis)
+      {
+      case 0:
+        start = line * size[0];
+        break;
+      case 1:
+        start = (line % size[0]) + (line / size[0]) * size[0] * size[1];
+        break;
+      default:
+        start = line;
+        break;
+      }
+    for (size_t i = 0; i < n; ++i)
+      {
+      f[i] = pass->Distances[start + i * stride];
+      labels[i] = pass->Labels[start + i * stride];
+      }
+    EuclideanVoronoi1D<PixelValue>(n, pass->Spacing[axis],
+                                   &f[0], &labels[0], v, z, g, l);
+    for (size_t i = 0; i < n; ++i)
+      {
+      pass->Distances[start + i * stride] = f[i];
+      pass->Labels[start + i * stride] = labels[i];
+      }
+    }
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+//-------------------------------------------------------------------------------
+// Give to each unknown voxel the label of the closest site (i.e. neither
+// background nor unknown) in Euclidean distance, constrained to the
+// foreground (i.e. non background voxels). The distance transform is
+// separable, each pass along an axis is split between threads. The
+// transform ignores the background: a voxel whose label is not connected to
+// its site through the foreground voxels of that label (e.g. an arm voxel
+// labeled by a torso edge across the gap between the arm and the torso) is
+// relabeled by propagating the labels of its neighbors through the
+// foreground.
+template<class InputImageType>
+void ComputeEuclideanVoronoi(typename InputImageType::Pointer siteMap,
+                             typename InputImageType::PixelType background,
+                             typename InputImageType::PixelType unknown)
+{
+  typedef typename InputImageType::PixelType PixelValue;
+  const typename InputImageType::RegionType region =
+    siteMap->GetBufferedRegion();
+  const size_t numberOfVoxels = region.GetNumberOfPixels();
+  PixelValue* sites = siteMap->GetBufferPointer();
+
+  std::vector<PixelValue> labels(sites, sites + numberOfVoxels);
+  std::vector<double> distances(numberOfVoxels,
+                                std::numeric_limits<double>::max());
+  for (size_t i = 0; i < numberOfVoxels; ++i)
+    {
+    if (sites[i] != background && sites[i] != unknown)
+      {
+      distances[i] = 0.;
+      }
+    }
+
+  EuclideanVoronoiPass<PixelValue> pass;
+  pass.Labels = &labels[0];
+  pass.Distances = &distances[0];
+  for (unsigned int axis = 0; axis < 3; ++axis)
+    {
+    pass.Size[axis] = region.GetSize(axis);
+    pass.Spacing[axis] = siteMap->GetSpacing()[axis];
+    }
+
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  threader->SetSingleMethod(
+    EuclideanVoronoiThreaderCallback<PixelValue>, &pass);
+  for (pass.Axis = 0; pass.Axis < 3; ++pass.Axis)
+    {
+    threader->SingleMethodExecute();
+    }
+
+  // Only keep the labels that are connected to their site through the
+  // foreground: flood each site through the voxels of its label.
+  const size_t size[3] =
+    {region.GetSize(0), region.GetSize(1), region.GetSize(2)};
+  const size_t strides[3] = {1, size[0], size[0] * size[1]};
+  std::vector<size_t> front;
+  for (size_t i = 0; i < numberOfVoxels; ++i)
+    {
+    if (sites[i] != background && sites[i] != unknown)
+      {
+      front.push_back(i);
+      }
+    }
+  bool hasDisconnectedVoxels = false;
+  while (!front.empty())
+    {
+    const size_t i = front.back();
+    front.pop_back();
+    const size_t coords[3] =
+      {i % size[0], (i / size[0]) % size[1], i / strides[2]};
+    for (unsigned int axis = 0; axis < 3; ++axis)
+      {
+      if (coords[axis] > 0)
+        {
+        const size_t j = i - strides[axis];
+        if (sites[j] == unknown && labels[j] == sites[i])
+          {
+          sites[j] = labels[j];
+          front.push_back(j);
+          }
+        }
+      if (coords[axis] + 1 < size[axis])
+        {
+        const size_t j = i + strides[axis];
+        if (sites[j] == unknown && labels[j] == sites[i])
+          {
+          sites[j] = labels[j];
+          front.push_back(j);
+          }
+        }
+      }
+    }
+  for (size_t i = 0; i < numberOfVoxels && !hasDisconnectedVoxels; ++i)
+    {
+    hasDisconnectedVoxels = (sites[i] == unknown);
+    }
+
+  // The remaining unknown voxels were reached across the background.
+  if (hasDisconnectedVoxels)
+    {
+    ComputeManhattanVoronoi<InputImageType>(siteMap, background, unknown);
+    }
+}
+
 } // end namespace
 
 //-------------------------------------------------------------------------------
 template<class T>
 ArmatureType<T>::ArmatureType(typename ImageType::Pointer image)
   : BackgroundValue(0)
+  , Debug(false)
+  , UseEuclideanVoronoi(false)
 {
   this->BodyMap = image;
 
@@ -194,21 +428,22 @@ ArmatureType<T>::ArmatureType(typename ImageType::Pointer image)
 
 //-------------------------------------------------------------------------------
 template<class T>
-CharType ArmatureType<T>::GetEdgeLabel(EdgeType i) const
+LabelType ArmatureType<T>::GetEdgeLabel(EdgeType i) const
 {
   // 0 is background, 1 is body interior so armature must start with 2
-  return static_cast<CharType>(i + ArmatureType::EdgeLabels);
+  return static_cast<LabelType>(i + ArmatureType::EdgeLabels);
 }
 
 //-------------------------------------------------------------------------------
 template<class T>
-CharType ArmatureType<T>::GetMaxEdgeLabel() const
+LabelType ArmatureType<T>::GetMaxEdgeLabel() const
 {
   assert(this->GetNumberOfEdges() > 0 &&
-         this->GetNumberOfEdges() <= std::numeric_limits<CharType>::max());
+         this->GetNumberOfEdges() + ArmatureType::EdgeLabels - 1 <=
+           std::numeric_limits<LabelType>::max());
   //return the last edge id
   EdgeType lastEdge = static_cast<EdgeType>(this->GetNumberOfEdges() - 1);
-  return static_cast<CharType>( this->GetEdgeLabel(lastEdge) );
+  return this->GetEdgeLabel(lastEdge);
 }
 
 //-------------------------------------------------------------------------------
@@ -232,6 +467,20 @@ bool ArmatureType<T>::GetDebug()const
   return this->Debug;
 }
 
+//-------------------------------------------------------------------------------
+template<class T>
+void ArmatureType<T>::SetUseEuclideanVoronoi(bool euclidean)
+{
+  this->UseEuclideanVoronoi = euclidean;
+}
+
+//-------------------------------------------------------------------------------
+template<class T>
+bool ArmatureType<T>::GetUseEuclideanVoronoi()const
+{
+  return this->UseEuclideanVoronoi;
+}
+
 //-------------------------------------------------------------------------------
 template<class T>
 void ArmatureType<T>::SetBackgroundValue(T value)
@@ -296,7 +545,7 @@ bool ArmatureType<T>::InitSkeleton(vtkPolyData* armaturePolyData)
       edgeVoxels.erase(edgeVoxels.begin());
       edgeVoxels.erase(edgeVoxels.begin() + edgeVoxels.size() - 1);
       }
-    const CharType label = ArmatureType::GetEdgeLabel(edgeId);
+    const LabelType label = ArmatureType::GetEdgeLabel(edgeId);
     size_t numOutside(0);
     for (std::vector<VoxelType>::iterator vi = edgeVoxels.begin();
          vi != edgeVoxels.end(); ++vi)
@@ -358,8 +607,16 @@ bool ArmatureType<T>::InitSkeleton(vtkPolyData* armaturePolyData)
       "DEBUG_bodybinary.mha");
     }
 
-  ComputeManhattanVoronoi<LabelImageType>(
-    this->BodyPartition, ArmatureType::BackgroundLabel, unknown);
+  if (this->UseEuclideanVoronoi)
+    {
+    ComputeEuclideanVoronoi<LabelImageType>(
+      this->BodyPartition, ArmatureType::BackgroundLabel, unknown);
+    }
+  else
+    {
+    ComputeManhattanVoronoi<LabelImageType>(
+      this->BodyPartition, ArmatureType::BackgroundLabel, unknown);
+    }
 
   return success;
 }
@@ -155,6 +155,7 @@ int DoIt( int argc, char * argv[] )
   ArmatureType<T> armature(volume);
   armature.SetBackgroundValue(BackgroundValue);
   armature.SetDebug(Debug);
+  armature.SetUseEuclideanVoronoi(EuclideanVoronoi);
   bool success = armature.InitSkeleton(armaturePolyData);
 
   bender::IOUtils::FilterProgress("Segment bones", 0.99, 0.89, 0.1);
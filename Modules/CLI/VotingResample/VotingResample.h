@@ -46,41 +46,40 @@ MAINTENANCE, SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS.
 
 #include "itkImage.h"
 #include "itkImageFileReader.h"
-#include "itkVotingResampleImageFunction.h"
-#include "itkResampleImageFilter.h"
+#include "itkVotingResampleImageFilter.h"
 #include <string>
+#include <vector>
 
 #include "itkPluginFilterWatcher.h"
 
 namespace{
 //----------------------------------------------------------------------------
+// Compute the geometry of the voting resampling of an image with the given
+// spacing. A spacing of 0 along an axis keeps the input spacing.
 template <class ImageType>
-typename ImageType::Pointer
-VotingResample(typename ImageType::Pointer input,
-               std::vector<float>& spacing,
-               std::vector<int>& highPrecedenceLabels,
-               std::vector<int>& lowPrecedenceLabels,
-               int radius,
-               bool adjustSpacing,
-               ModuleProcessInformation * processInformation = NULL,
-               double progressFraction = 1,
-               double progressStart = 0)
+void
+ComputeVotingResampleGeometry(const ImageType* input,
+                              const std::vector<float>& spacing,
+                              bool adjustSpacing,
+                              typename ImageType::SizeType& outputSize,
+                              typename ImageType::PointType& outputOrigin,
+                              typename ImageType::SpacingType& outputSpacing)
 {
   // Get the input properties
   const typename ImageType::RegionType& inputRegion = input->GetLargestPossibleRegion();
-  const typename ImageType::PointType& inputOrigin = input->GetOrigin();
+  // The largest region of the input does not necessarily start at index 0
+  // (e.g. a padded image), the output starts at its first voxel.
+  typename ImageType::PointType inputOrigin;
+  input->TransformIndexToPhysicalPoint(inputRegion.GetIndex(), inputOrigin);
   const typename ImageType::SpacingType& inputSpacing = input->GetSpacing();
   const typename ImageType::DirectionType& inputDirection = input->GetDirection();
   const typename ImageType::SizeType& inputSize = inputRegion.GetSize();
   typedef typename ImageType::SizeType::SizeValueType SizeValueType;
 
   // Setup the output
-  typename ImageType::Pointer output = ImageType::New();
-  typename ImageType::SizeType outputSize = inputRegion.GetSize();
-  typename ImageType::PointType outputOrigin = input->GetOrigin();
-  typename ImageType::IndexType outputIndex = inputRegion.GetIndex();
-  typename ImageType::SpacingType outputSpacing = input->GetSpacing();
-  typename ImageType::DirectionType outputDirection = input->GetDirection();
+  outputSize = inputRegion.GetSize();
+  outputOrigin = inputOrigin;
+  outputSpacing = input->GetSpacing();
 
   for(size_t i = 0; i < spacing.size(); i++)
     {
@@ -108,39 +107,40 @@ VotingResample(typename ImageType::Pointer input,
         inputOrigin[i] + sign * (outputSpacing[i] - inputSpacing[i]) /2.;
       }
     }
+}
 
-
-  typename ImageType::RegionType outputRegion;
-  outputRegion.SetSize(outputSize);
-  outputRegion.SetIndex(outputIndex);
-  output->SetRegions(outputRegion);
-  output->Allocate();
-  output->FillBuffer(0);
-  output->SetSpacing(outputSpacing);
-  output->SetOrigin(outputOrigin);
-  output->SetDirection(outputDirection);
-  
-  // Conduct the filter  
-  typedef itk::ResampleImageFilter<ImageType, ImageType>
-          ResampleImageFilterType;
-  typedef itk::VotingResampleImageFunction<ImageType, double>
-          VotingFunctionType;
-  typename VotingFunctionType::Pointer interpolator = VotingFunctionType::New();
-  interpolator->SetInputImage(input);
-  interpolator->SetHighPrecedenceLabels(highPrecedenceLabels);
-  interpolator->SetLowPrecedenceLabels(lowPrecedenceLabels);
-  interpolator->SetOutputSpacing(output->GetSpacing());
-  interpolator->SetRadius(radius);
-  typename ResampleImageFilterType::Pointer resample =
-    ResampleImageFilterType::New();
+//----------------------------------------------------------------------------
+template <class ImageType>
+typename ImageType::Pointer
+VotingResample(typename ImageType::Pointer input,
+               std::vector<float>& spacing,
+               std::vector<int>& highPrecedenceLabels,
+               std::vector<int>& lowPrecedenceLabels,
+               int radius,
+               bool adjustSpacing,
+               ModuleProcessInformation * processInformation = NULL,
+               double progressFraction = 1,
+               double progressStart = 0)
+{
+  typename ImageType::SizeType outputSize;
+  typename ImageType::PointType outputOrigin;
+  typename ImageType::SpacingType outputSpacing;
+  ComputeVotingResampleGeometry<ImageType>(input, spacing, adjustSpacing,
+                                           outputSize, outputOrigin,
+                                           outputSpacing);
+
+  // Conduct the filter
+  typedef itk::VotingResampleImageFilter<ImageType> VotingFilterType;
+  typename VotingFilterType::Pointer resample = VotingFilterType::New();
   itk::PluginFilterWatcher resampleWatcher( resample, "Voting Resample", processInformation, progressFraction, progressStart );
   resample->SetInput(input);
-  resample->SetInterpolator(interpolator);
-  resample->SetSize(output->GetLargestPossibleRegion().GetSize());
-  resample->SetOutputSpacing(output->GetSpacing());
-  resample->SetOutputOrigin(output->GetOrigin());
-  resample->SetOutputDirection(output->GetDirection());
-  resample->Update(); 
+  resample->SetHighPrecedenceLabels(highPrecedenceLabels);
+  resample->SetLowPrecedenceLabels(lowPrecedenceLabels);
+  resample->SetRadius(radius);
+  resample->SetSize(outputSize);
+  resample->SetOutputSpacing(outputSpacing);
+  resample->SetOutputOrigin(outputOrigin);
+  resample->Update();
 
   // return the result
   return resample->GetOutput();